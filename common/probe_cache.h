@@ -0,0 +1,248 @@
+/**
+ * 流探测结果的缓存，C 和 C++ 都可以包含
+ *
+ * avformat_find_stream_info 要读一段数据、打开解码器解几帧才能把流参数补全，
+ * 打开小文件时大部分时间花在这里。第一次打开文件时照常探测，然后把输入格式、
+ * 每个流的编解码参数、帧率和时长写到同目录下的缓存文件 <文件名>.probe。
+ * 之后打开同一个文件，文件大小和修改时间都对得上时：
+ * 1. 直接用缓存里的输入格式打开，不再探测格式，probesize 设成最小值
+ * 2. 跳过 avformat_find_stream_info，把缓存的参数填回每个 AVStream
+ * 打开后的流数量、类型、编码器或者 time_base 和缓存对不上时，关掉文件重新完整探测一次并更新缓存。
+ * sffplay 和 ffmpeg_sdk_tutorial 都把 common 目录加到头文件搜索路径里包含它，缓存格式只有这一份实现。
+ */
+
+#ifndef COMMON_PROBE_CACHE_H
+#define COMMON_PROBE_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavformat/avformat.h>
+#ifdef __cplusplus
+}
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define PROBE_CACHE_MAGIC "probe-cache 1"
+// 命中缓存时打开文件用的 probesize，avformat 允许的最小值
+#define PROBE_CACHE_PROBESIZE "32"
+
+typedef struct ProbeCacheHeader {
+    char format_name[64];
+    int nb_streams;
+    long long start_time;
+    long long duration;
+    long long bit_rate;
+} ProbeCacheHeader;
+
+static inline void probe_cache_path(const char *filename, char *path, size_t size) {
+    snprintf(path, size, "%s.probe", filename);
+}
+
+/**
+ * 读取缓存文件头：magic，然后一行是文件大小、修改时间、输入格式名、流数量、开始时间、时长和码率
+ * 源文件变了返回 -1
+ */
+static inline int probe_cache_read_header(FILE *fp, const struct stat *st, ProbeCacheHeader *h) {
+    char magic[32];
+    long long file_size, mtime;
+
+    if (!fgets(magic, sizeof(magic), fp) || strncmp(magic, PROBE_CACHE_MAGIC, strlen(PROBE_CACHE_MAGIC)) != 0)
+        return -1;
+    if (fscanf(fp, "%lld %lld %63s %d %lld %lld %lld", &file_size, &mtime, h->format_name,
+               &h->nb_streams, &h->start_time, &h->duration, &h->bit_rate) != 7)
+        return -1;
+    if (file_size != (long long) st->st_size || mtime != (long long) st->st_mtime || h->nb_streams <= 0)
+        return -1;
+    return 0;
+}
+
+/**
+ * 每个流一行：类型、编码器、tag、像素或采样格式、码率、bits_per_coded_sample、profile、level、宽高、
+ * 宽高比、采样率、声道数、声道布局、frame_size、time_base、r_frame_rate、avg_frame_rate、
+ * 开始时间、时长、帧数，最后是 extradata 的长度和十六进制内容，没有时是 "-"
+ */
+static inline int probe_cache_apply_stream(AVStream *st, FILE *fp) {
+    AVCodecParameters *par = st->codecpar;
+    int type, codec_id, format, bits_per_coded_sample, profile, level, width, height;
+    int sar_num, sar_den, sample_rate, channels, frame_size, tb_num, tb_den;
+    int r_num, r_den, avg_num, avg_den, extradata_size, i;
+    unsigned int codec_tag, byte;
+    char empty;
+    unsigned long long channel_layout;
+    long long bit_rate, start_time, duration, nb_frames;
+    uint8_t *extradata;
+
+    if (fscanf(fp, "%d %d %u %d %lld %d %d %d %d %d %d %d %d %d %llu %d %d %d %d %d %d %d %lld %lld %lld %d",
+               &type, &codec_id, &codec_tag, &format, &bit_rate, &bits_per_coded_sample, &profile, &level,
+               &width, &height, &sar_num, &sar_den, &sample_rate, &channels, &channel_layout, &frame_size,
+               &tb_num, &tb_den, &r_num, &r_den, &avg_num, &avg_den, &start_time, &duration, &nb_frames,
+               &extradata_size) != 26)
+        return -1;
+    // 解复用器读文件头得到的信息和缓存对不上，说明缓存不能用
+    if (type != par->codec_type || codec_id != par->codec_id ||
+        tb_num != st->time_base.num || tb_den != st->time_base.den || extradata_size < 0)
+        return -1;
+
+    if (extradata_size == 0) {
+        if (fscanf(fp, " %c", &empty) != 1 || empty != '-')
+            return -1;
+    } else {
+        extradata = (uint8_t *) av_mallocz(extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!extradata)
+            return -1;
+        for (i = 0; i < extradata_size; i++) {
+            if (fscanf(fp, "%2x", &byte) != 1) {
+                av_free(extradata);
+                return -1;
+            }
+            extradata[i] = (uint8_t) byte;
+        }
+        // 解复用器已经从文件头读出 extradata 时用它自己的
+        if (par->extradata_size == 0) {
+            av_free(par->extradata);
+            par->extradata = extradata;
+            par->extradata_size = extradata_size;
+        } else {
+            av_free(extradata);
+        }
+    }
+
+    par->codec_tag = codec_tag;
+    par->format = format;
+    par->bit_rate = bit_rate;
+    par->bits_per_coded_sample = bits_per_coded_sample;
+    par->profile = profile;
+    par->level = level;
+    par->width = width;
+    par->height = height;
+    par->sample_aspect_ratio.num = sar_num;
+    par->sample_aspect_ratio.den = sar_den;
+    par->sample_rate = sample_rate;
+    par->channels = channels;
+    par->channel_layout = channel_layout;
+    par->frame_size = frame_size;
+    st->r_frame_rate.num = r_num;
+    st->r_frame_rate.den = r_den;
+    st->avg_frame_rate.num = avg_num;
+    st->avg_frame_rate.den = avg_den;
+    if (st->start_time == AV_NOPTS_VALUE)
+        st->start_time = start_time;
+    if (st->duration == AV_NOPTS_VALUE)
+        st->duration = duration;
+    if (st->nb_frames == 0)
+        st->nb_frames = nb_frames;
+    return 0;
+}
+
+static inline int probe_cache_save(const AVFormatContext *fmt, const char *filename, const struct stat *st) {
+    char path[1100], format_name[64];
+    unsigned int i;
+    int j;
+    FILE *fp;
+
+    probe_cache_path(filename, path, sizeof(path));
+    fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    // "mov,mp4,m4a,3gp,3g2,mj2" 这样的名字只保留第一个，av_find_input_format 用它就能找到
+    snprintf(format_name, sizeof(format_name), "%s", fmt->iformat->name);
+    format_name[strcspn(format_name, ",")] = '\0';
+    fprintf(fp, "%s\n%lld %lld %s %u %lld %lld %lld\n", PROBE_CACHE_MAGIC,
+            (long long) st->st_size, (long long) st->st_mtime, format_name, fmt->nb_streams,
+            (long long) fmt->start_time, (long long) fmt->duration, (long long) fmt->bit_rate);
+    for (i = 0; i < fmt->nb_streams; i++) {
+        const AVStream *s = fmt->streams[i];
+        const AVCodecParameters *par = s->codecpar;
+        fprintf(fp, "%d %d %u %d %lld %d %d %d %d %d %d %d %d %d %llu %d %d %d %d %d %d %d %lld %lld %lld %d ",
+                par->codec_type, par->codec_id, par->codec_tag, par->format, (long long) par->bit_rate,
+                par->bits_per_coded_sample, par->profile, par->level, par->width, par->height,
+                par->sample_aspect_ratio.num, par->sample_aspect_ratio.den, par->sample_rate, par->channels,
+                (unsigned long long) par->channel_layout, par->frame_size, s->time_base.num, s->time_base.den,
+                s->r_frame_rate.num, s->r_frame_rate.den, s->avg_frame_rate.num, s->avg_frame_rate.den,
+                (long long) s->start_time, (long long) s->duration, (long long) s->nb_frames,
+                par->extradata_size);
+        if (par->extradata_size == 0)
+            fputc('-', fp);
+        for (j = 0; j < par->extradata_size; j++)
+            fprintf(fp, "%02x", par->extradata[j]);
+        fputc('\n', fp);
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+// 用缓存打开，任何一步对不上都返回 -1，这时 *pfmt 已经关闭
+static inline int probe_cache_open_cached(AVFormatContext **pfmt, const char *filename, const struct stat *st) {
+    char path[1100];
+    ProbeCacheHeader h;
+    const AVInputFormat *iformat = NULL;
+    AVDictionary *opts = NULL;
+    FILE *fp;
+    int ret = -1, i;
+
+    probe_cache_path(filename, path, sizeof(path));
+    fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    if (probe_cache_read_header(fp, st, &h) < 0 || !(iformat = av_find_input_format(h.format_name)))
+        goto end;
+    av_dict_set(&opts, "probesize", PROBE_CACHE_PROBESIZE, 0);
+    ret = avformat_open_input(pfmt, filename, iformat, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+    // 文件头里没有流信息的格式（比如 MPEG-TS）这时还看不到流，只能完整探测
+    ret = (*pfmt)->nb_streams == (unsigned int) h.nb_streams ? 0 : -1;
+    for (i = 0; ret == 0 && i < h.nb_streams; i++)
+        ret = probe_cache_apply_stream((*pfmt)->streams[i], fp);
+    if (ret < 0) {
+        avformat_close_input(pfmt);
+        goto end;
+    }
+    if ((*pfmt)->start_time == AV_NOPTS_VALUE)
+        (*pfmt)->start_time = h.start_time;
+    if ((*pfmt)->duration == AV_NOPTS_VALUE)
+        (*pfmt)->duration = h.duration;
+    if ((*pfmt)->bit_rate == 0)
+        (*pfmt)->bit_rate = h.bit_rate;
+
+    end:
+    fclose(fp);
+    return ret;
+}
+
+/**
+ * 代替 avformat_open_input + avformat_find_stream_info 打开 filename
+ * iformat 和 avformat_open_input 的一样，为 NULL 时自动探测格式，命中缓存时用缓存里的格式
+ * hit 返回是否命中缓存；use_cache 为 0 时不读缓存，照常完整探测，探测完仍然更新缓存
+ * 返回值和 avformat_open_input、avformat_find_stream_info 的一样，出错时 *pfmt 已经关闭
+ */
+static inline int probe_cache_open_input(AVFormatContext **pfmt, const char *filename,
+                                         const AVInputFormat *iformat, int use_cache, int *hit) {
+    struct stat file_stat;
+    int have_stat, ret;
+
+    *hit = 0;
+    have_stat = stat(filename, &file_stat) == 0;
+    if (use_cache && have_stat && probe_cache_open_cached(pfmt, filename, &file_stat) == 0) {
+        *hit = 1;
+        return 0;
+    }
+
+    ret = avformat_open_input(pfmt, filename, iformat, NULL);
+    if (ret < 0)
+        return ret;
+    ret = avformat_find_stream_info(*pfmt, NULL);
+    if (ret < 0) {
+        avformat_close_input(pfmt);
+        return ret;
+    }
+    if (have_stat)
+        probe_cache_save(*pfmt, filename, &file_stat);
+    return ret;
+}
+
+#endif //COMMON_PROBE_CACHE_H
@@ -3,10 +3,31 @@
 
 #include <stdint.h>
 
-int32_t init_audio_decoder(char *audio_codec_id);
+#include "av_pool.h"
 
-void destroy_audio_decoder();
+struct IoContext;
 
-int32_t audio_decoding();
+/**
+ * 一路音频解码的全部状态，由调用者持有并初始化为 {}，
+ * 每个函数都显式传入，多路解码可以在不同线程里同时进行
+ */
+typedef struct AudioDecoderContext {
+    const AVCodec *codec;
+    AVCodecContext *codec_ctx;
+    AVCodecParserContext *parser;
+    AVFrame *frame;
+    AVPacket *pkt;
+    enum AVCodecID audio_codec_id;
+
+    // 解码器自己分配帧数据，对象池只缓存 AVFrame/AVPacket 结构
+    FramePool frame_pool;
+    PacketPool packet_pool;
+} AudioDecoderContext;
+
+int32_t init_audio_decoder(AudioDecoderContext *ctx, const char *audio_codec_id);
+
+void destroy_audio_decoder(AudioDecoderContext *ctx);
+
+int32_t audio_decoding(AudioDecoderContext *ctx, IoContext *io);
 
 #endif
\ No newline at end of file
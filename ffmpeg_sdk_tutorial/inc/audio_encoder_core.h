@@ -3,10 +3,30 @@
 
 #include <stdint.h>
 
-int32_t init_audio_encoder(const char *codec_name);
+#include "av_pool.h"
 
-int32_t audio_encoding();
+struct IoContext;
 
-void destroy_audio_encoder();
+/**
+ * 一路音频编码的全部状态，由调用者持有并初始化为 {}，
+ * 每个函数都显式传入，多路编码可以在不同线程里同时进行
+ */
+typedef struct AudioEncoderContext {
+    const AVCodec *codec;
+    AVCodecContext *codec_ctx;
+    AVFrame *frame;
+    AVPacket *pkt;
+    enum AVCodecID audio_codec_id;
+
+    // 音频帧的大小由编码器的 frame_size 决定，对象池只缓存结构，数据用 av_frame_get_buffer 分配一次
+    FramePool frame_pool;
+    PacketPool packet_pool;
+} AudioEncoderContext;
+
+int32_t init_audio_encoder(AudioEncoderContext *ctx, const char *codec_name);
+
+int32_t audio_encoding(AudioEncoderContext *ctx, IoContext *io);
+
+void destroy_audio_encoder(AudioEncoderContext *ctx);
 
 #endif
\ No newline at end of file
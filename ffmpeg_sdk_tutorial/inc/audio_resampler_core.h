@@ -3,13 +3,34 @@
 
 #include <stdint.h>
 
-int32_t init_audio_resampler(int32_t in_sample_rate, const char *in_sample_fmt,
-                             const char *in_ch_layout, int32_t out_sample_rate,
-                             const char *out_sample_fmt,
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/samplefmt.h>
+}
+
+struct IoContext;
+struct SwrContext;
+
+/**
+ * 一路重采样的全部状态，由调用者持有并初始化为 {}，
+ * 每个函数都显式传入，多路重采样可以在不同线程里同时进行
+ */
+typedef struct AudioResamplerContext {
+    struct SwrContext *swr_ctx;
+    AVFrame *input_frame;
+    int32_t dst_nb_samples, max_dst_nb_samples, dst_nb_channels, dst_rate, src_rate;
+    enum AVSampleFormat src_sample_fmt, dst_sample_fmt;
+    uint8_t **dst_data;
+    int32_t dst_linesize;
+} AudioResamplerContext;
+
+int32_t init_audio_resampler(AudioResamplerContext *ctx, int32_t in_sample_rate,
+                             const char *in_sample_fmt, const char *in_ch_layout,
+                             int32_t out_sample_rate, const char *out_sample_fmt,
                              const char *out_ch_layout);
 
-int32_t audio_resampling();
+int32_t audio_resampling(AudioResamplerContext *ctx, IoContext *io);
 
-void destroy_audio_resampler();
+void destroy_audio_resampler(AudioResamplerContext *ctx);
 
 #endif
\ No newline at end of file
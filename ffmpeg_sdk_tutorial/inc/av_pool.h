@@ -0,0 +1,64 @@
+//
+// AVFrame/AVPacket 对象池
+//
+
+#ifndef FFMPEG_SDK_TUTORIAL_AV_POOL_H
+#define FFMPEG_SDK_TUTORIAL_AV_POOL_H
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/buffer.h>
+}
+
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * AVFrame 对象池，线程安全，可以在一个线程取、另一个线程还
+ * frame_pool_put 时只做 av_frame_unref 并把 AVFrame 结构放回空闲链表。
+ * 初始化时给了宽高和像素格式的话，frame_pool_get 返回的 frame 已经挂好了
+ * 数据缓冲区，缓冲区来自每个平面各自的 av_buffer_pool：
+ * 引用计数归零时缓冲区自动回到 av_buffer_pool，编码器还持有引用也没关系。
+ * 稳定运行后 get/put 都不会再分配内存。
+ */
+typedef struct FramePool {
+    std::mutex mutex;
+    std::vector<AVFrame *> free_frames;
+
+    // width 为 0 时只缓存 AVFrame 结构本身，数据由解码器自己分配
+    int32_t width;
+    int32_t height;
+    enum AVPixelFormat format;
+    int linesize[4];
+    AVBufferPool *planes[4];
+
+    // 统计实际分配过的 AVFrame 个数
+    int64_t nb_allocated;
+} FramePool;
+
+// AVPacket 对象池，回收时 av_packet_unref
+typedef struct PacketPool {
+    std::mutex mutex;
+    std::vector<AVPacket *> free_pkts;
+    int64_t nb_allocated;
+} PacketPool;
+
+int32_t frame_pool_init(FramePool *pool, int32_t width, int32_t height,
+                        enum AVPixelFormat format);
+
+AVFrame *frame_pool_get(FramePool *pool);
+
+void frame_pool_put(FramePool *pool, AVFrame *frame);
+
+void frame_pool_uninit(FramePool *pool);
+
+int32_t packet_pool_init(PacketPool *pool);
+
+AVPacket *packet_pool_get(PacketPool *pool);
+
+void packet_pool_put(PacketPool *pool, AVPacket *pkt);
+
+void packet_pool_uninit(PacketPool *pool);
+
+#endif //FFMPEG_SDK_TUTORIAL_AV_POOL_H
@@ -3,10 +3,38 @@
 
 #include <stdint.h>
 
-int32_t init_demuxer(char *input_name, char *video_output, char *audio_output);
+extern "C" {
+#include <libavformat/avformat.h>
+}
 
-int32_t demuxing(char *video_output_name, char *audio_output_name);
+#include "av_pool.h"
+#include "io_data.h"
 
-void destroy_demuxer();
+/**
+ * 一路解封装的全部状态，由调用者持有并初始化为 {}，
+ * 每个函数都显式传入，多路解封装可以在不同线程里同时进行
+ */
+typedef struct DemuxerContext {
+    AVFormatContext *format_ctx;
+    AVCodecContext *video_dec_ctx, *audio_dec_ctx;
+    int video_stream_index, audio_stream_index;
+    AVStream *video_stream, *audio_stream;
+    // 解出来的视频和音频分别写到两个输出文件
+    IoContext video_io, audio_io;
+    AVFrame *frame;
+    AVPacket *pkt;
+    // 解码器自己分配帧数据，对象池只缓存 AVFrame/AVPacket 结构
+    FramePool frame_pool;
+    PacketPool packet_pool;
+    // 为 1 时打开输入文件不用探测缓存（命令行的 --no-probe-cache），用来对比启动时间
+    int32_t no_probe_cache;
+} DemuxerContext;
+
+int32_t init_demuxer(DemuxerContext *ctx, char *input_name, char *video_output,
+                     char *audio_output);
+
+int32_t demuxing(DemuxerContext *ctx, char *video_output_name, char *audio_output_name);
+
+void destroy_demuxer(DemuxerContext *ctx);
 
 #endif
\ No newline at end of file
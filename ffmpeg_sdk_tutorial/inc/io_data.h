@@ -8,34 +8,71 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+#include <stddef.h>
 #include <stdint.h>
-
-int32_t open_input_output_files(const char *input_name,
+#include <stdio.h>
+
+// mmap 模式下每次交给 parser 的数据量
+#define MAP_CHUNK_SIZE (1024 * 1024)
+
+/**
+ * 一路处理流程的输入输出状态，每个 read_* / write_* 函数都显式传入，
+ * 多个 IoContext 之间互不影响，可以在不同线程里同时跑多路编解码
+ */
+typedef struct IoContext {
+    FILE *input_file;
+    FILE *output_file;
+
+    // mmap 输入模式，map_data 为空时按 fread 读取
+    uint8_t *map_data;
+    size_t map_size;
+    size_t map_pos;
+    // 文件末尾的数据拷贝到这里并补零 AV_INPUT_BUFFER_PADDING_SIZE 字节
+    uint8_t *map_tail;
+
+    // write_frame_to_yuv 聚合写入用的 iovec 数组，按需扩容
+    void *iov;
+    unsigned int iov_size;
+
+    // pcm 读写时 packed 数据的中转缓冲区，整帧转换后一次 fread/fwrite
+    uint8_t *pcm_buf;
+    unsigned int pcm_buf_size;
+} IoContext;
+
+int32_t open_input_output_files(IoContext *io, const char *input_name,
                                 const char *output_name);
 
-void close_input_output_files();
+void close_input_output_files(IoContext *io);
+
+int32_t end_of_input_file(IoContext *io);
+
+int32_t read_data_to_buf(IoContext *io, uint8_t *buf, int32_t size,
+                         int32_t &out_size);
 
-int32_t end_of_input_file();
+int32_t map_input_file(IoContext *io);
 
-int32_t read_data_to_buf(uint8_t *buf, int32_t size, int32_t &out_size);
+int32_t map_data_to_buf(IoContext *io, const uint8_t **data, int32_t size,
+                        int32_t &out_size);
 
-int32_t write_frame_to_yuv(AVFrame *frame);
+int32_t write_frame_to_yuv(IoContext *io, AVFrame *frame);
 
-int32_t read_yuv_to_frame(AVFrame *frame);
+int32_t read_yuv_to_frame(IoContext *io, AVFrame *frame);
 
-void write_pkt_to_file(AVPacket *pkt);
+void write_pkt_to_file(IoContext *io, AVPacket *pkt);
 
-int32_t write_samples_to_pcm(AVFrame *frame, AVCodecContext *codec_ctx);
+int32_t write_samples_to_pcm(IoContext *io, AVFrame *frame,
+                             AVCodecContext *codec_ctx);
 
-int32_t read_pcm_to_frame(AVFrame *frame, AVCodecContext *codec_ctx);
+int32_t read_pcm_to_frame(IoContext *io, AVFrame *frame,
+                          AVCodecContext *codec_ctx);
 
-int32_t write_samples_to_pcm2(AVFrame *frame, enum AVSampleFormat format,
-                              int channels);
+int32_t write_samples_to_pcm2(IoContext *io, AVFrame *frame,
+                              enum AVSampleFormat format, int channels);
 
-int32_t read_pcm_to_frame2(AVFrame *frame, enum AVSampleFormat format,
-                           int channels);
+int32_t read_pcm_to_frame2(IoContext *io, AVFrame *frame,
+                           enum AVSampleFormat format, int channels);
 
-void write_packed_data_to_file(const uint8_t *buf, int32_t size);
+void write_packed_data_to_file(IoContext *io, const uint8_t *buf, int32_t size);
 
 
 
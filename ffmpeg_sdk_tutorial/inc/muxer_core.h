@@ -3,11 +3,28 @@
 
 #include <stdint.h>
 
-int32_t init_muxer(char *video_input_file, char *audio_input_file,
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+/**
+ * 一路封装的全部状态，由调用者持有并初始化为 {}，
+ * 每个函数都显式传入，多路封装可以在不同线程里同时进行
+ */
+typedef struct MuxerContext {
+    AVFormatContext *video_fmt_ctx, *audio_fmt_ctx, *output_fmt_ctx;
+    AVPacket pkt;
+    int32_t in_video_st_idx, in_audio_st_idx;
+    int32_t out_video_st_idx, out_audio_st_idx;
+    // 为 1 时打开输入文件不用探测缓存（命令行的 --no-probe-cache），用来对比启动时间
+    int32_t no_probe_cache;
+} MuxerContext;
+
+int32_t init_muxer(MuxerContext *ctx, char *video_input_file, char *audio_input_file,
                    char *output_file);
 
-int32_t muxing();
+int32_t muxing(MuxerContext *ctx);
 
-void destroy_muxer();
+void destroy_muxer(MuxerContext *ctx);
 
 #endif
\ No newline at end of file
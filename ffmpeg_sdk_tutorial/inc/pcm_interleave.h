@@ -0,0 +1,61 @@
+#ifndef PCM_INTERLEAVE_H
+#define PCM_INTERLEAVE_H
+
+#include <stdint.h>
+
+/**
+ * 只有立体声的 s16/s32/flt/dbl 有向量实现（x86 上 AVX2 或 SSE2，aarch64 上 NEON），
+ * 单声道直接 memcpy；u8 和 3~8 声道（包括 5.1、7.1）还是逐个采样的标量循环，
+ * 比原来每个采样一次 fread/fwrite 快，但没有向量化。
+ * src/pcm_test 里的 PcmInterleaveTest 对比了这些实现和逐个采样的参考实现。
+ */
+
+/**
+ * 立体声用哪一种实现，PCM_KERNEL_AUTO 按编译目标和 CPU 自动选择（AVX2 > SSE2，aarch64 上 NEON），
+ * 其余的强制使用某一种，给测试和跑分逐个检查每条路径用。PCM_KERNEL_SCALAR 只走标量循环
+ */
+typedef enum PcmKernel {
+    PCM_KERNEL_AUTO,
+    PCM_KERNEL_SCALAR,
+    PCM_KERNEL_SSE2,
+    PCM_KERNEL_AVX2,
+    PCM_KERNEL_NEON,
+} PcmKernel;
+
+// 当前编译目标和 CPU 能不能用 kernel，返回 1 表示可以
+int32_t pcm_kernel_supported(PcmKernel kernel);
+
+// kernel 的名字，用于打印
+const char *pcm_kernel_name(PcmKernel kernel);
+
+/**
+ * planar -> packed: src[ch] 里是每个声道的 nb_samples 个采样，
+ * 按 LRLRLR 的顺序交错写入 dst
+ * bytes_per_sample 支持 1/2/4/8，对应 u8/s16/s32,flt/dbl
+ */
+void interleave_samples(uint8_t *dst, const uint8_t *const *src,
+                        int32_t bytes_per_sample, int32_t channels,
+                        int32_t nb_samples);
+
+/**
+ * 和 interleave_samples 一样，但强制使用 kernel，kernel 不支持时什么都不做并返回 -1
+ */
+int32_t interleave_samples_kernel(PcmKernel kernel, uint8_t *dst, const uint8_t *const *src,
+                                  int32_t bytes_per_sample, int32_t channels,
+                                  int32_t nb_samples);
+
+/**
+ * packed -> planar: 把 LRLRLR 交错的 src 拆分到每个声道的 dst[ch]
+ */
+void deinterleave_samples(uint8_t *const *dst, const uint8_t *src,
+                          int32_t bytes_per_sample, int32_t channels,
+                          int32_t nb_samples);
+
+/**
+ * 和 deinterleave_samples 一样，但强制使用 kernel，kernel 不支持时什么都不做并返回 -1
+ */
+int32_t deinterleave_samples_kernel(PcmKernel kernel, uint8_t *const *dst, const uint8_t *src,
+                                    int32_t bytes_per_sample, int32_t channels,
+                                    int32_t nb_samples);
+
+#endif
@@ -0,0 +1,28 @@
+//
+// 流探测结果缓存
+//
+
+#ifndef PROBE_CACHE_CORE_H
+#define PROBE_CACHE_CORE_H
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <stdint.h>
+
+/**
+ * 代替 avformat_open_input + avformat_find_stream_info 打开输入文件
+ * 第一次打开时照常探测，把输入格式、每个流的编解码参数、帧率和时长写到 <文件名>.probe，
+ * 之后文件大小和修改时间都没变时，用缓存里的输入格式和最小的 probesize 打开，
+ * 跳过 avformat_find_stream_info，把缓存的参数填回 AVStream。
+ * 打开后的流和缓存对不上时重新完整探测并更新缓存。
+ * input_format 为 nullptr 时自动探测格式。打印打开文件花的时间和是否命中缓存。
+ * use_cache 为 0 时不读缓存，每次都完整探测（探测完仍然更新缓存），用来对比打开文件的时间
+ * 缓存的读写用的是 common/probe_cache.h，和 sffplay 共用同一份实现
+ * 返回值和 avformat_open_input、avformat_find_stream_info 的一样，出错时 *fmt_ctx 已经关闭
+ */
+int32_t probe_cache_open_input(AVFormatContext **fmt_ctx, const char *filename,
+                               const AVInputFormat *input_format, int32_t use_cache);
+
+#endif //PROBE_CACHE_CORE_H
@@ -0,0 +1,67 @@
+//
+// 单生产者单消费者的无锁环形队列
+//
+
+#ifndef FFMPEG_SDK_TUTORIAL_SPSC_QUEUE_H
+#define FFMPEG_SDK_TUTORIAL_SPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+/**
+ * 只允许一个线程 push、一个线程 pop，push/pop 都不会阻塞，满或空时返回 false，
+ * 需要等待的话由调用者决定是自旋还是休眠。
+ * 容量向上取整到 2 的幂，head/tail 单调递增，用 & mask 取下标。
+ * head 只由消费者写，tail 只由生产者写，分在不同的 cache line 上避免伪共享。
+ */
+template<typename T>
+class SpscQueue {
+public:
+    explicit SpscQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buf.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue &) = delete;
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    bool push(const T &value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) > mask) {
+            return false;
+        }
+        buf[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = buf[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 只是一个近似值，两端都在并发修改
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    std::vector<T> buf;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+#endif //FFMPEG_SDK_TUTORIAL_SPSC_QUEUE_H
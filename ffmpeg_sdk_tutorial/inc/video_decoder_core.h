@@ -7,10 +7,62 @@
 
 #include <stdint.h>
 
-int32_t init_video_decoder();
+#include "av_pool.h"
 
-void destroy_video_decoder();
+struct IoContext;
 
-int32_t decoding();
+// 取值和 FFmpeg 的 FF_THREAD_FRAME / FF_THREAD_SLICE 相同，可以按位或
+#define VIDEO_DECODER_THREAD_FRAME 1
+#define VIDEO_DECODER_THREAD_SLICE 2
+
+/**
+ * 解码器配置
+ * thread_count: 解码线程数，0 表示按 CPU 核数自动选择，1 表示单线程
+ * thread_type: 帧级并行吞吐量高，但会多出 thread_count - 1 帧的延迟；
+ *              片级并行没有额外延迟，但要求码流本身分了多个 slice
+ * low_delay: 打开 AV_CODEC_FLAG_LOW_DELAY，FFmpeg 会因此关闭帧级并行
+ * verbose: 是否逐帧打印日志，测吞吐量时应该关掉
+ */
+typedef struct VideoDecoderConfig {
+    int32_t thread_count;
+    int32_t thread_type;
+    bool low_delay;
+    bool verbose;
+} VideoDecoderConfig;
+
+// 解码统计，decoding() 结束时打印
+typedef struct VideoDecoderStats {
+    int64_t frames;
+    double total_ms;   // decoding() 的总耗时，包含读文件和写 yuv
+    double decode_ms;  // 花在 avcodec_send_packet/avcodec_receive_frame 里的时间
+} VideoDecoderStats;
+
+/**
+ * 一路解码的全部状态，由调用者持有并初始化为 {}，每个函数都显式传入，
+ * 和 IoContext 一样，多个 VideoDecoderContext 可以在不同线程里同时解码
+ */
+typedef struct VideoDecoderContext {
+    const AVCodec *codec;
+    AVCodecContext *codec_ctx;
+    AVCodecParserContext *parser;
+    AVFrame *frame;
+    AVPacket *pkt;
+
+    // 解码器自己分配帧数据，对象池只缓存 AVFrame/AVPacket 结构
+    FramePool frame_pool;
+    PacketPool packet_pool;
+
+    bool verbose;
+    VideoDecoderStats stats;
+} VideoDecoderContext;
+
+// config 为 nullptr 时使用 FFmpeg 的默认配置（单线程）
+int32_t init_video_decoder(VideoDecoderContext *ctx, const VideoDecoderConfig *config);
+
+void get_video_decoder_stats(VideoDecoderContext *ctx, VideoDecoderStats *stats);
+
+void destroy_video_decoder(VideoDecoderContext *ctx);
+
+int32_t decoding(VideoDecoderContext *ctx, IoContext *io);
 
 #endif //FFMPEG_SDK_TUTORIAL_VIDEO_DECODER_CORE_H
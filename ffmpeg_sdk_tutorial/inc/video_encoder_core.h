@@ -7,14 +7,83 @@
 
 #include <stdint.h>
 
-// 初始化视频编码器
-int32_t init_video_encoder(const char *codec_name);
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/pixfmt.h>
+}
+
+#include "av_pool.h"
+
+struct IoContext;
+
+// 码率控制方式
+typedef enum RateControlMode {
+    RC_MODE_ABR = 0,  // 只给平均码率 bit_rate
+    RC_MODE_CRF,      // 恒定质量，忽略 bit_rate，max_rate 不为 0 时受 VBV 限制
+    RC_MODE_CBR,      // 恒定码率，bit_rate = max_rate = min_rate
+    RC_MODE_VBV,      // 平均码率 + 峰值码率 max_rate + 缓冲区 buffer_size
+} RateControlMode;
+
+/**
+ * 编码参数，width/height/pix_fmt 需要和输入的 yuv 文件一致
+ * preset 和 tune 只对 libx264/libx265 生效，决定了编码速度：
+ * 直播用 ultrafast + zerolatency，点播用 slow
+ * 码率单位都是 bit/s
+ */
+typedef struct VideoEncoderProfile {
+    int32_t width;
+    int32_t height;
+    enum AVPixelFormat pix_fmt;
+    int32_t fps;
+    int32_t gop_size;
+    int32_t max_b_frames;
+    char preset[32];
+    char tune[32];
+    RateControlMode rc_mode;
+    int32_t crf;
+    int64_t bit_rate;
+    int64_t max_rate;
+    int64_t buffer_size;
+} VideoEncoderProfile;
+
+/**
+ * 按名称填充预置的编码参数
+ * "vod": 原来硬编码的参数，352x288，400 kbps，preset slow
+ * "live": ultrafast + zerolatency，CBR，不使用 B 帧
+ */
+int32_t init_video_encoder_profile(VideoEncoderProfile *profile, const char *name);
+
+/**
+ * 一路编码的全部状态，由调用者持有并初始化为 {}，
+ * 每个函数都显式传入，多路编码可以在不同线程里同时进行
+ */
+typedef struct VideoEncoderContext {
+    const AVCodec *codec;
+    AVCodecContext *codec_ctx;
+    AVFrame *frame;
+    AVPacket *pkt;
+    VideoEncoderProfile profile;
+    // 编码器的输入帧和输出包都从对象池中获取，并行和流水线模式下反复取还
+    FramePool frame_pool;
+    PacketPool packet_pool;
+} VideoEncoderContext;
+
+// 初始化视频编码器，profile 为 nullptr 时使用 "vod" 参数
+int32_t init_video_encoder(VideoEncoderContext *ctx, const char *codec_name,
+                           const VideoEncoderProfile *profile);
 
 // 销毁视频编码器
-void destroy_video_encoder();
+void destroy_video_encoder(VideoEncoderContext *ctx);
 
 // 循环编码
-int32_t encoding(int32_t frame_cnt);
+int32_t encoding(VideoEncoderContext *ctx, IoContext *io, int32_t frame_cnt);
+
+// 读文件、编码、写文件三个线程流水线编码，结束时打印每个阶段的利用率
+int32_t pipelined_encoding(VideoEncoderContext *ctx, IoContext *io, int32_t frame_cnt);
+
+// 按 GOP 分段并行编码，workers 为 0 时使用 CPU 核数
+int32_t parallel_encoding(VideoEncoderContext *ctx, IoContext *io, int32_t frame_cnt,
+                          int32_t workers);
 
 
 #endif //FFMPEGPRO_VIDEO_ENCODER_CORE_H
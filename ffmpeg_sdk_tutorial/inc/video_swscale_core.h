@@ -3,11 +3,30 @@
 
 #include <stdint.h>
 
-int32_t init_video_swscale(char *src_size, char *src_fmt, char *dst_size,
-                           char *dst_fmt);
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
 
-int32_t transforming(int32_t frame_cnt);
+struct IoContext;
+struct SwsContext;
 
-void destroy_video_swscale();
+/**
+ * 一路图像转换的全部状态，由调用者持有并初始化为 {}，
+ * 每个函数都显式传入，多路转换可以在不同线程里同时进行
+ */
+typedef struct VideoSwscaleContext {
+    AVFrame *input_frame;
+    struct SwsContext *sws_ctx;
+    int32_t src_width, src_height, dst_width, dst_height;
+    enum AVPixelFormat src_pix_fmt, dst_pix_fmt;
+} VideoSwscaleContext;
+
+int32_t init_video_swscale(VideoSwscaleContext *ctx, char *src_size, char *src_fmt,
+                           char *dst_size, char *dst_fmt);
+
+int32_t transforming(VideoSwscaleContext *ctx, IoContext *io, int32_t frame_cnt);
+
+void destroy_video_swscale(VideoSwscaleContext *ctx);
 
 #endif
\ No newline at end of file
@@ -6,7 +6,9 @@ int main() {
     char input_file[] = "input.txt";
     char output_file[] = "output.txt";
     int32_t result = 12;
-    result = open_input_output_files(input_file, output_file);
+    IoContext io = {};
+    result = open_input_output_files(&io, input_file, output_file);
+    close_input_output_files(&io);
     std::cout << "result: " << result << std::endl;
 
 
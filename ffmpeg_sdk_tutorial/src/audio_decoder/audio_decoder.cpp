@@ -1,4 +1,5 @@
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
 
@@ -17,23 +18,33 @@ int main(int argc, char **argv) {
     std::cout << "Input file:" << std::string(input_file_name) << std::endl;
     std::cout << "output file:" << std::string(output_file_name) << std::endl;
 
-    int32_t result = open_input_output_files(input_file_name, output_file_name);
+    IoContext io = {};
+    int32_t result = open_input_output_files(&io, input_file_name, output_file_name);
     if (result < 0) {
         return result;
     }
 
-    result = init_audio_decoder("MP3");
+    // 加上 --mmap 参数时把输入文件映射到内存，parser 直接读映射区域
+    if (argc > 1 && strcmp(argv[1], "--mmap") == 0) {
+        result = map_input_file(&io);
+        if (result < 0) {
+            return result;
+        }
+    }
+
+    AudioDecoderContext decoder = {};
+    result = init_audio_decoder(&decoder, "MP3");
     if (result < 0) {
         return result;
     }
 
-    result = audio_decoding();
+    result = audio_decoding(&decoder, &io);
     if (result < 0) {
         return result;
     }
 
-    destroy_audio_decoder();
+    destroy_audio_decoder(&decoder);
 
-    close_input_output_files();
+    close_input_output_files(&io);
     return 0;
 }
\ No newline at end of file
@@ -6,82 +6,81 @@ extern "C" {
 
 #include <iostream>
 
+#include "av_pool.h"
 #include "io_data.h"
 
 #define AUDIO_INBUF_SIZE 20480
 #define AUDIO_REFILL_THRESH 4096
 
-const static AVCodec *codec = nullptr;
-static AVCodecContext *codec_ctx = nullptr;
-static AVCodecParserContext *parser = nullptr;
-
-static AVFrame *frame = nullptr;
-static AVPacket *pkt = nullptr;
-static enum AVCodecID audio_codec_id;
-
-int32_t init_audio_decoder(char *audio_codec) {
+int32_t init_audio_decoder(AudioDecoderContext *ctx, const char *audio_codec) {
     if (strcasecmp(audio_codec, "MP3") == 0) {
-        audio_codec_id = AV_CODEC_ID_MP3;
+        ctx->audio_codec_id = AV_CODEC_ID_MP3;
         std::cout << "Select codec id: MP3" << std::endl;
     } else if (strcasecmp(audio_codec, "AAC") == 0) {
-        audio_codec_id = AV_CODEC_ID_AAC;
+        ctx->audio_codec_id = AV_CODEC_ID_AAC;
         std::cout << "Select codec id: AAC" << std::endl;
     } else {
         std::cerr << "Error invalid audio format." << std::endl;
         return -1;
     }
-    codec = avcodec_find_decoder(audio_codec_id);
-    if (!codec) {
+    ctx->codec = avcodec_find_decoder(ctx->audio_codec_id);
+    if (!ctx->codec) {
         std::cerr << "Error: could not find codec." << std::endl;
         return -1;
     }
     // 初始化一个解码器的解析器
-    parser = av_parser_init(codec->id);
-    if (!parser) {
+    ctx->parser = av_parser_init(ctx->codec->id);
+    if (!ctx->parser) {
         std::cerr << "Error: could not init parser." << std::endl;
         return -1;
     }
-    codec_ctx = avcodec_alloc_context3(codec);
-    if (!codec_ctx) {
+    ctx->codec_ctx = avcodec_alloc_context3(ctx->codec);
+    if (!ctx->codec_ctx) {
         std::cerr << "Error: could not alloc codec." << std::endl;
         return -1;
     }
-    int32_t result = avcodec_open2(codec_ctx, codec, nullptr);
+    int32_t result = avcodec_open2(ctx->codec_ctx, ctx->codec, nullptr);
     if (result < 0) {
         std::cerr << "Error: could not open codec." << std::endl;
         return -1;
     }
-    frame = av_frame_alloc();
-    if (!frame) {
+    frame_pool_init(&ctx->frame_pool, 0, 0, AV_PIX_FMT_NONE);
+    packet_pool_init(&ctx->packet_pool);
+    ctx->frame = frame_pool_get(&ctx->frame_pool);
+    if (!ctx->frame) {
         std::cerr << "Error: could not alloc frame." << std::endl;
         return -1;
     }
-    pkt = av_packet_alloc();
-    if (!pkt) {
+    ctx->pkt = packet_pool_get(&ctx->packet_pool);
+    if (!ctx->pkt) {
         std::cerr << "Error: could not alloc packet." << std::endl;
         return -1;
     }
     return 0;
 }
 
-void destroy_audio_decoder() {
-    av_parser_close(parser);
-    avcodec_free_context(&codec_ctx);
-    av_frame_free(&frame);
-    av_packet_free(&pkt);
+void destroy_audio_decoder(AudioDecoderContext *ctx) {
+    av_parser_close(ctx->parser);
+    avcodec_free_context(&ctx->codec_ctx);
+    frame_pool_put(&ctx->frame_pool, ctx->frame);
+    ctx->frame = nullptr;
+    packet_pool_put(&ctx->packet_pool, ctx->pkt);
+    ctx->pkt = nullptr;
+    frame_pool_uninit(&ctx->frame_pool);
+    packet_pool_uninit(&ctx->packet_pool);
 }
 
-static int32_t decode_packet(bool flushing) {
+static int32_t decode_packet(AudioDecoderContext *ctx, IoContext *io, bool flushing) {
     int32_t result = 0;
     // 把packet数据发送到codec_ctx，如果是flushing，则发送nullptr到codec_ctx
-    result = avcodec_send_packet(codec_ctx, flushing ? nullptr : pkt);
+    result = avcodec_send_packet(ctx->codec_ctx, flushing ? nullptr : ctx->pkt);
     if (result < 0) {
         std::cerr << "Error: failed to send packet, result:" << result << std::endl;
         return -1;
     }
     while (result >= 0) {
         // 前面把 packet(编码后的数据)传给codec，这里可以取出解码后的 frame
-        result = avcodec_receive_frame(codec_ctx, frame);
+        result = avcodec_receive_frame(ctx->codec_ctx, ctx->frame);
         if (result == AVERROR(EAGAIN) || result == AVERROR_EOF)
             return 1;
         else if (result < 0) {
@@ -93,9 +92,9 @@ static int32_t decode_packet(bool flushing) {
             std::cout << "Flushing:";
         }
         // 将解码后的 frame 写入文件
-        write_samples_to_pcm(frame, codec_ctx);
-        std::cout << "frame->nb_samples:" << frame->nb_samples
-                  << ", frame->channels:" << frame->channels << std::endl;
+        write_samples_to_pcm(io, ctx->frame, ctx->codec_ctx);
+        std::cout << "frame->nb_samples:" << ctx->frame->nb_samples
+                  << ", frame->channels:" << ctx->frame->channels << std::endl;
     }
     return result;
 }
@@ -155,23 +154,28 @@ int32_t get_audio_format(AVCodecContext *codec_ctx) {
     return 0;
 }
 
-int32_t audio_decoding() {
+int32_t audio_decoding(AudioDecoderContext *ctx, IoContext *io) {
     uint8_t inbuf[AUDIO_INBUF_SIZE + AV_INPUT_BUFFER_PADDING_SIZE] = {0};
     int32_t result = 0;
-    uint8_t *data = nullptr;
+    const uint8_t *data = nullptr;
     int32_t data_size = 0;
-    while (!end_of_input_file()) {
-        result = read_data_to_buf(inbuf, AUDIO_INBUF_SIZE, data_size);
+    while (!end_of_input_file(io)) {
+        if (io->map_data != nullptr) {
+            // 输入文件已经 mmap，直接从映射区域解析
+            result = map_data_to_buf(io, &data, MAP_CHUNK_SIZE, data_size);
+        } else {
+            result = read_data_to_buf(io, inbuf, AUDIO_INBUF_SIZE, data_size);
+            data = inbuf;
+        }
         if (result < 0) {
-            std::cerr << "Error: read_data_to_buf failed." << std::endl;
+            std::cerr << "Error: read input data failed." << std::endl;
             return -1;
         }
 
-        data = inbuf;
         while (data_size > 0) {
             std::cout << ", data_size: " << data_size << std::endl;
             // 从 buf 里解码数据到 packet
-            result = av_parser_parse2(parser, codec_ctx, &pkt->data, &pkt->size, data,
+            result = av_parser_parse2(ctx->parser, ctx->codec_ctx, &ctx->pkt->data, &ctx->pkt->size, data,
                                       data_size, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
             if (result < 0) {
                 std::cerr << "Error: av_parser_parse2 failed." << std::endl;
@@ -180,13 +184,13 @@ int32_t audio_decoding() {
             // 数据指针后移result字节
             data += result;
             data_size -= result;
-            if (pkt->size) {
-                std::cout << "Parsed packet size:" << pkt->size << std::endl;
-                decode_packet(false);
+            if (ctx->pkt->size) {
+                std::cout << "Parsed packet size:" << ctx->pkt->size << std::endl;
+                decode_packet(ctx, io, false);
             }
         }
     }
-    decode_packet(true);
-    get_audio_format(codec_ctx);
+    decode_packet(ctx, io, true);
+    get_audio_format(ctx->codec_ctx);
     return 0;
 }
@@ -35,22 +35,24 @@ int main() {
     std::cout << "output file:" << std::string(output_file_name) << std::endl;
     std::cout << "codec name:" << std::string(codec_name) << std::endl;
 
-    int32_t result = open_input_output_files(input_file_name, output_file_name);
+    IoContext io = {};
+    int32_t result = open_input_output_files(&io, input_file_name, output_file_name);
     if (result < 0) {
         return result;
     }
 
-    result = init_audio_encoder(codec_name);
+    AudioEncoderContext encoder = {};
+    result = init_audio_encoder(&encoder, codec_name);
     if (result < 0) {
         return result;
     }
-    result = audio_encoding();
+    result = audio_encoding(&encoder, &io);
     if (result < 0) {
         goto failed;
     }
 
     failed:
-    destroy_audio_encoder();
-    close_input_output_files();
+    destroy_audio_encoder(&encoder);
+    close_input_output_files(&io);
     return 0;
 }
\ No newline at end of file
@@ -13,15 +13,9 @@ extern "C" {
 #include <libavutil/samplefmt.h>
 }
 
+#include "av_pool.h"
 #include "io_data.h"
 
-const static AVCodec *codec = nullptr;
-static AVCodecContext *codec_ctx = nullptr;
-static AVFrame *frame = nullptr;
-static AVPacket *pkt = nullptr;
-
-static enum AVCodecID audio_codec_id;
-
 /* select layout with the highest channel count */
 static int select_channel_layout(const AVCodec *codec, AVChannelLayout *dst)
 {
@@ -46,67 +40,69 @@ static int select_channel_layout(const AVCodec *codec, AVChannelLayout *dst)
     return av_channel_layout_copy(dst, best_ch_layout);
 }
 
-int32_t init_audio_encoder(const char *codec_name) {
+int32_t init_audio_encoder(AudioEncoderContext *ctx, const char *codec_name) {
     if (strcasecmp(codec_name, "MP3") == 0) {
-        audio_codec_id = AV_CODEC_ID_MP3;
+        ctx->audio_codec_id = AV_CODEC_ID_MP3;
         std::cout << "Select codec id: MP3" << std::endl;
     } else if (strcasecmp(codec_name, "AAC") == 0) {
-        audio_codec_id = AV_CODEC_ID_AAC;
+        ctx->audio_codec_id = AV_CODEC_ID_AAC;
         std::cout << "Select codec id: AAC" << std::endl;
     } else {
         std::cerr << "Error invalid audio format." << std::endl;
         return -1;
     }
 
-    codec = avcodec_find_encoder(audio_codec_id);
-    if (!codec) {
+    ctx->codec = avcodec_find_encoder(ctx->audio_codec_id);
+    if (!ctx->codec) {
         std::cerr << "Error: could not find codec." << std::endl;
         return -1;
     }
 
-    codec_ctx = avcodec_alloc_context3(codec);
-    if (!codec_ctx) {
+    ctx->codec_ctx = avcodec_alloc_context3(ctx->codec);
+    if (!ctx->codec_ctx) {
         std::cerr << "Error: could not alloc codec." << std::endl;
         return -1;
     }
 
     // 设置音频编码器的参数
-    codec_ctx->bit_rate = 128000;                // 设置输出码率为128Kbps
+    ctx->codec_ctx->bit_rate = 128000;                // 设置输出码率为128Kbps
 //    codec_ctx->sample_fmt = AV_SAMPLE_FMT_FLTP;  // 音频采样格式为fltp
-    codec_ctx->sample_fmt = AV_SAMPLE_FMT_S16P;
-    codec_ctx->sample_rate = 44100;              // 音频采样率为44.1kHz
-    int ret = select_channel_layout(codec, &codec_ctx->ch_layout);
+    ctx->codec_ctx->sample_fmt = AV_SAMPLE_FMT_S16P;
+    ctx->codec_ctx->sample_rate = 44100;              // 音频采样率为44.1kHz
+    int ret = select_channel_layout(ctx->codec, &ctx->codec_ctx->ch_layout);
     if (ret < 0) {
         return -1;
     }
 //    codec_ctx->channel_layout = AV_CH_LAYOUT_STEREO;  // 声道布局为立体声
 //    codec_ctx->channels = 2;                          // 声道数为双声道
 
-    int32_t result = avcodec_open2(codec_ctx, codec, nullptr);
+    int32_t result = avcodec_open2(ctx->codec_ctx, ctx->codec, nullptr);
     if (result < 0) {
         std::cerr << "Error: could not open codec." << std::endl;
         return -1;
     }
 
-    frame = av_frame_alloc();
-    if (!frame) {
+    frame_pool_init(&ctx->frame_pool, 0, 0, AV_PIX_FMT_NONE);
+    packet_pool_init(&ctx->packet_pool);
+    ctx->frame = frame_pool_get(&ctx->frame_pool);
+    if (!ctx->frame) {
         std::cerr << "Error: could not alloc frame." << std::endl;
         return -1;
     }
 
-    frame->nb_samples = codec_ctx->frame_size;
-    frame->format = codec_ctx->sample_fmt;
-    frame->ch_layout = codec_ctx->ch_layout;
+    ctx->frame->nb_samples = ctx->codec_ctx->frame_size;
+    ctx->frame->format = ctx->codec_ctx->sample_fmt;
+    ctx->frame->ch_layout = ctx->codec_ctx->ch_layout;
 //    frame->channel_layout = codec_ctx->channel_layout;
     // 填充 frame.data数组和frame.buf数组
-    result = av_frame_get_buffer(frame, 0);
+    result = av_frame_get_buffer(ctx->frame, 0);
     if (result < 0) {
         std::cerr << "Error: AVFrame could not get buffer." << std::endl;
         return -1;
     }
 
-    pkt = av_packet_alloc();
-    if (!pkt) {
+    ctx->pkt = packet_pool_get(&ctx->packet_pool);
+    if (!ctx->pkt) {
         std::cerr << "Error: could not alloc packet." << std::endl;
         return -1;
     }
@@ -114,24 +110,24 @@ int32_t init_audio_encoder(const char *codec_name) {
 }
 
 // 将 frame 编码成 packet 保存到文件中
-static int32_t encode_frame(bool flushing) {
+static int32_t encode_frame(AudioEncoderContext *ctx, IoContext *io, bool flushing) {
     int32_t result = 0;
-    result = avcodec_send_frame(codec_ctx, flushing ? nullptr : frame);
+    result = avcodec_send_frame(ctx->codec_ctx, flushing ? nullptr : ctx->frame);
     if (result < 0) {
         std::cerr << "Error: avcodec_send_frame failed." << std::endl;
         return result;
     }
 
     while (result >= 0) {
-        result = avcodec_receive_packet(codec_ctx, pkt);
+        result = avcodec_receive_packet(ctx->codec_ctx, ctx->pkt);
         if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
             return 1;
         } else if (result < 0) {
             std::cerr << "Error: avcodec_receive_packet failed." << std::endl;
             return result;
         }
-        std::cout << "received pkt size:" << pkt->size << std::endl;
-        write_pkt_to_file(pkt);
+        std::cout << "received pkt size:" << ctx->pkt->size << std::endl;
+        write_pkt_to_file(io, ctx->pkt);
     }
     return 0;
 }
@@ -139,22 +135,22 @@ static int32_t encode_frame(bool flushing) {
 /*
  * 编码pcm文件里的音频数据
  */
-int32_t audio_encoding() {
+int32_t audio_encoding(AudioEncoderContext *ctx, IoContext *io) {
     int32_t result = 0;
-    while (!end_of_input_file()) {
-        result = read_pcm_to_frame(frame, codec_ctx);
+    while (!end_of_input_file(io)) {
+        result = read_pcm_to_frame(io, ctx->frame, ctx->codec_ctx);
         if (result < 0) {
             std::cerr << "Error: read_pcm_to_frame failed." << std::endl;
             return -1;
         }
 
-        result = encode_frame(false);
+        result = encode_frame(ctx, io, false);
         if (result < 0) {
             std::cerr << "Error: encode_frame failed." << std::endl;
             return result;
         }
     }
-    result = encode_frame(true);
+    result = encode_frame(ctx, io, true);
     if (result < 0) {
         std::cerr << "Error: flushing failed." << std::endl;
         return result;
@@ -162,8 +158,12 @@ int32_t audio_encoding() {
     return 0;
 }
 
-void destroy_audio_encoder() {
-    av_frame_free(&frame);
-    av_packet_free(&pkt);
-    avcodec_free_context(&codec_ctx);
+void destroy_audio_encoder(AudioEncoderContext *ctx) {
+    frame_pool_put(&ctx->frame_pool, ctx->frame);
+    ctx->frame = nullptr;
+    packet_pool_put(&ctx->packet_pool, ctx->pkt);
+    ctx->pkt = nullptr;
+    frame_pool_uninit(&ctx->frame_pool);
+    packet_pool_uninit(&ctx->packet_pool);
+    avcodec_free_context(&ctx->codec_ctx);
 }
@@ -23,12 +23,14 @@ int main(int argc, char **argv) {
     char out_sample_fmt[] = "s16";
     char out_sample_layout[] = "STEREO";
 
-    result = open_input_output_files(input_file_name, output_file_name);
+    IoContext io = {};
+    result = open_input_output_files(&io, input_file_name, output_file_name);
     if (result < 0) {
         std::cerr << "open input and output error!!";
     }
     // 做重采样的所有准备
-    result = init_audio_resampler(in_sample_rate, in_sample_fmt,
+    AudioResamplerContext resampler = {};
+    result = init_audio_resampler(&resampler, in_sample_rate, in_sample_fmt,
                                   in_sample_layout, out_sample_rate,
                                   out_sample_fmt, out_sample_layout);
     if (result < 0) {
@@ -36,14 +38,14 @@ int main(int argc, char **argv) {
         return result;
     }
     // 开始重采样
-    result = audio_resampling();
+    result = audio_resampling(&resampler, &io);
     if (result < 0) {
         std::cerr << "Error: audio_resampling failed." << std::endl;
         return result;
     }
 
-    close_input_output_files();
-    destroy_audio_resampler();
+    close_input_output_files(&io);
+    destroy_audio_resampler(&resampler);
     std::cout << "END!!!!" << std::endl;
     return result;
 }
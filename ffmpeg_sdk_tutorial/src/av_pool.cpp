@@ -0,0 +1,164 @@
+//
+// AVFrame/AVPacket 对象池
+//
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include <iostream>
+
+#include "av_pool.h"
+
+// 和 av_frame_get_buffer 一样，行宽按 32 字节对齐，方便 SIMD 访问
+#define POOL_LINESIZE_ALIGN 32
+
+int32_t frame_pool_init(FramePool *pool, int32_t width, int32_t height,
+                        enum AVPixelFormat format) {
+    pool->width = width;
+    pool->height = height;
+    pool->format = format;
+    pool->nb_allocated = 0;
+    for (int32_t i = 0; i < 4; i++) {
+        pool->linesize[i] = 0;
+        pool->planes[i] = nullptr;
+    }
+    if (width <= 0) {
+        return 0;
+    }
+
+    int32_t result = av_image_fill_linesizes(pool->linesize, format,
+                                             FFALIGN(width, POOL_LINESIZE_ALIGN));
+    if (result < 0) {
+        std::cerr << "Error: frame pool could not get linesize." << std::endl;
+        return -1;
+    }
+    size_t sizes[4] = {0};
+    ptrdiff_t linesizes[4];
+    for (int32_t i = 0; i < 4; i++) {
+        linesizes[i] = pool->linesize[i];
+    }
+    result = av_image_fill_plane_sizes(sizes, format, height, linesizes);
+    if (result < 0) {
+        std::cerr << "Error: frame pool could not get plane size." << std::endl;
+        return -1;
+    }
+    for (int32_t i = 0; i < 4 && sizes[i] > 0; i++) {
+        // 多留 16 字节，和 av_frame_get_buffer 一样允许 SIMD 读越过行尾
+        pool->planes[i] = av_buffer_pool_init(sizes[i] + 16 + POOL_LINESIZE_ALIGN - 1,
+                                              nullptr);
+        if (!pool->planes[i]) {
+            std::cerr << "Error: could not init av_buffer_pool." << std::endl;
+            frame_pool_uninit(pool);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// 从 av_buffer_pool 取出每个平面的缓冲区挂到 frame 上
+static int32_t frame_pool_attach_buffers(FramePool *pool, AVFrame *frame) {
+    frame->width = pool->width;
+    frame->height = pool->height;
+    frame->format = pool->format;
+    for (int32_t i = 0; i < 4 && pool->planes[i]; i++) {
+        frame->buf[i] = av_buffer_pool_get(pool->planes[i]);
+        if (!frame->buf[i]) {
+            av_frame_unref(frame);
+            return -1;
+        }
+        frame->data[i] = (uint8_t *) FFALIGN((uintptr_t) frame->buf[i]->data,
+                                             POOL_LINESIZE_ALIGN);
+        frame->linesize[i] = pool->linesize[i];
+    }
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+AVFrame *frame_pool_get(FramePool *pool) {
+    AVFrame *frame = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        if (!pool->free_frames.empty()) {
+            frame = pool->free_frames.back();
+            pool->free_frames.pop_back();
+        }
+    }
+    if (!frame) {
+        frame = av_frame_alloc();
+        if (!frame) {
+            std::cerr << "Error: could not allocate AVFrame." << std::endl;
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->nb_allocated++;
+    }
+    if (pool->planes[0] && frame_pool_attach_buffers(pool, frame) < 0) {
+        std::cerr << "Error: could not get AVFrame buffer from pool." << std::endl;
+        frame_pool_put(pool, frame);
+        return nullptr;
+    }
+    return frame;
+}
+
+void frame_pool_put(FramePool *pool, AVFrame *frame) {
+    if (!frame) {
+        return;
+    }
+    // 释放对数据缓冲区的引用，最后一个引用释放时缓冲区回到 av_buffer_pool
+    av_frame_unref(frame);
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->free_frames.push_back(frame);
+}
+
+void frame_pool_uninit(FramePool *pool) {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    for (AVFrame *frame: pool->free_frames) {
+        av_frame_free(&frame);
+    }
+    pool->free_frames.clear();
+    // 还有缓冲区在外面被引用时，av_buffer_pool 会等它们都回来之后再释放
+    for (int32_t i = 0; i < 4; i++) {
+        av_buffer_pool_uninit(&pool->planes[i]);
+    }
+}
+
+int32_t packet_pool_init(PacketPool *pool) {
+    pool->nb_allocated = 0;
+    return 0;
+}
+
+AVPacket *packet_pool_get(PacketPool *pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        if (!pool->free_pkts.empty()) {
+            AVPacket *pkt = pool->free_pkts.back();
+            pool->free_pkts.pop_back();
+            return pkt;
+        }
+        pool->nb_allocated++;
+    }
+    AVPacket *pkt = av_packet_alloc();
+    if (!pkt) {
+        std::cerr << "Error: could not allocate AVPacket." << std::endl;
+    }
+    return pkt;
+}
+
+void packet_pool_put(PacketPool *pool, AVPacket *pkt) {
+    if (!pkt) {
+        return;
+    }
+    av_packet_unref(pkt);
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->free_pkts.push_back(pkt);
+}
+
+void packet_pool_uninit(PacketPool *pool) {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    for (AVPacket *pkt: pool->free_pkts) {
+        av_packet_free(&pkt);
+    }
+    pool->free_pkts.clear();
+}
@@ -6,17 +6,24 @@
 
 /**
  * 音视频解封装，将封装格式 FLV MPEG-TS MP4 解成音频和视频格式
+ * 用法：demuxer [--no-probe-cache]，--no-probe-cache 不用探测缓存，打印完整探测时打开文件的时间
  */
 int main(int argc, char **argv) {
     char input_file[] = "demuxer.mp4";
     char output_v[] = "demuxer.yuv";
     char output_a[] = "demuxer.pcm";
-    int32_t result = init_demuxer(input_file, output_v, output_a);
+    DemuxerContext demuxer = {};
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--no-probe-cache") {
+            demuxer.no_probe_cache = 1;
+        }
+    }
+    int32_t result = init_demuxer(&demuxer, input_file, output_v, output_a);
     if (result < 0) {
         return -1;
     }
-    result = demuxing(output_v, output_a);
+    result = demuxing(&demuxer, output_v, output_a);
 
-    destroy_demuxer();
+    destroy_demuxer(&demuxer);
     return 0;
 }
@@ -9,16 +9,9 @@ extern "C" {  // C 格式的头文件，用于告诉编译器这些头文件使
 
 #include <iostream>
 
+#include "av_pool.h"
 #include "io_data.h"
-
-static AVFormatContext *format_ctx = nullptr;
-static AVCodecContext *video_dec_ctx = nullptr, *audio_dec_ctx = nullptr;
-static int video_stream_index = -1, audio_stream_index = -1;
-static AVStream *video_stream = nullptr, *audio_stream = nullptr;
-static FILE *output_video_file = nullptr, *output_audio_file = nullptr;
-static AVFrame *frame = nullptr;
-static AVPacket *pkt = nullptr;
-//static AVPacket pkt;
+#include "probe_cache_core.h"
 
 /**
  * 获取输入文件里最佳的 type 流，序号是 stream_idx, 创建对应的 AVCodec 和 AVCodecContext 并打开编码器。
@@ -78,59 +71,55 @@ static int open_codec_context(int32_t *stream_idx, AVCodecContext **dec_ctx,
 /**
  * 初始化解封装器，打开输入文件，解析所有媒体流，选择最佳的一路
  */
-int32_t init_demuxer(char *input_name, char *video_output_name,
+int32_t init_demuxer(DemuxerContext *ctx, char *input_name, char *video_output_name,
                      char *audio_output_name) {
+    // 调用者把上下文初始化为 {}，流序号要先置成 -1，不然会和第 0 路流混淆
+    ctx->video_stream_index = -1;
+    ctx->audio_stream_index = -1;
     if (strlen(input_name) == 0) {
         std::cerr << "Error: empty input file name." << std::endl;
         exit(-1);
     }
 
-    // 打开输入流，填充 AVFormatContext信息
-    int32_t result =
-            avformat_open_input(&format_ctx, input_name, nullptr, nullptr);
-    if (result < 0) {
-        std::cerr << "Error: avformat_open_input failed." << std::endl;
-        exit(-1);
-    }
-
     /**
-     * 解析输入文件的音视频流信息
-     * 遍历输入文件的所有媒体流，针对每一路音频流、视频流、字幕流打开对应的解码器
+     * 打开输入流，填充 AVFormatContext信息，然后解析输入文件的音视频流信息
+     * avformat_find_stream_info 遍历输入文件的所有媒体流，针对每一路音频流、视频流、字幕流打开对应的解码器
      * 读取部分数据进行解码，同时将解码过程的多个参数保存到AVFormatContext的AVFormat成员中
+     * 同一个文件第二次打开时用缓存的探测结果，不再调用 avformat_find_stream_info
      */
-    result = avformat_find_stream_info(format_ctx, nullptr);
+    int32_t result = probe_cache_open_input(&ctx->format_ctx, input_name, nullptr, !ctx->no_probe_cache);
     if (result < 0) {
-        std::cerr << "Error: avformat_find_stream_info failed." << std::endl;
+        std::cerr << "Error: open input and find stream info failed." << std::endl;
         exit(-1);
     }
 
     // 选择最佳的一路视频流
-    result = open_codec_context(&video_stream_index, &video_dec_ctx, format_ctx,
+    result = open_codec_context(&ctx->video_stream_index, &ctx->video_dec_ctx, ctx->format_ctx,
                                 AVMEDIA_TYPE_VIDEO);
     if (result >= 0) {
-        video_stream = format_ctx->streams[video_stream_index];
-        output_video_file = fopen(video_output_name, "wb");
-        if (!output_video_file) {
+        ctx->video_stream = ctx->format_ctx->streams[ctx->video_stream_index];
+        ctx->video_io.output_file = fopen(video_output_name, "wb");
+        if (!ctx->video_io.output_file) {
             std::cerr << "Error: failed to open video output file." << std::endl;
             return -1;
         }
     }
     // 选择最佳的一路音频流
-    result = open_codec_context(&audio_stream_index, &audio_dec_ctx, format_ctx,
+    result = open_codec_context(&ctx->audio_stream_index, &ctx->audio_dec_ctx, ctx->format_ctx,
                                 AVMEDIA_TYPE_AUDIO);
     if (result >= 0) {
-        audio_stream = format_ctx->streams[audio_stream_index];
-        output_audio_file = fopen(audio_output_name, "wb");
-        if (!output_audio_file) {
+        ctx->audio_stream = ctx->format_ctx->streams[ctx->audio_stream_index];
+        ctx->audio_io.output_file = fopen(audio_output_name, "wb");
+        if (!ctx->audio_io.output_file) {
             std::cerr << "Error: failed to open audio output file." << std::endl;
             return -1;
         }
     }
 
     /* dump input information to stderr */
-    av_dump_format(format_ctx, 0, input_name, 0);
+    av_dump_format(ctx->format_ctx, 0, input_name, 0);
 
-    if (!audio_stream && !video_stream) {
+    if (!ctx->audio_stream && !ctx->video_stream) {
         std::cerr
                 << "Error: Could not find audio or video stream in the input, aborting "
                 << std::endl;
@@ -138,22 +127,28 @@ int32_t init_demuxer(char *input_name, char *video_output_name,
     }
 
     // 使用默认值初始化packet的可选字段
-    pkt = av_packet_alloc();
+    frame_pool_init(&ctx->frame_pool, 0, 0, AV_PIX_FMT_NONE);
+    packet_pool_init(&ctx->packet_pool);
+    ctx->pkt = packet_pool_get(&ctx->packet_pool);
+    if (!ctx->pkt) {
+        std::cerr << "Error: Failed to alloc packet." << std::endl;
+        return -1;
+    }
 //    av_init_packet(pkt);
 //    pkt->data = NULL;
 //    pkt->size = 0;
 
-    frame = av_frame_alloc();
-    if (!frame) {
+    ctx->frame = frame_pool_get(&ctx->frame_pool);
+    if (!ctx->frame) {
         std::cerr << "Error: Failed to alloc frame." << std::endl;
         return -1;
     }
 
-    if (video_stream) {
+    if (ctx->video_stream) {
         std::cout << "Demuxing video from file " << std::string(input_name)
                   << " into " << std::string(video_output_name) << std::endl;
     }
-    if (audio_stream) {
+    if (ctx->audio_stream) {
         std::cout << "Demuxing audio from file " << std::string(input_name)
                   << " into " << std::string(audio_output_name) << std::endl;
     }
@@ -161,46 +156,10 @@ int32_t init_demuxer(char *input_name, char *video_output_name,
     return 0;
 }
 
-/**
- * 将解码后的 frame 保存成yuv422格式
- */
-static int32_t write_frame_to_yuv1(AVFrame *frame) {
-    uint8_t **pBuf = frame->data;
-    int *pStride = frame->linesize;
-    for (size_t i = 0; i < 3; i++) {
-        int32_t width = (i == 0 ? frame->width : frame->width / 2);
-        int32_t height = (i == 0 ? frame->height : frame->height / 2);
-        for (size_t j = 0; j < height; j++) {
-            fwrite(pBuf[i], 1, width, output_video_file);
-            pBuf[i] += pStride[i];
-        }
-    }
-    return 0;
-}
-
-/**
- * 保存解码后的音频，每个声道交叉存储 packed 格式
- */
-static int32_t write_samples_to_pcm1(AVFrame *frame,
-                                     AVCodecContext *codec_ctx) {
-    int data_size = av_get_bytes_per_sample(codec_ctx->sample_fmt);
-    if (data_size < 0) {
-        /* This should not occur, checking just for paranoia */
-        std::cerr << "Failed to calculate data size" << std::endl;
-        exit(1);
-    }
-    for (int i = 0; i < frame->nb_samples; i++) {
-        for (int ch = 0; ch < codec_ctx->ch_layout.nb_channels; ch++) {
-            fwrite(frame->data[ch] + data_size * i, 1, data_size, output_audio_file);
-        }
-    }
-    return 0;
-}
-
 /**
  * 解码 packet，还是常规那一套，send_packet->receive_frame
  */
-static int32_t decode_packet(AVCodecContext *dec, const AVPacket *pkt) {
+static int32_t decode_packet(DemuxerContext *ctx, AVCodecContext *dec, const AVPacket *pkt) {
     int32_t result = 0;
     result = avcodec_send_packet(dec, pkt);
     if (result < 0) {
@@ -209,7 +168,7 @@ static int32_t decode_packet(AVCodecContext *dec, const AVPacket *pkt) {
     }
 
     while (result >= 0) {
-        result = avcodec_receive_frame(dec, frame);
+        result = avcodec_receive_frame(dec, ctx->frame);
         if (result < 0) {
             if (result == AVERROR_EOF || result == AVERROR(EAGAIN)) return 0;
 
@@ -218,14 +177,16 @@ static int32_t decode_packet(AVCodecContext *dec, const AVPacket *pkt) {
         }
 
         if (dec->codec->type == AVMEDIA_TYPE_VIDEO) {
-            write_frame_to_yuv1(frame);
+            // 按解码器输出的像素格式逐平面写入，不改动 frame->data
+            write_frame_to_yuv(&ctx->video_io, ctx->frame);
             std::cout << "Write frame to yuv file" << std::endl;
         } else {
-            write_samples_to_pcm1(frame, audio_dec_ctx);
+            // 每个声道交叉存储 packed 格式
+            write_samples_to_pcm(&ctx->audio_io, ctx->frame, ctx->audio_dec_ctx);
             std::cout << "Write sample to pcm file" << std::endl;
         }
 
-        av_frame_unref(frame);
+        av_frame_unref(ctx->frame);
     }
 
     return result;
@@ -265,21 +226,21 @@ static int get_format_from_sample_fmt(const char **fmt,
 /**
  * 解封装，
  */
-int32_t demuxing(char *video_output_name, char *audio_output_name) {
+int32_t demuxing(DemuxerContext *ctx, char *video_output_name, char *audio_output_name) {
     int32_t result = 0;
 
     // 读取文件中的下一个packet，保存到pkt中，pkt引用计数+1，需要av_packet_unref释放
     // 使用合适的编解码器解码packet为frame，保存到文件
-    while (av_read_frame(format_ctx, pkt) >= 0) {
-        std::cout << "Read packet, pts:" << pkt->pts
-                  << ", stream:" << pkt->stream_index << ", size:" << pkt->size
+    while (av_read_frame(ctx->format_ctx, ctx->pkt) >= 0) {
+        std::cout << "Read packet, pts:" << ctx->pkt->pts
+                  << ", stream:" << ctx->pkt->stream_index << ", size:" << ctx->pkt->size
                   << std::endl;
-        if (pkt->stream_index == audio_stream_index) {
-            result = decode_packet(audio_dec_ctx, pkt);
-        } else if (pkt->stream_index == video_stream_index) {
-            result = decode_packet(video_dec_ctx, pkt);
+        if (ctx->pkt->stream_index == ctx->audio_stream_index) {
+            result = decode_packet(ctx, ctx->audio_dec_ctx, ctx->pkt);
+        } else if (ctx->pkt->stream_index == ctx->video_stream_index) {
+            result = decode_packet(ctx, ctx->video_dec_ctx, ctx->pkt);
         }
-        av_packet_unref(pkt);
+        av_packet_unref(ctx->pkt);
         if (result < 0) {
             break;
         }
@@ -287,22 +248,22 @@ int32_t demuxing(char *video_output_name, char *audio_output_name) {
 
     /* flush the decoders */
     // 传入空指针packet，刷新解码器
-    if (video_dec_ctx) decode_packet(video_dec_ctx, nullptr);
-    if (audio_dec_ctx) decode_packet(audio_dec_ctx, nullptr);
+    if (ctx->video_dec_ctx) decode_packet(ctx, ctx->video_dec_ctx, nullptr);
+    if (ctx->audio_dec_ctx) decode_packet(ctx, ctx->audio_dec_ctx, nullptr);
 
     std::cout << "Demuxing succeeded." << std::endl;
-    if (video_dec_ctx) {
+    if (ctx->video_dec_ctx) {
         std::cout << "Play the output video file with the command:" << std::endl
                   << "   ffplay -f rawvideo -pixel_format "
-                  << std::string(av_get_pix_fmt_name(video_dec_ctx->pix_fmt))
-                  << " -video_size " << video_dec_ctx->width << "x"
-                  << video_dec_ctx->height << " " << std::string(video_output_name)
+                  << std::string(av_get_pix_fmt_name(ctx->video_dec_ctx->pix_fmt))
+                  << " -video_size " << ctx->video_dec_ctx->width << "x"
+                  << ctx->video_dec_ctx->height << " " << std::string(video_output_name)
                   << std::endl;
     }
-    if (audio_dec_ctx) {
+    if (ctx->audio_dec_ctx) {
         // 这里获取的是 AV_SAMPLE_FMT_FLTP 格式，表示 float planar
-        enum AVSampleFormat sfmt = audio_dec_ctx->sample_fmt;
-        int n_channels = audio_dec_ctx->ch_layout.nb_channels;
+        enum AVSampleFormat sfmt = ctx->audio_dec_ctx->sample_fmt;
+        int n_channels = ctx->audio_dec_ctx->ch_layout.nb_channels;
         const char *fmt;
 
         // 这个就有点扯了，虽然audio在封装后的数据中是sfmt(planar)格式
@@ -320,23 +281,22 @@ int32_t demuxing(char *video_output_name, char *audio_output_name) {
         }
         std::cout << "Play the output video file with the command:" << std::endl
                   << "    ffplay -f " << std::string(fmt) << " -ac " << n_channels
-                  << " -ar " << audio_dec_ctx->sample_rate << " "
+                  << " -ar " << ctx->audio_dec_ctx->sample_rate << " "
                   << std::string(audio_output_name) << std::endl;
     }
     return 0;
 }
 
-void destroy_demuxer() {
-    avcodec_free_context(&video_dec_ctx);
-    avcodec_free_context(&audio_dec_ctx);
-    avformat_close_input(&format_ctx);
-    av_packet_free(&pkt);
-    if (output_video_file != nullptr) {
-        fclose(output_video_file);
-        output_video_file = nullptr;
-    }
-    if (output_audio_file != nullptr) {
-        fclose(output_audio_file);
-        output_audio_file = nullptr;
-    }
+void destroy_demuxer(DemuxerContext *ctx) {
+    avcodec_free_context(&ctx->video_dec_ctx);
+    avcodec_free_context(&ctx->audio_dec_ctx);
+    avformat_close_input(&ctx->format_ctx);
+    frame_pool_put(&ctx->frame_pool, ctx->frame);
+    ctx->frame = nullptr;
+    packet_pool_put(&ctx->packet_pool, ctx->pkt);
+    ctx->pkt = nullptr;
+    frame_pool_uninit(&ctx->frame_pool);
+    packet_pool_uninit(&ctx->packet_pool);
+    close_input_output_files(&ctx->video_io);
+    close_input_output_files(&ctx->audio_io);
 }
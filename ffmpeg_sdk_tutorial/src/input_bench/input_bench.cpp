@@ -0,0 +1,151 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include "io_data.h"
+
+// 两种方式每次都交给解析器同样大小的一块数据，只比较读取方式本身
+#define BENCH_CHUNK_SIZE MAP_CHUNK_SIZE
+#define BENCH_ROUNDS 5
+
+/**
+ * 比较 fread 和 mmap 两种读取方式下 av_parser_parse2 切分整个文件的耗时，
+ * 只解析不解码，这样测出来的就是输入路径本身的开销
+ *  input_bench 2_football.h264 h264
+ *  input_bench a.mp3 mp3
+ */
+static int32_t parse_file(const char *input_name, enum AVCodecID codec_id,
+                          bool use_mmap, int64_t &pkt_cnt, int64_t &bytes) {
+    IoContext io = {};
+    int32_t result = open_input_output_files(&io, input_name, "/dev/null");
+    if (result < 0) {
+        return result;
+    }
+    if (use_mmap) {
+        result = map_input_file(&io);
+        if (result < 0) {
+            close_input_output_files(&io);
+            return result;
+        }
+    }
+
+    const AVCodec *codec = avcodec_find_decoder(codec_id);
+    AVCodecParserContext *parser = av_parser_init(codec_id);
+    AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
+    if (!codec || !parser || !codec_ctx) {
+        std::cerr << "Error: could not init parser." << std::endl;
+        av_parser_close(parser);
+        avcodec_free_context(&codec_ctx);
+        close_input_output_files(&io);
+        return -1;
+    }
+
+    std::vector<uint8_t> inbuf(use_mmap ? 0 : BENCH_CHUNK_SIZE + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+    const uint8_t *data = nullptr;
+    int32_t data_size = 0;
+    uint8_t *pkt_data = nullptr;
+    int pkt_size = 0;
+    pkt_cnt = 0;
+    bytes = 0;
+    while (!end_of_input_file(&io)) {
+        if (use_mmap) {
+            result = map_data_to_buf(&io, &data, BENCH_CHUNK_SIZE, data_size);
+        } else {
+            result = read_data_to_buf(&io, inbuf.data(), BENCH_CHUNK_SIZE, data_size);
+            data = inbuf.data();
+        }
+        if (result < 0) {
+            // 文件长度正好是 BENCH_CHUNK_SIZE 整数倍时，最后一次 fread 读不到数据
+            result = 0;
+            break;
+        }
+        bytes += data_size;
+        while (data_size > 0) {
+            result = av_parser_parse2(parser, codec_ctx, &pkt_data, &pkt_size, data,
+                                      data_size, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+            if (result < 0) {
+                break;
+            }
+            data += result;
+            data_size -= result;
+            if (pkt_size) {
+                pkt_cnt++;
+            }
+        }
+    }
+    // 送入空数据取出解析器里缓存的最后一个 packet，两种方式数出来的 packet 数才一样
+    if (result >= 0) {
+        av_parser_parse2(parser, codec_ctx, &pkt_data, &pkt_size, nullptr, 0,
+                         AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+        if (pkt_size) {
+            pkt_cnt++;
+        }
+    }
+
+    av_parser_close(parser);
+    avcodec_free_context(&codec_ctx);
+    close_input_output_files(&io);
+    return result < 0 ? result : 0;
+}
+
+/**
+ * 每种方式跑 BENCH_ROUNDS 次取最快的一次，第一次运行之后文件已经在 page cache 里
+ */
+static int32_t bench(const char *input_name, enum AVCodecID codec_id,
+                     bool use_mmap) {
+    double best_ms = -1;
+    int64_t pkt_cnt = 0, bytes = 0;
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        auto start = std::chrono::steady_clock::now();
+        int32_t result = parse_file(input_name, codec_id, use_mmap, pkt_cnt, bytes);
+        auto end = std::chrono::steady_clock::now();
+        if (result < 0) {
+            return result;
+        }
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        if (best_ms < 0 || ms < best_ms) {
+            best_ms = ms;
+        }
+    }
+    std::cout << (use_mmap ? "mmap " : "fread") << ": chunk:" << BENCH_CHUNK_SIZE
+              << ", packets:" << pkt_cnt << ", bytes:" << bytes << ", best:" << best_ms << " ms, "
+              << bytes / 1024.0 / 1024.0 / (best_ms / 1000.0) << " MB/s"
+              << std::endl;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *input_file_name = argc > 1 ? argv[1] : "2_football.h264";
+    const char *codec_name = argc > 2 ? argv[2] : "h264";
+
+    enum AVCodecID codec_id = AV_CODEC_ID_NONE;
+    if (strcasecmp(codec_name, "h264") == 0) {
+        codec_id = AV_CODEC_ID_H264;
+    } else if (strcasecmp(codec_name, "mp3") == 0) {
+        codec_id = AV_CODEC_ID_MP3;
+    } else if (strcasecmp(codec_name, "aac") == 0) {
+        codec_id = AV_CODEC_ID_AAC;
+    } else {
+        std::cerr << "Error: unsupported codec:" << std::string(codec_name)
+                  << std::endl;
+        return -1;
+    }
+
+    std::cout << "Input file:" << std::string(input_file_name) << std::endl;
+    int32_t result = bench(input_file_name, codec_id, false);
+    if (result < 0) {
+        return result;
+    }
+    result = bench(input_file_name, codec_id, true);
+    if (result < 0) {
+        return result;
+    }
+    return 0;
+}
@@ -3,33 +3,47 @@
 //
 // io_data.cpp
 #include "io_data.h"
+#include "pcm_interleave.h"
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <climits>
 #include <cstdlib>
 #include <cstring>
 
 #include <iostream>
 
-static FILE *input_file = nullptr;
-static FILE *output_file = nullptr;
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
 
 /**
- * 打开输入输出文件，保存文件指针，后面读输入文件和写输出文件会用到
+ * 打开输入输出文件，文件指针保存在 io 里，后面读输入文件和写输出文件会用到
  * 按照二进制读写数据
  */
-int32_t open_input_output_files(const char *input_name,
+int32_t open_input_output_files(IoContext *io, const char *input_name,
                                 const char *output_name) {
     if (strlen(input_name) == 0 || strlen(output_name) == 0) {
         std::cerr << "Error: empty input or output file name." << std::endl;
         return -1;
     }
-    close_input_output_files();
-    input_file = fopen(input_name, "rb");
-    if (input_file == nullptr) {
+    close_input_output_files(io);
+    io->input_file = fopen(input_name, "rb");
+    if (io->input_file == nullptr) {
         std::cerr << "Error: failed to open input file." << std::endl;
         return -1;
     }
-    output_file = fopen(output_name, "wb");
-    if (output_file == nullptr) {
+    io->output_file = fopen(output_name, "wb");
+    if (io->output_file == nullptr) {
         std::cerr << "Error: failed to open output file." << std::endl;
         return -1;
     }
@@ -39,24 +53,41 @@ int32_t open_input_output_files(const char *input_name,
 /**
  * 关闭输入输出文件
  */
-void close_input_output_files() {
-    if (input_file != nullptr) {
-        fclose(input_file);
-        input_file = nullptr;
+void close_input_output_files(IoContext *io) {
+    if (io->map_data != nullptr) {
+        munmap(io->map_data, io->map_size);
+        io->map_data = nullptr;
+        io->map_size = 0;
+        io->map_pos = 0;
     }
-    if (output_file != nullptr) {
-        fclose(output_file);
-        output_file = nullptr;
+    av_freep(&io->map_tail);
+    av_freep(&io->iov);
+    io->iov_size = 0;
+    av_freep(&io->pcm_buf);
+    io->pcm_buf_size = 0;
+    if (io->input_file != nullptr) {
+        fclose(io->input_file);
+        io->input_file = nullptr;
+    }
+    if (io->output_file != nullptr) {
+        fclose(io->output_file);
+        io->output_file = nullptr;
     }
 }
 
-int32_t end_of_input_file() { return feof(input_file); }
+int32_t end_of_input_file(IoContext *io) {
+    if (io->map_data != nullptr) {
+        return io->map_pos >= io->map_size;
+    }
+    return feof(io->input_file);
+}
 
 /**
- * 从 input_file 读取 size 个字节到缓存区 buf
+ * 从 io->input_file 读取 size 个字节到缓存区 buf
  */
-int32_t read_data_to_buf(uint8_t *buf, int32_t size, int32_t &out_size) {
-    int32_t read_size = fread(buf, 1, size, input_file);
+int32_t read_data_to_buf(IoContext *io, uint8_t *buf, int32_t size,
+                         int32_t &out_size) {
+    int32_t read_size = fread(buf, 1, size, io->input_file);
     if (read_size == 0) {
         std::cerr << "Error: read_data_to_buf failed." << std::endl;
         return -1;
@@ -66,56 +97,199 @@ int32_t read_data_to_buf(uint8_t *buf, int32_t size, int32_t &out_size) {
 }
 
 /**
- * 将 frame 中的 data 写入文件，按照 422 格式写入
- * linesize 是 data 数据区的宽度，可能会大于 frame->width。
+ * 把已经打开的输入文件整体映射到内存，之后用 map_data_to_buf 读取，
+ * 数据直接交给 parser，省掉 fread 的拷贝和大部分系统调用
+ */
+int32_t map_input_file(IoContext *io) {
+    struct stat st;
+    if (io->input_file == nullptr || fstat(fileno(io->input_file), &st) < 0) {
+        std::cerr << "Error: failed to stat input file." << std::endl;
+        return -1;
+    }
+    if (st.st_size == 0) {
+        // 空文件不能 mmap，继续走 fread
+        return 0;
+    }
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE,
+                      fileno(io->input_file), 0);
+    if (addr == MAP_FAILED) {
+        std::cerr << "Error: failed to mmap input file." << std::endl;
+        return -1;
+    }
+    // 顺序读取，让内核加大预读并及时回收读过的页
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    io->map_data = static_cast<uint8_t *>(addr);
+    io->map_size = st.st_size;
+    io->map_pos = 0;
+    return 0;
+}
+
+/**
+ * mmap 模式下取出下一段最多 size 字节的数据，data 指向映射区域，不拷贝。
+ * parser 可能会读到数据末尾之后 AV_INPUT_BUFFER_PADDING_SIZE 字节，文件中间
+ * 这部分就是后面的数据，文件末尾不够的部分拷贝到 map_tail 里补零。
+ */
+int32_t map_data_to_buf(IoContext *io, const uint8_t **data, int32_t size,
+                        int32_t &out_size) {
+    size_t remain = io->map_size - io->map_pos;
+    if (remain == 0) {
+        std::cerr << "Error: map_data_to_buf failed." << std::endl;
+        return -1;
+    }
+    if (remain >= (size_t) size + AV_INPUT_BUFFER_PADDING_SIZE) {
+        *data = io->map_data + io->map_pos;
+        out_size = size;
+        io->map_pos += size;
+        return 0;
+    }
+
+    av_freep(&io->map_tail);
+    io->map_tail = static_cast<uint8_t *>(
+            av_mallocz(remain + AV_INPUT_BUFFER_PADDING_SIZE));
+    if (io->map_tail == nullptr) {
+        std::cerr << "Error: failed to alloc tail buffer." << std::endl;
+        return -1;
+    }
+    memcpy(io->map_tail, io->map_data + io->map_pos, remain);
+    *data = io->map_tail;
+    out_size = (int32_t) remain;
+    io->map_pos = io->map_size;
+    return 0;
+}
+
+/**
+ * writev 一次最多写 IOV_MAX 段，可能只写了一部分，没写完的继续写
+ */
+static int32_t writev_all(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        int cnt = iovcnt < IOV_MAX ? iovcnt : IOV_MAX;
+        ssize_t written = writev(fd, iov, cnt);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        // 跳过已经写完的段，最后一段可能只写了一半
+        while (cnt > 0 && written >= (ssize_t) iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+            cnt--;
+        }
+        if (written > 0) {
+            iov->iov_base = (uint8_t *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 将 frame 中的 data 按平面依次写入文件，不修改 frame->data。
+ * linesize 是 data 数据区的宽度，可能会大于一行的实际字节数。
+ * 色度平面的宽高按照 av_pix_fmt_desc_get 给出的采样比例计算，
+ * 420 宽高各一半，422 只有宽度一半，444 和 Y 一样大。
+ * 没有 padding 的平面整块写入，有 padding 时把所有行收集到 iovec 里一次 writev。
  */
-int32_t write_frame_to_yuv(AVFrame *frame) {
-    uint8_t **pBuf = frame->data;
-    int *pStride = frame->linesize;
-    // 422模式存储YUV，Y是全尺寸，UV是半尺寸
-    for (size_t i = 0; i < 3; i++) {
-        int32_t width = (i == 0 ? frame->width : frame->width / 2);
-        int32_t height = (i == 0 ? frame->height : frame->height / 2);
-        for (size_t j = 0; j < height; j++) {
-            // ptr是要写入的数据的指针，后面数据指针会后移；size是每个数据项的大小，nitems是数据项的数量，output_file是要写入的文件
-            fwrite(pBuf[i], 1, width, output_file);
-            pBuf[i] += pStride[i];
+int32_t write_frame_to_yuv(IoContext *io, AVFrame *frame) {
+    auto pix_fmt = (enum AVPixelFormat) frame->format;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+        std::cerr << "Error: unsupported pixel format:" << frame->format
+                  << std::endl;
+        return -1;
+    }
+
+    int32_t nb_planes = av_pix_fmt_count_planes(pix_fmt);
+    int32_t row_bytes[4] = {0}, rows[4] = {0};
+    int32_t total_rows = 0;
+    bool padded = false;
+    for (int32_t i = 0; i < nb_planes; i++) {
+        // 每行实际的字节数，已经考虑了色度宽度的缩小和每个像素的字节数
+        row_bytes[i] = av_image_get_linesize(pix_fmt, frame->width, i);
+        rows[i] = (i == 1 || i == 2)
+                  ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h)
+                  : frame->height;
+        if (row_bytes[i] < 0) {
+            std::cerr << "Error: failed to get plane linesize." << std::endl;
+            return -1;
+        }
+        if (frame->linesize[i] != row_bytes[i]) {
+            padded = true;
+        }
+        total_rows += rows[i];
+    }
+
+    if (!padded) {
+        // 没有 padding，每个平面在内存里是连续的，一次写入
+        for (int32_t i = 0; i < nb_planes; i++) {
+            size_t plane_size = (size_t) row_bytes[i] * rows[i];
+            if (fwrite(frame->data[i], 1, plane_size, io->output_file) !=
+                plane_size) {
+                std::cerr << "Error: write plane failed." << std::endl;
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    av_fast_malloc(&io->iov, &io->iov_size, total_rows * sizeof(struct iovec));
+    if (io->iov == nullptr) {
+        std::cerr << "Error: failed to alloc iovec." << std::endl;
+        return -1;
+    }
+    auto *iov = static_cast<struct iovec *>(io->iov);
+    int32_t iovcnt = 0;
+    for (int32_t i = 0; i < nb_planes; i++) {
+        for (int32_t j = 0; j < rows[i]; j++) {
+            iov[iovcnt].iov_base = frame->data[i] + (ptrdiff_t) j * frame->linesize[i];
+            iov[iovcnt].iov_len = row_bytes[i];
+            iovcnt++;
         }
     }
+    // 绕过 stdio 直接写 fd，先把 FILE 缓冲区里的数据刷出去保证顺序
+    fflush(io->output_file);
+    if (writev_all(fileno(io->output_file), iov, iovcnt) < 0) {
+        std::cerr << "Error: writev failed." << std::endl;
+        return -1;
+    }
     return 0;
 }
 
 /**
- * 读取yuv数据到frame，很奇怪，这里的yuv是420格式，上面是422格式
+ * 按 frame->format 逐个平面读取 yuv 数据到 frame，平面大小的计算和
+ * write_frame_to_yuv 相同，支持 420/422/444 等平面格式
+ * 没有 padding 的平面整块读取，否则逐行读取
  */
-int32_t read_yuv_to_frame(AVFrame *frame) {
-    int32_t frame_width = frame->width;
-    int32_t frame_height = frame->height;
-    int32_t luma_stride = frame->linesize[0];
-    int32_t chroma_stride = frame->linesize[1];
-    int32_t frame_size = frame_width * frame_height * 3 / 2;
-    int32_t read_size = 0;
-
-    if (frame_width == luma_stride) {
-        // 如果 width 等于 stride，说明 frame 中不存在 padding
-        // 字节，可向其中整体读取
-        read_size +=
-                fread(frame->data[0], 1, frame_width * frame_height, input_file);
-        read_size +=
-                fread(frame->data[1], 1, frame_width * frame_height / 4, input_file);
-        read_size +=
-                fread(frame->data[2], 1, frame_width * frame_height / 4, input_file);
-    } else {
-        //  如果 width 不等于 stride，说明 frame 一行的末尾存在 padding
-        //  字节，三个分量都应当逐行读取
-        for (size_t i = 0; i < frame_height; i++) {
-            read_size +=
-                    fread(frame->data[0] + i * luma_stride, 1, frame_width, input_file);
+int32_t read_yuv_to_frame(IoContext *io, AVFrame *frame) {
+    auto pix_fmt = (enum AVPixelFormat) frame->format;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+    if (desc == nullptr || (desc->flags & AV_PIX_FMT_FLAG_HWACCEL)) {
+        std::cerr << "Error: unsupported pixel format:" << frame->format
+                  << std::endl;
+        return -1;
+    }
+
+    int32_t nb_planes = av_pix_fmt_count_planes(pix_fmt);
+    size_t frame_size = 0, read_size = 0;
+    for (int32_t i = 0; i < nb_planes; i++) {
+        int32_t row_bytes = av_image_get_linesize(pix_fmt, frame->width, i);
+        int32_t rows = (i == 1 || i == 2)
+                       ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h)
+                       : frame->height;
+        if (row_bytes < 0) {
+            std::cerr << "Error: failed to get plane linesize." << std::endl;
+            return -1;
         }
-        for (size_t uv = 1; uv <= 2; uv++) {
-            for (size_t i = 0; i < frame_height / 2; i++) {
-                read_size += fread(frame->data[uv] + i * chroma_stride, 1,
-                                   frame_width / 2, input_file);
+        frame_size += (size_t) row_bytes * rows;
+        if (frame->linesize[i] == row_bytes) {
+            read_size += fread(frame->data[i], 1, (size_t) row_bytes * rows,
+                               io->input_file);
+        } else {
+            for (int32_t j = 0; j < rows; j++) {
+                read_size += fread(frame->data[i] + (ptrdiff_t) j * frame->linesize[i],
+                                   1, row_bytes, io->input_file);
             }
         }
     }
@@ -130,15 +304,71 @@ int32_t read_yuv_to_frame(AVFrame *frame) {
 }
 
 
-void write_pkt_to_file(AVPacket *pkt) {
-    fwrite(pkt->data, 1, pkt->size, output_file);
+void write_pkt_to_file(IoContext *io, AVPacket *pkt) {
+    fwrite(pkt->data, 1, pkt->size, io->output_file);
+}
+
+/**
+ * 把 planar 的 frame 在内存里交错成 packed 格式，再一次性写入文件
+ */
+static int32_t write_planar_samples(IoContext *io, AVFrame *frame,
+                                    int data_size, int channels) {
+    size_t size = (size_t) data_size * channels * frame->nb_samples;
+    if (size == 0) {
+        return 0;
+    }
+    av_fast_malloc(&io->pcm_buf, &io->pcm_buf_size, size);
+    if (io->pcm_buf == nullptr) {
+        std::cerr << "Error: failed to alloc pcm buffer." << std::endl;
+        return -1;
+    }
+    interleave_samples(io->pcm_buf, frame->extended_data, data_size, channels,
+                       frame->nb_samples);
+    if (fwrite(io->pcm_buf, 1, size, io->output_file) != size) {
+        std::cerr << "Error: write pcm data failed." << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * 一次读出整帧 packed 数据，再拆分到 frame 的各个声道。
+ * 文件末尾不够一帧时，和逐个采样 fread 的结果一样：完整的采样正常拆分，
+ * 最后不完整采样的字节依次放进对应声道，frame 里其余数据保持不变
+ */
+static int32_t read_planar_samples(IoContext *io, AVFrame *frame,
+                                   int data_size, int channels) {
+    size_t sample_size = (size_t) data_size * channels;
+    size_t size = sample_size * frame->nb_samples;
+    if (size == 0) {
+        return 0;
+    }
+    av_fast_malloc(&io->pcm_buf, &io->pcm_buf_size, size);
+    if (io->pcm_buf == nullptr) {
+        std::cerr << "Error: failed to alloc pcm buffer." << std::endl;
+        return -1;
+    }
+    size_t read_size = fread(io->pcm_buf, 1, size, io->input_file);
+    auto full_samples = (int32_t) (read_size / sample_size);
+    deinterleave_samples(frame->extended_data, io->pcm_buf, data_size, channels,
+                         full_samples);
+
+    size_t offset = full_samples * sample_size;
+    for (int ch = 0; offset < read_size; ch++) {
+        size_t n = FFMIN((size_t) data_size, read_size - offset);
+        memcpy(frame->extended_data[ch] + (size_t) data_size * full_samples,
+               io->pcm_buf + offset, n);
+        offset += n;
+    }
+    return 0;
 }
 
 /**
  * 将音频 frame->data 写入pcm文件
  * 每个 frame 中会包含一段音频，这一段音频可能有1152个采样，每个采样又由多位二进制表示
  */
-int32_t write_samples_to_pcm(AVFrame *frame, AVCodecContext *codec_ctx) {
+int32_t write_samples_to_pcm(IoContext *io, AVFrame *frame,
+                             AVCodecContext *codec_ctx) {
     // data_size = 4, 每个采样4字节，也就是说每个采样点的值是使用32位保存的
     int data_size = av_get_bytes_per_sample(codec_ctx->sample_fmt);
     if (data_size < 0) {
@@ -148,12 +378,8 @@ int32_t write_samples_to_pcm(AVFrame *frame, AVCodecContext *codec_ctx) {
     }
     // mp3格式每一帧保存1152个采样值
     // 对于每一个采样值，按照packet格式同时写入左右声道，
-    for (int i = 0; i < frame->nb_samples; i++) {
-        for (int ch = 0; ch < codec_ctx->ch_layout.nb_channels; ch++) {
-            fwrite(frame->data[ch] + data_size * i, 1, data_size, output_file);
-        }
-    }
-    return 0;
+    return write_planar_samples(io, frame, data_size,
+                                codec_ctx->ch_layout.nb_channels);
 }
 
 /**
@@ -163,7 +389,8 @@ int32_t write_samples_to_pcm(AVFrame *frame, AVCodecContext *codec_ctx) {
  * 按照下面的循环方式，pcm文件的格式是packet格式，读取到frame->data数据，
  * 数组中使用planar格式保存
  */
-int32_t read_pcm_to_frame(AVFrame *frame, AVCodecContext *codec_ctx) {
+int32_t read_pcm_to_frame(IoContext *io, AVFrame *frame,
+                          AVCodecContext *codec_ctx) {
     int data_size = av_get_bytes_per_sample(codec_ctx->sample_fmt);
     if (data_size < 0) {
         /* This should not occur, checking just for paranoia */
@@ -171,39 +398,30 @@ int32_t read_pcm_to_frame(AVFrame *frame, AVCodecContext *codec_ctx) {
         return -1;
     }
 
-    // 从输入文件中交替读取一个采样值的各个声道的数据，
+    // 从输入文件中读取交替存放的各个声道的数据，
     // 保存到AVFrame结构的存储分量中
     // nc_samples：每个声道的采样数量
     // nb_channels: 声道的数量
-    for (int i = 0; i < frame->nb_samples; i++) {
-        for (int ch = 0; ch < codec_ctx->ch_layout.nb_channels; ch++) {
-            fread(frame->data[ch] + data_size * i, 1, data_size, input_file);
-        }
-    }
-    return 0;
+    return read_planar_samples(io, frame, data_size,
+                               codec_ctx->ch_layout.nb_channels);
 }
 
-int32_t write_samples_to_pcm2(AVFrame *frame, enum AVSampleFormat format,
-                              int channels) {
+int32_t write_samples_to_pcm2(IoContext *io, AVFrame *frame,
+                              enum AVSampleFormat format, int channels) {
     int data_size = av_get_bytes_per_sample(format);
     if (data_size < 0) {
         /* This should not occur, checking just for paranoia */
         std::cerr << "Failed to calculate data size" << std::endl;
         exit(1);
     }
-    for (int i = 0; i < frame->nb_samples; i++) {
-        for (int ch = 0; ch < channels; ch++) {
-            fwrite(frame->data[ch] + data_size * i, 1, data_size, output_file);
-        }
-    }
-    return 0;
+    return write_planar_samples(io, frame, data_size, channels);
 }
 
 /**
  * 从packed文件里读取一个frame，保存到data[ch]对应声道里 planar
  */
-int32_t read_pcm_to_frame2(AVFrame *frame, enum AVSampleFormat format,
-                           int channels) {
+int32_t read_pcm_to_frame2(IoContext *io, AVFrame *frame,
+                           enum AVSampleFormat format, int channels) {
     // 一个frame包含很多个sample，每个sample用data_size个字节表示
     int data_size = av_get_bytes_per_sample(format);
     if (data_size < 0) {
@@ -212,18 +430,11 @@ int32_t read_pcm_to_frame2(AVFrame *frame, enum AVSampleFormat format,
         return -1;
     }
 
-    // 从输入文件中交替读取一个采样值的各个声道的数据，
-    // 保存到AVFrame结构的存储分量中
-    for (int i = 0; i < frame->nb_samples; i++) {
-        for (int ch = 0; ch < channels; ch++) {
-            // 交替读取声道信息，所以文件是packed格式保存的
-            // 不同的生成存储在data数组里对应的项，所以是planar保存
-            fread(frame->data[ch] + data_size * i, 1, data_size, input_file);
-        }
-    }
-    return 0;
+    // 文件是packed格式保存的，交替存放各个声道的采样
+    // 不同的声道存储在data数组里对应的项，所以是planar保存
+    return read_planar_samples(io, frame, data_size, channels);
 }
 
-void write_packed_data_to_file(const uint8_t *buf, int32_t size) {
-    fwrite(buf, 1, size, output_file);
+void write_packed_data_to_file(IoContext *io, const uint8_t *buf, int32_t size) {
+    fwrite(buf, 1, size, io->output_file);
 }
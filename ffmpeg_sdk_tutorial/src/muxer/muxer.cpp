@@ -6,24 +6,31 @@
 
 /**
  * 将音频流和视频流封装成mp4格式
+ * 用法：muxer [--no-probe-cache]，--no-probe-cache 不用探测缓存，打印完整探测时打开文件的时间
  */
 int main(int argc, char **argv) {
     char input_v[] = "muxer.h264";
     char input_a[] = "muxer.mp3";
     char output_file[] = "muxer.mp4";
     int32_t result = 0;
+    MuxerContext muxer = {};
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--no-probe-cache") {
+            muxer.no_probe_cache = 1;
+        }
+    }
     do {
-        result = init_muxer(input_v, input_a, output_file);
+        result = init_muxer(&muxer, input_v, input_a, output_file);
         if (result < 0) {
             break;
         }
-        result = muxing();
+        result = muxing(&muxer);
         if (result < 0) {
             break;
         }
 
     } while (0);
-    destroy_muxer();
+    destroy_muxer(&muxer);
 
     return result;
 }
@@ -0,0 +1,434 @@
+// pcm_interleave.cpp
+// planar/packed 音频采样之间的转换，立体声走 SIMD，单声道 memcpy，u8 和多声道走标量循环
+// 立体声默认按 CPU 选择实现，也可以用 *_kernel 强制某一种，测试用它逐个检查
+#include "pcm_interleave.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PCM_HAVE_SSE2 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define PCM_HAVE_NEON 1
+#endif
+
+template<typename T>
+static void interleave_scalar(uint8_t *dst, const uint8_t *const *src,
+                              int32_t channels, int32_t offset,
+                              int32_t nb_samples) {
+    T *out = reinterpret_cast<T *>(dst) + (size_t) offset * channels;
+    for (int32_t i = offset; i < nb_samples; i++) {
+        for (int32_t ch = 0; ch < channels; ch++) {
+            *out++ = reinterpret_cast<const T *>(src[ch])[i];
+        }
+    }
+}
+
+template<typename T>
+static void deinterleave_scalar(uint8_t *const *dst, const uint8_t *src,
+                                int32_t channels, int32_t offset,
+                                int32_t nb_samples) {
+    const T *in = reinterpret_cast<const T *>(src) + (size_t) offset * channels;
+    for (int32_t i = offset; i < nb_samples; i++) {
+        for (int32_t ch = 0; ch < channels; ch++) {
+            reinterpret_cast<T *>(dst[ch])[i] = *in++;
+        }
+    }
+}
+
+static void interleave_tail(uint8_t *dst, const uint8_t *const *src,
+                            int32_t bytes_per_sample, int32_t channels,
+                            int32_t offset, int32_t nb_samples) {
+    switch (bytes_per_sample) {
+        case 1:
+            interleave_scalar<uint8_t>(dst, src, channels, offset, nb_samples);
+            break;
+        case 2:
+            interleave_scalar<uint16_t>(dst, src, channels, offset, nb_samples);
+            break;
+        case 4:
+            interleave_scalar<uint32_t>(dst, src, channels, offset, nb_samples);
+            break;
+        case 8:
+            interleave_scalar<uint64_t>(dst, src, channels, offset, nb_samples);
+            break;
+        default:
+            break;
+    }
+}
+
+static void deinterleave_tail(uint8_t *const *dst, const uint8_t *src,
+                              int32_t bytes_per_sample, int32_t channels,
+                              int32_t offset, int32_t nb_samples) {
+    switch (bytes_per_sample) {
+        case 1:
+            deinterleave_scalar<uint8_t>(dst, src, channels, offset, nb_samples);
+            break;
+        case 2:
+            deinterleave_scalar<uint16_t>(dst, src, channels, offset, nb_samples);
+            break;
+        case 4:
+            deinterleave_scalar<uint32_t>(dst, src, channels, offset, nb_samples);
+            break;
+        case 8:
+            deinterleave_scalar<uint64_t>(dst, src, channels, offset, nb_samples);
+            break;
+        default:
+            break;
+    }
+}
+
+#if PCM_HAVE_SSE2
+/**
+ * 立体声交错就是把 L、R 两个向量按元素宽度 unpack，
+ * 拆分时先在每 128 位内部把 L、R 各自排到一起，再按 64 位拼接。
+ * 这些都是整数搬移指令，float/double 的每一位都原样保留。
+ */
+template<int Bytes>
+static inline __m128i unpack_lo_128(__m128i a, __m128i b) {
+    if (Bytes == 2) return _mm_unpacklo_epi16(a, b);
+    if (Bytes == 4) return _mm_unpacklo_epi32(a, b);
+    return _mm_unpacklo_epi64(a, b);
+}
+
+template<int Bytes>
+static inline __m128i unpack_hi_128(__m128i a, __m128i b) {
+    if (Bytes == 2) return _mm_unpackhi_epi16(a, b);
+    if (Bytes == 4) return _mm_unpackhi_epi32(a, b);
+    return _mm_unpackhi_epi64(a, b);
+}
+
+template<int Bytes>
+static int32_t interleave_stereo_sse2(uint8_t *dst, const uint8_t *left,
+                                      const uint8_t *right, int32_t nb_samples) {
+    const int32_t step = 16 / Bytes;
+    int32_t i = 0;
+    for (; i + step <= nb_samples; i += step) {
+        __m128i l = _mm_loadu_si128((const __m128i *) (left + i * Bytes));
+        __m128i r = _mm_loadu_si128((const __m128i *) (right + i * Bytes));
+        _mm_storeu_si128((__m128i *) (dst + 2 * i * Bytes), unpack_lo_128<Bytes>(l, r));
+        _mm_storeu_si128((__m128i *) (dst + 2 * i * Bytes + 16), unpack_hi_128<Bytes>(l, r));
+    }
+    return i;
+}
+
+template<int Bytes>
+static int32_t deinterleave_stereo_sse2(uint8_t *left, uint8_t *right,
+                                        const uint8_t *src, int32_t nb_samples) {
+    const int32_t step = 16 / Bytes;
+    int32_t i = 0;
+    for (; i + step <= nb_samples; i += step) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (src + 2 * i * Bytes));
+        __m128i y = _mm_loadu_si128((const __m128i *) (src + 2 * i * Bytes + 16));
+        __m128i l, r;
+        if (Bytes == 2) {
+            // 每 32 位里低 16 位是 L，高 16 位是 R，符号扩展后 packs 不会饱和
+            l = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(x, 16), 16),
+                                _mm_srai_epi32(_mm_slli_epi32(y, 16), 16));
+            r = _mm_packs_epi32(_mm_srai_epi32(x, 16), _mm_srai_epi32(y, 16));
+        } else if (Bytes == 4) {
+            // L0 R0 L1 R1 -> L0 L1 R0 R1
+            x = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 1, 2, 0));
+            y = _mm_shuffle_epi32(y, _MM_SHUFFLE(3, 1, 2, 0));
+            l = _mm_unpacklo_epi64(x, y);
+            r = _mm_unpackhi_epi64(x, y);
+        } else {
+            l = _mm_unpacklo_epi64(x, y);
+            r = _mm_unpackhi_epi64(x, y);
+        }
+        _mm_storeu_si128((__m128i *) (left + i * Bytes), l);
+        _mm_storeu_si128((__m128i *) (right + i * Bytes), r);
+    }
+    return i;
+}
+
+template<int Bytes>
+__attribute__((target("avx2")))
+static inline __m256i unpack_lo_256(__m256i a, __m256i b) {
+    if (Bytes == 2) return _mm256_unpacklo_epi16(a, b);
+    if (Bytes == 4) return _mm256_unpacklo_epi32(a, b);
+    return _mm256_unpacklo_epi64(a, b);
+}
+
+template<int Bytes>
+__attribute__((target("avx2")))
+static inline __m256i unpack_hi_256(__m256i a, __m256i b) {
+    if (Bytes == 2) return _mm256_unpackhi_epi16(a, b);
+    if (Bytes == 4) return _mm256_unpackhi_epi32(a, b);
+    return _mm256_unpackhi_epi64(a, b);
+}
+
+/**
+ * AVX2 的 unpack 只在 128 位内部进行，结果的两半需要用 permute2x128 重新拼接
+ */
+template<int Bytes>
+__attribute__((target("avx2")))
+static int32_t interleave_stereo_avx2(uint8_t *dst, const uint8_t *left,
+                                      const uint8_t *right, int32_t nb_samples) {
+    const int32_t step = 32 / Bytes;
+    int32_t i = 0;
+    for (; i + step <= nb_samples; i += step) {
+        __m256i l = _mm256_loadu_si256((const __m256i *) (left + i * Bytes));
+        __m256i r = _mm256_loadu_si256((const __m256i *) (right + i * Bytes));
+        __m256i lo = unpack_lo_256<Bytes>(l, r);
+        __m256i hi = unpack_hi_256<Bytes>(l, r);
+        _mm256_storeu_si256((__m256i *) (dst + 2 * i * Bytes),
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *) (dst + 2 * i * Bytes + 32),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    return i;
+}
+
+/**
+ * 和 SSE2 一样先在 128 位内部分开 L、R，得到的 64 位块顺序是 0 2 1 3，
+ * 再用 permute4x64 调整回来
+ */
+template<int Bytes>
+__attribute__((target("avx2")))
+static int32_t deinterleave_stereo_avx2(uint8_t *left, uint8_t *right,
+                                        const uint8_t *src, int32_t nb_samples) {
+    const int32_t step = 32 / Bytes;
+    int32_t i = 0;
+    for (; i + step <= nb_samples; i += step) {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (src + 2 * i * Bytes));
+        __m256i y = _mm256_loadu_si256((const __m256i *) (src + 2 * i * Bytes + 32));
+        __m256i l, r;
+        if (Bytes == 2) {
+            l = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(x, 16), 16),
+                                   _mm256_srai_epi32(_mm256_slli_epi32(y, 16), 16));
+            r = _mm256_packs_epi32(_mm256_srai_epi32(x, 16), _mm256_srai_epi32(y, 16));
+        } else if (Bytes == 4) {
+            x = _mm256_shuffle_epi32(x, _MM_SHUFFLE(3, 1, 2, 0));
+            y = _mm256_shuffle_epi32(y, _MM_SHUFFLE(3, 1, 2, 0));
+            l = _mm256_unpacklo_epi64(x, y);
+            r = _mm256_unpackhi_epi64(x, y);
+        } else {
+            l = _mm256_unpacklo_epi64(x, y);
+            r = _mm256_unpackhi_epi64(x, y);
+        }
+        _mm256_storeu_si256((__m256i *) (left + i * Bytes),
+                            _mm256_permute4x64_epi64(l, _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_si256((__m256i *) (right + i * Bytes),
+                            _mm256_permute4x64_epi64(r, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    return i;
+}
+
+static bool cpu_has_avx2() {
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+}
+
+#elif PCM_HAVE_NEON
+/**
+ * NEON 的 vst2/vld2 本身就是两路交错存取
+ */
+template<int Bytes>
+static int32_t interleave_stereo_neon(uint8_t *dst, const uint8_t *left,
+                                      const uint8_t *right, int32_t nb_samples) {
+    const int32_t step = 16 / Bytes;
+    int32_t i = 0;
+    for (; i + step <= nb_samples; i += step) {
+        if (Bytes == 2) {
+            uint16x8x2_t v = {{vld1q_u16((const uint16_t *) left + i),
+                               vld1q_u16((const uint16_t *) right + i)}};
+            vst2q_u16((uint16_t *) dst + 2 * i, v);
+        } else if (Bytes == 4) {
+            uint32x4x2_t v = {{vld1q_u32((const uint32_t *) left + i),
+                               vld1q_u32((const uint32_t *) right + i)}};
+            vst2q_u32((uint32_t *) dst + 2 * i, v);
+        } else {
+            uint64x2x2_t v = {{vld1q_u64((const uint64_t *) left + i),
+                               vld1q_u64((const uint64_t *) right + i)}};
+            vst2q_u64((uint64_t *) dst + 2 * i, v);
+        }
+    }
+    return i;
+}
+
+template<int Bytes>
+static int32_t deinterleave_stereo_neon(uint8_t *left, uint8_t *right,
+                                        const uint8_t *src, int32_t nb_samples) {
+    const int32_t step = 16 / Bytes;
+    int32_t i = 0;
+    for (; i + step <= nb_samples; i += step) {
+        if (Bytes == 2) {
+            uint16x8x2_t v = vld2q_u16((const uint16_t *) src + 2 * i);
+            vst1q_u16((uint16_t *) left + i, v.val[0]);
+            vst1q_u16((uint16_t *) right + i, v.val[1]);
+        } else if (Bytes == 4) {
+            uint32x4x2_t v = vld2q_u32((const uint32_t *) src + 2 * i);
+            vst1q_u32((uint32_t *) left + i, v.val[0]);
+            vst1q_u32((uint32_t *) right + i, v.val[1]);
+        } else {
+            uint64x2x2_t v = vld2q_u64((const uint64_t *) src + 2 * i);
+            vst1q_u64((uint64_t *) left + i, v.val[0]);
+            vst1q_u64((uint64_t *) right + i, v.val[1]);
+        }
+    }
+    return i;
+}
+#endif
+
+int32_t pcm_kernel_supported(PcmKernel kernel) {
+    switch (kernel) {
+        case PCM_KERNEL_AUTO:
+        case PCM_KERNEL_SCALAR:
+            return 1;
+#if PCM_HAVE_SSE2
+        case PCM_KERNEL_SSE2:
+            return 1;
+        case PCM_KERNEL_AVX2:
+            return cpu_has_avx2();
+#elif PCM_HAVE_NEON
+        case PCM_KERNEL_NEON:
+            return 1;
+#endif
+        default:
+            return 0;
+    }
+}
+
+const char *pcm_kernel_name(PcmKernel kernel) {
+    switch (kernel) {
+        case PCM_KERNEL_AUTO:
+            return "auto";
+        case PCM_KERNEL_SCALAR:
+            return "scalar";
+        case PCM_KERNEL_SSE2:
+            return "sse2";
+        case PCM_KERNEL_AVX2:
+            return "avx2";
+        case PCM_KERNEL_NEON:
+            return "neon";
+        default:
+            return "unknown";
+    }
+}
+
+// 把 PCM_KERNEL_AUTO 换成当前 CPU 上最快的实现
+static PcmKernel resolve_kernel(PcmKernel kernel) {
+    if (kernel != PCM_KERNEL_AUTO) {
+        return kernel;
+    }
+#if PCM_HAVE_SSE2
+    return cpu_has_avx2() ? PCM_KERNEL_AVX2 : PCM_KERNEL_SSE2;
+#elif PCM_HAVE_NEON
+    return PCM_KERNEL_NEON;
+#else
+    return PCM_KERNEL_SCALAR;
+#endif
+}
+
+// 返回向量部分处理了多少个采样，剩下的交给标量循环
+template<int Bytes>
+static int32_t interleave_stereo(PcmKernel kernel, uint8_t *dst, const uint8_t *left,
+                                 const uint8_t *right, int32_t nb_samples) {
+    switch (kernel) {
+#if PCM_HAVE_SSE2
+        case PCM_KERNEL_AVX2:
+            return interleave_stereo_avx2<Bytes>(dst, left, right, nb_samples);
+        case PCM_KERNEL_SSE2:
+            return interleave_stereo_sse2<Bytes>(dst, left, right, nb_samples);
+#elif PCM_HAVE_NEON
+        case PCM_KERNEL_NEON:
+            return interleave_stereo_neon<Bytes>(dst, left, right, nb_samples);
+#endif
+        default:
+            return 0;
+    }
+}
+
+template<int Bytes>
+static int32_t deinterleave_stereo(PcmKernel kernel, uint8_t *left, uint8_t *right,
+                                   const uint8_t *src, int32_t nb_samples) {
+    switch (kernel) {
+#if PCM_HAVE_SSE2
+        case PCM_KERNEL_AVX2:
+            return deinterleave_stereo_avx2<Bytes>(left, right, src, nb_samples);
+        case PCM_KERNEL_SSE2:
+            return deinterleave_stereo_sse2<Bytes>(left, right, src, nb_samples);
+#elif PCM_HAVE_NEON
+        case PCM_KERNEL_NEON:
+            return deinterleave_stereo_neon<Bytes>(left, right, src, nb_samples);
+#endif
+        default:
+            return 0;
+    }
+}
+
+int32_t interleave_samples_kernel(PcmKernel kernel, uint8_t *dst, const uint8_t *const *src,
+                                  int32_t bytes_per_sample, int32_t channels,
+                                  int32_t nb_samples) {
+    if (!pcm_kernel_supported(kernel)) {
+        return -1;
+    }
+    if (channels == 1) {
+        memcpy(dst, src[0], (size_t) bytes_per_sample * nb_samples);
+        return 0;
+    }
+    int32_t done = 0;
+    if (channels == 2) {
+        kernel = resolve_kernel(kernel);
+        switch (bytes_per_sample) {
+            case 2:
+                done = interleave_stereo<2>(kernel, dst, src[0], src[1], nb_samples);
+                break;
+            case 4:
+                done = interleave_stereo<4>(kernel, dst, src[0], src[1], nb_samples);
+                break;
+            case 8:
+                done = interleave_stereo<8>(kernel, dst, src[0], src[1], nb_samples);
+                break;
+            default:
+                break;
+        }
+    }
+    interleave_tail(dst, src, bytes_per_sample, channels, done, nb_samples);
+    return 0;
+}
+
+int32_t deinterleave_samples_kernel(PcmKernel kernel, uint8_t *const *dst, const uint8_t *src,
+                                    int32_t bytes_per_sample, int32_t channels,
+                                    int32_t nb_samples) {
+    if (!pcm_kernel_supported(kernel)) {
+        return -1;
+    }
+    if (channels == 1) {
+        memcpy(dst[0], src, (size_t) bytes_per_sample * nb_samples);
+        return 0;
+    }
+    int32_t done = 0;
+    if (channels == 2) {
+        kernel = resolve_kernel(kernel);
+        switch (bytes_per_sample) {
+            case 2:
+                done = deinterleave_stereo<2>(kernel, dst[0], dst[1], src, nb_samples);
+                break;
+            case 4:
+                done = deinterleave_stereo<4>(kernel, dst[0], dst[1], src, nb_samples);
+                break;
+            case 8:
+                done = deinterleave_stereo<8>(kernel, dst[0], dst[1], src, nb_samples);
+                break;
+            default:
+                break;
+        }
+    }
+    deinterleave_tail(dst, src, bytes_per_sample, channels, done, nb_samples);
+    return 0;
+}
+
+void interleave_samples(uint8_t *dst, const uint8_t *const *src,
+                        int32_t bytes_per_sample, int32_t channels,
+                        int32_t nb_samples) {
+    interleave_samples_kernel(PCM_KERNEL_AUTO, dst, src, bytes_per_sample, channels, nb_samples);
+}
+
+void deinterleave_samples(uint8_t *const *dst, const uint8_t *src,
+                          int32_t bytes_per_sample, int32_t channels,
+                          int32_t nb_samples) {
+    deinterleave_samples_kernel(PCM_KERNEL_AUTO, dst, src, bytes_per_sample, channels, nb_samples);
+}
@@ -0,0 +1,23 @@
+//
+// 流探测结果缓存，实现和 sffplay 共用 common/probe_cache.h，这里只加上计时和打印
+//
+
+#include "probe_cache_core.h"
+#include "probe_cache.h"
+
+#include <chrono>
+#include <iostream>
+
+int32_t probe_cache_open_input(AVFormatContext **fmt_ctx, const char *filename,
+                               const AVInputFormat *input_format, int32_t use_cache) {
+    auto start = std::chrono::steady_clock::now();
+    int hit = 0;
+    int32_t result = probe_cache_open_input(fmt_ctx, filename, input_format, use_cache, &hit);
+    if (result < 0) {
+        return result;
+    }
+    std::cout << "open " << filename << ": "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+              << " ms, probe cache " << (!use_cache ? "off" : hit ? "hit" : "miss") << std::endl;
+    return result;
+}
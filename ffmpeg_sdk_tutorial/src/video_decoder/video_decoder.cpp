@@ -4,6 +4,7 @@
 //
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
 
@@ -11,7 +12,7 @@
 #include "video_decoder_core.h"
 
 
-int main() {
+int main(int argc, char **argv) {
 
     char input_file_name[] = "2_football.h264";
     char output_file_name[] = "output";
@@ -19,23 +20,66 @@ int main() {
     std::cout << "Input file:" << std::string(input_file_name) << std::endl;
     std::cout << "output file:" << std::string(output_file_name) << std::endl;
 
-    int32_t result = open_input_output_files(input_file_name, output_file_name);
+    IoContext io = {};
+    int32_t result = open_input_output_files(&io, input_file_name, output_file_name);
     if (result < 0) {
         return result;
     }
 
-    result = init_video_decoder();
+    /**
+     * 命令行参数：
+     *  --mmap                  把输入文件映射到内存，parser 直接读映射区域
+     *  --threads N             解码线程数，0 表示自动
+     *  --thread-type frame|slice|auto
+     *  --low-delay             低延迟模式，会关闭帧级并行
+     *  --quiet                 不打印逐帧日志，测吞吐量时使用
+     */
+    VideoDecoderConfig config = {};
+    config.thread_count = 1;
+    config.verbose = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mmap") == 0) {
+            result = map_input_file(&io);
+            if (result < 0) {
+                return result;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            config.thread_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--thread-type") == 0 && i + 1 < argc) {
+            const char *type = argv[++i];
+            if (strcmp(type, "frame") == 0) {
+                config.thread_type = VIDEO_DECODER_THREAD_FRAME;
+            } else if (strcmp(type, "slice") == 0) {
+                config.thread_type = VIDEO_DECODER_THREAD_SLICE;
+            } else if (strcmp(type, "auto") == 0) {
+                config.thread_type = VIDEO_DECODER_THREAD_FRAME | VIDEO_DECODER_THREAD_SLICE;
+            } else {
+                std::cerr << "Error: unknown thread type:" << std::string(type) << std::endl;
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--low-delay") == 0) {
+            config.low_delay = true;
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            config.verbose = false;
+        } else {
+            std::cerr << "Error: unknown option:" << std::string(argv[i]) << std::endl;
+            return -1;
+        }
+    }
+
+    VideoDecoderContext decoder = {};
+    result = init_video_decoder(&decoder, &config);
     if (result < 0) {
         return result;
     }
 
-    result = decoding();
+    result = decoding(&decoder, &io);
     if (result < 0) {
         return result;
     }
 
-    destroy_video_decoder();
-    close_input_output_files();
+    destroy_video_decoder(&decoder);
+    close_input_output_files(&io);
     return 0;
 }
 
@@ -6,60 +6,81 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
+#include <chrono>
 #include <iostream>
 
+#include "av_pool.h"
 #include "io_data.h"
 #include "video_decoder_core.h"
 
 #define INBUF_SIZE 4096
 
-const static AVCodec *codec = nullptr;
-static AVCodecContext *codec_ctx = nullptr;
+using Clock = std::chrono::steady_clock;
 
-static AVCodecParserContext *parser = nullptr;
-
-static AVFrame *frame = nullptr;
-static AVPacket *pkt = nullptr;
+static double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
 
 /**
  * 初始化解码相关数据结构
  * AVCodec:
  * AVCodecContext
  * AVCodecParserContext
+ * 线程数和线程类型必须在 avcodec_open2 之前设置
  */
-int32_t init_video_decoder() {
-    codec = avcodec_find_decoder(AV_CODEC_ID_H264);
-    if (!codec) {
+int32_t init_video_decoder(VideoDecoderContext *ctx, const VideoDecoderConfig *config) {
+    ctx->codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (!ctx->codec) {
         std::cerr << "Error: could not find codec." << std::endl;
         return -1;
     }
 
-    parser = av_parser_init(codec->id);
-    if (!parser) {
+    ctx->parser = av_parser_init(ctx->codec->id);
+    if (!ctx->parser) {
         std::cerr << "Error: could not init parser." << std::endl;
         return -1;
     }
 
-    codec_ctx = avcodec_alloc_context3(codec);
-    if (!codec_ctx) {
+    ctx->codec_ctx = avcodec_alloc_context3(ctx->codec);
+    if (!ctx->codec_ctx) {
         std::cerr << "Error: could not alloc codec." << std::endl;
         return -1;
     }
 
-    int32_t result = avcodec_open2(codec_ctx, codec, nullptr);
+    ctx->verbose = true;
+    if (config != nullptr) {
+        ctx->codec_ctx->thread_count = config->thread_count;
+        if (config->thread_type != 0) {
+            ctx->codec_ctx->thread_type = config->thread_type;
+        }
+        if (config->low_delay) {
+            ctx->codec_ctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        }
+        ctx->verbose = config->verbose;
+    }
+
+    int32_t result = avcodec_open2(ctx->codec_ctx, ctx->codec, nullptr);
     if (result < 0) {
         std::cerr << "Error: could not open codec." << std::endl;
         return -1;
     }
-
-    frame = av_frame_alloc();
-    if (!frame) {
+    // 打开之后才能知道实际用了几个线程、哪种并行方式
+    std::cout << "Decoder threads:" << ctx->codec_ctx->thread_count
+              << ", active thread type:"
+              << (ctx->codec_ctx->active_thread_type == FF_THREAD_FRAME ? "frame" :
+                  ctx->codec_ctx->active_thread_type == FF_THREAD_SLICE ? "slice" : "none")
+              << std::endl;
+
+    frame_pool_init(&ctx->frame_pool, 0, 0, AV_PIX_FMT_NONE);
+    packet_pool_init(&ctx->packet_pool);
+    ctx->frame = frame_pool_get(&ctx->frame_pool);
+    if (!ctx->frame) {
         std::cerr << "Error: could not alloc frame." << std::endl;
         return -1;
     }
 
-    pkt = av_packet_alloc();
-    if (!pkt) {
+    ctx->pkt = packet_pool_get(&ctx->packet_pool);
+    if (!ctx->pkt) {
         std::cerr << "Error: could not alloc packet." << std::endl;
         return -1;
     }
@@ -70,16 +91,21 @@ int32_t init_video_decoder() {
 /**
  * 将 packet 转换成 frame，再提取 frame 中的yuv图像写入到文件
  */
-static int32_t decode_packet(bool flushing) {
+static int32_t decode_packet(VideoDecoderContext *ctx, IoContext *io, bool flushing) {
     int32_t result = 0;
-    result = avcodec_send_packet(codec_ctx, flushing ? nullptr : pkt);
+    auto start = Clock::now();
+    result = avcodec_send_packet(ctx->codec_ctx, flushing ? nullptr : ctx->pkt);
+    ctx->stats.decode_ms += elapsed_ms(start);
     if (result < 0) {
         std::cerr << "Error: failed to send packet, result:" << result << std::endl;
         return -1;
     }
 
-    while (result) {
-        result = avcodec_receive_frame(codec_ctx, frame);
+    // 一个 packet 可能解出零到多帧，一直取到 EAGAIN 或 EOF 为止
+    for (;;) {
+        start = Clock::now();
+        result = avcodec_receive_frame(ctx->codec_ctx, ctx->frame);
+        ctx->stats.decode_ms += elapsed_ms(start);
         if (result == AVERROR(EAGAIN) || result == AVERROR_EOF)
             return 1;
         else if (result < 0) {
@@ -87,36 +113,46 @@ static int32_t decode_packet(bool flushing) {
                       << std::endl;
             return -1;
         }
-        if (flushing) {
-            std::cout << "Flushing:";
+        ctx->stats.frames++;
+        if (ctx->verbose) {
+            if (flushing) {
+                std::cout << "Flushing:";
+            }
+            std::cout << "Write frame pic_num:" << ctx->frame->pts
+                      << std::endl;
         }
-        std::cout << "Write frame pic_num:" << frame->pts
-                  << std::endl;
-        write_frame_to_yuv(frame);
+        write_frame_to_yuv(io, ctx->frame);
     }
     return 0;
 }
 
 /**
  * 读取二进制文件到 inbuf, 转换成 AVPacket，之后使用 decode_packet 解码packet
+ * 输入文件已经 mmap 时直接从映射区域解析，不经过 inbuf
  */
-int32_t decoding() {
-    uint8_t inbuf[INBUF_SIZE] = {0};
+int32_t decoding(VideoDecoderContext *ctx, IoContext *io) {
+    uint8_t inbuf[INBUF_SIZE + AV_INPUT_BUFFER_PADDING_SIZE] = {0};
     int32_t result = 0;
-    uint8_t *data = nullptr;
+    const uint8_t *data = nullptr;
     int32_t data_size = 0;
-    while (!end_of_input_file()) {
-        // data_size 是输入文件的大小
-        result = read_data_to_buf(inbuf, INBUF_SIZE, data_size);
+    auto start = Clock::now();
+    ctx->stats = {};
+    while (!end_of_input_file(io)) {
+        if (io->map_data != nullptr) {
+            result = map_data_to_buf(io, &data, MAP_CHUNK_SIZE, data_size);
+        } else {
+            // data_size 是本次读到的字节数
+            result = read_data_to_buf(io, inbuf, INBUF_SIZE, data_size);
+            // data是缓冲区指针，指向缓冲区开始位置
+            data = inbuf;
+        }
         if (result < 0) {
-            std::cerr << "Error: read_data_to_buf failed." << std::endl;
+            std::cerr << "Error: read input data failed." << std::endl;
             return -1;
         }
 
-        // data是缓冲区指针，指向缓冲区开始位置
-        data = inbuf;
         while (data_size > 0) {
-            result = av_parser_parse2(parser, codec_ctx, &pkt->data, &pkt->size, data,
+            result = av_parser_parse2(ctx->parser, ctx->codec_ctx, &ctx->pkt->data, &ctx->pkt->size, data,
                                       data_size, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
             if (result < 0) {
                 std::cerr << "Error: av_parser_parse2 failed." << std::endl;
@@ -127,25 +163,42 @@ int32_t decoding() {
             data += result;
             data_size -= result;
 
-            if (pkt->size) {
-                std::cout << "Parsed packet size:" << pkt->size << std::endl;
-                result = decode_packet(false);
+            if (ctx->pkt->size) {
+                if (ctx->verbose) {
+                    std::cout << "Parsed packet size:" << ctx->pkt->size << std::endl;
+                }
+                result = decode_packet(ctx, io, false);
                 if (result < 0) {
                     break;
                 }
             }
         }
     }
-    result = decode_packet(true);
+    result = decode_packet(ctx, io, true);
     if (result < 0) {
         return result;
     }
+
+    // 吞吐量报告，用来按机器调整线程数和线程类型
+    ctx->stats.total_ms = elapsed_ms(start);
+    // 一帧都没解出来时也打印，这时只有总耗时有意义
+    int64_t frames = ctx->stats.frames > 0 ? ctx->stats.frames : 1;
+    std::cout << "Decoded " << ctx->stats.frames << " frames in " << ctx->stats.total_ms
+              << " ms, " << (ctx->stats.total_ms > 0 ? ctx->stats.frames * 1000.0 / ctx->stats.total_ms : 0) << " fps, "
+              << ctx->stats.total_ms / frames << " ms/frame, decode only "
+              << ctx->stats.decode_ms / frames << " ms/frame" << std::endl;
     return 0;
 }
 
-void destroy_video_decoder() {
-    av_parser_close(parser);
-    avcodec_free_context(&codec_ctx);
-    av_frame_free(&frame);
-    av_packet_free(&pkt);
+void get_video_decoder_stats(VideoDecoderContext *ctx, VideoDecoderStats *out) { *out = ctx->stats; }
+
+void destroy_video_decoder(VideoDecoderContext *ctx) {
+    av_parser_close(ctx->parser);
+    avcodec_free_context(&ctx->codec_ctx);
+    frame_pool_put(&ctx->frame_pool, ctx->frame);
+    ctx->frame = nullptr;
+    packet_pool_put(&ctx->packet_pool, ctx->pkt);
+    ctx->pkt = nullptr;
+    frame_pool_uninit(&ctx->frame_pool);
+    packet_pool_uninit(&ctx->packet_pool);
 }
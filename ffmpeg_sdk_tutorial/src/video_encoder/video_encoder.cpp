@@ -3,9 +3,16 @@
 //
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <string>
 
+extern "C" {
+#include <libavutil/avstring.h>
+#include <libavutil/parseutils.h>
+#include <libavutil/pixdesc.h>
+}
+
 #include "io_data.h"
 #include "video_encoder_core.h"
 
@@ -14,31 +21,133 @@
  * 官方例子也是一样；最后证实是生成的 frame 有错误。
  */
 
+/**
+ * 命令行参数：
+ *  --profile vod|live      预置参数，要放在其他编码参数前面
+ *  --size WxH              输入分辨率，也可以是 cif/720p 这类缩写
+ *  --pix-fmt yuv420p       输入像素格式
+ *  --fps N
+ *  --gop N
+ *  --bframes N
+ *  --preset ultrafast|...|slow
+ *  --tune zerolatency|film|...
+ *  --crf N                 恒定质量
+ *  --cbr kbps              恒定码率
+ *  --vbv kbps maxkbps bufkbit
+ *  --abr kbps              平均码率
+ *  --parallel N            按 GOP 分段并行编码，N 为 0 时使用 CPU 核数
+ *  --pipeline              读、编码、写三个线程流水线编码
+ */
+static int32_t parse_args(int argc, char **argv, VideoEncoderProfile *profile,
+                          int32_t &workers, bool &pipeline) {
+    for (int i = 1; i < argc; i++) {
+        const char *opt = argv[i];
+        if (strcmp(opt, "--pipeline") == 0) {
+            pipeline = true;
+            continue;
+        }
+        // 除了 --vbv 之外的选项都只带一个参数
+        int nb_args = strcmp(opt, "--vbv") == 0 ? 3 : 1;
+        if (i + nb_args >= argc) {
+            std::cerr << "Error: missing value for option:" << std::string(opt) << std::endl;
+            return -1;
+        }
+        const char *val = argv[i + 1];
+        if (strcmp(opt, "--profile") == 0) {
+            if (init_video_encoder_profile(profile, val) < 0) {
+                return -1;
+            }
+        } else if (strcmp(opt, "--size") == 0) {
+            if (av_parse_video_size(&profile->width, &profile->height, val) < 0) {
+                std::cerr << "Error: invalid size:" << std::string(val) << std::endl;
+                return -1;
+            }
+        } else if (strcmp(opt, "--pix-fmt") == 0) {
+            profile->pix_fmt = av_get_pix_fmt(val);
+            if (profile->pix_fmt == AV_PIX_FMT_NONE) {
+                std::cerr << "Error: invalid pixel format:" << std::string(val) << std::endl;
+                return -1;
+            }
+        } else if (strcmp(opt, "--fps") == 0) {
+            profile->fps = atoi(val);
+        } else if (strcmp(opt, "--gop") == 0) {
+            profile->gop_size = atoi(val);
+        } else if (strcmp(opt, "--bframes") == 0) {
+            profile->max_b_frames = atoi(val);
+        } else if (strcmp(opt, "--preset") == 0) {
+            av_strlcpy(profile->preset, val, sizeof(profile->preset));
+        } else if (strcmp(opt, "--tune") == 0) {
+            av_strlcpy(profile->tune, val, sizeof(profile->tune));
+        } else if (strcmp(opt, "--crf") == 0) {
+            profile->rc_mode = RC_MODE_CRF;
+            profile->crf = atoi(val);
+        } else if (strcmp(opt, "--cbr") == 0) {
+            profile->rc_mode = RC_MODE_CBR;
+            profile->bit_rate = atoll(val) * 1000;
+        } else if (strcmp(opt, "--abr") == 0) {
+            profile->rc_mode = RC_MODE_ABR;
+            profile->bit_rate = atoll(val) * 1000;
+        } else if (strcmp(opt, "--vbv") == 0) {
+            profile->rc_mode = RC_MODE_VBV;
+            profile->bit_rate = atoll(argv[i + 1]) * 1000;
+            profile->max_rate = atoll(argv[i + 2]) * 1000;
+            profile->buffer_size = atoll(argv[i + 3]) * 1000;
+        } else if (strcmp(opt, "--parallel") == 0) {
+            workers = atoi(val);
+        } else {
+            std::cerr << "Error: unknown option:" << std::string(opt) << std::endl;
+            return -1;
+        }
+        i += nb_args;
+    }
+    return 0;
+}
+
 int main(int argc, char **argv) {
 
     char input_file_name[] = "1_soccor.yuv";
-    char output_file_name[] = "soccor1.yuv";
+    char output_file_name[] = "soccor1.h264";
     char codec_name[] = "libx264";
 
+    VideoEncoderProfile profile;
+    init_video_encoder_profile(&profile, "vod");
+    int32_t workers = -1;
+    bool pipeline = false;
+    if (parse_args(argc, argv, &profile, workers, pipeline) < 0) {
+        return -1;
+    }
+
     std::cout << "Input file:" << std::string(input_file_name) << std::endl;
     std::cout << "output file:" << std::string(output_file_name) << std::endl;
     std::cout << "codec name:" << std::string(codec_name) << std::endl;
+    std::cout << "profile:" << profile.width << "x" << profile.height << " "
+              << av_get_pix_fmt_name(profile.pix_fmt) << " " << profile.fps
+              << "fps, preset:" << profile.preset << ", tune:" << profile.tune
+              << ", rc mode:" << profile.rc_mode << std::endl;
 
-    int32_t result = open_input_output_files(input_file_name, output_file_name);
+    IoContext io = {};
+    VideoEncoderContext encoder = {};
+    int32_t result = open_input_output_files(&io, input_file_name, output_file_name);
     if (result < 0) {
         return result;
     }
-    result = init_video_encoder(codec_name);
+    result = init_video_encoder(&encoder, codec_name, &profile);
     if (result < 0) {
         goto failed;
     }
-    result = encoding(300);
+    if (workers >= 0) {
+        result = parallel_encoding(&encoder, &io, 300, workers);
+    } else if (pipeline) {
+        result = pipelined_encoding(&encoder, &io, 300);
+    } else {
+        result = encoding(&encoder, &io, 300);
+    }
     if (result < 0) {
         goto failed;
     }
 
     failed:
-    destroy_video_encoder();
-    close_input_output_files();
+    destroy_video_encoder(&encoder);
+    close_input_output_files(&io);
     return 0;
 }
@@ -6,110 +6,218 @@
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/avstring.h>
 #include <libavutil/opt.h>
 }
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include "av_pool.h"
 #include "io_data.h"
+#include "spsc_queue.h"
+#include "video_encoder_core.h"
 
-const static AVCodec *codec = nullptr;
-static AVCodecContext *codec_ctx = nullptr;
-static AVFrame *frame = nullptr;
-static AVPacket *pkt = nullptr;
-
-int32_t init_video_encoder(const char *codec_name) {
-    // 验证输入编码器名称非空
-    if (strlen(codec_name) == 0) {
-        std::cerr << "Error: empty codec name." << std::endl;
+int32_t init_video_encoder_profile(VideoEncoderProfile *profile, const char *name) {
+    *profile = {};
+    profile->width = 352;
+    profile->height = 288;
+    profile->pix_fmt = AV_PIX_FMT_YUV420P;
+    profile->fps = 25;
+    profile->gop_size = 10;
+    if (strcmp(name, "vod") == 0) {
+        profile->max_b_frames = 1;
+        av_strlcpy(profile->preset, "slow", sizeof(profile->preset));
+        profile->rc_mode = RC_MODE_ABR;
+        profile->bit_rate = 400000;
+    } else if (strcmp(name, "live") == 0) {
+        // 直播：编码速度优先，不用 B 帧也不等 lookahead，码率恒定便于推流
+        profile->gop_size = 50;
+        profile->max_b_frames = 0;
+        av_strlcpy(profile->preset, "ultrafast", sizeof(profile->preset));
+        av_strlcpy(profile->tune, "zerolatency", sizeof(profile->tune));
+        profile->rc_mode = RC_MODE_CBR;
+        profile->bit_rate = 400000;
+        profile->buffer_size = 400000;
+    } else {
+        std::cerr << "Error: unknown encoder profile:" << std::string(name) << std::endl;
         return -1;
     }
+    return 0;
+}
 
-    // 查找编码器
-    codec = avcodec_find_encoder_by_name(codec_name);
-    if (!codec) {
-        std::cerr << "Error: could not find codec with codec name:"
-                  << std::string(codec_name) << std::endl;
-        return -1;
+// 按码率控制方式设置 AVCodecContext 和 x264 私有参数
+static void apply_rate_control(AVCodecContext *ctx, const VideoEncoderProfile *p) {
+    switch (p->rc_mode) {
+        case RC_MODE_CRF:
+            ctx->bit_rate = 0;
+            av_opt_set_int(ctx->priv_data, "crf", p->crf, 0);
+            if (p->max_rate > 0) {
+                ctx->rc_max_rate = p->max_rate;
+                ctx->rc_buffer_size = (int) (p->buffer_size > 0 ? p->buffer_size : p->max_rate);
+            }
+            break;
+        case RC_MODE_CBR:
+            ctx->bit_rate = p->bit_rate;
+            ctx->rc_min_rate = p->bit_rate;
+            ctx->rc_max_rate = p->bit_rate;
+            ctx->rc_buffer_size = (int) (p->buffer_size > 0 ? p->buffer_size : p->bit_rate);
+            // x264 需要打开 nal-hrd 才会真正按 CBR 填充码流
+            av_opt_set(ctx->priv_data, "nal-hrd", "cbr", 0);
+            break;
+        case RC_MODE_VBV:
+            ctx->bit_rate = p->bit_rate;
+            ctx->rc_max_rate = p->max_rate > 0 ? p->max_rate : p->bit_rate;
+            ctx->rc_buffer_size = (int) (p->buffer_size > 0 ? p->buffer_size : ctx->rc_max_rate);
+            break;
+        case RC_MODE_ABR:
+        default:
+            ctx->bit_rate = p->bit_rate;
+            break;
     }
+}
 
-    // 创建编码器上下文结构
-    codec_ctx = avcodec_alloc_context3(codec);
-    if (!codec_ctx) {
+/**
+ * 按统一的参数创建并打开一个编码器上下文
+ * 并行分段编码时每个分段都用它创建独立的编码器，参数和串行模式保持一致
+ * closed_gop: 分段编码要求每段都从 IDR 开始，段内不能引用前一段的帧
+ */
+static AVCodecContext *open_encoder_context(VideoEncoderContext *ctx, bool closed_gop) {
+    AVCodecContext *enc_ctx = avcodec_alloc_context3(ctx->codec);
+    if (!enc_ctx) {
         std::cerr << "Error: could not allocate video codec context." << std::endl;
-        return -1;
+        return nullptr;
     }
 
     // 配置编码参数
-    codec_ctx->profile = FF_PROFILE_H264_HIGH;
-    codec_ctx->bit_rate = 400000;
-    codec_ctx->width = 352;
-    codec_ctx->height = 288;
-    codec_ctx->gop_size = 10;
-    codec_ctx->time_base = (AVRational) {1, 25};
-    codec_ctx->framerate = (AVRational) {25, 1};
-    codec_ctx->max_b_frames = 1;
-    codec_ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    const VideoEncoderProfile *p = &ctx->profile;
+    if (p->pix_fmt == AV_PIX_FMT_YUV420P) {
+        // 422/444 输入需要 High 4:2:2 / High 4:4:4，交给编码器自己选
+        enc_ctx->profile = FF_PROFILE_H264_HIGH;
+    }
+    enc_ctx->width = p->width;
+    enc_ctx->height = p->height;
+    enc_ctx->gop_size = p->gop_size;
+    enc_ctx->time_base = (AVRational) {1, p->fps};
+    enc_ctx->framerate = (AVRational) {p->fps, 1};
+    enc_ctx->max_b_frames = p->max_b_frames;
+    enc_ctx->pix_fmt = p->pix_fmt;
 
-    if (codec->id == AV_CODEC_ID_H264) {
-        av_opt_set(codec_ctx->priv_data, "preset", "slow", 0);
+    if (ctx->codec->id == AV_CODEC_ID_H264 || ctx->codec->id == AV_CODEC_ID_HEVC) {
+        if (p->preset[0]) {
+            av_opt_set(enc_ctx->priv_data, "preset", p->preset, 0);
+        }
+        if (p->tune[0]) {
+            av_opt_set(enc_ctx->priv_data, "tune", p->tune, 0);
+        }
+    }
+    apply_rate_control(enc_ctx, p);
+    if (closed_gop) {
+        enc_ctx->flags |= AV_CODEC_FLAG_CLOSED_GOP;
+        // 并行度来自分段，编码器内部不再开线程，避免线程数超过核数
+        enc_ctx->thread_count = 1;
     }
 
     // 使用指定的 codec 初始化编码器上下文结构
-    int32_t result = avcodec_open2(codec_ctx, codec, nullptr);
+    int32_t result = avcodec_open2(enc_ctx, ctx->codec, nullptr);
     if (result < 0) {
         std::cerr << "Error: could not open codec" << std::endl;
+        avcodec_free_context(&enc_ctx);
+        return nullptr;
+    }
+    return enc_ctx;
+}
+
+int32_t init_video_encoder(VideoEncoderContext *ctx, const char *codec_name,
+                           const VideoEncoderProfile *profile) {
+    // 验证输入编码器名称非空
+    if (strlen(codec_name) == 0) {
+        std::cerr << "Error: empty codec name." << std::endl;
+        return -1;
+    }
+
+    // 查找编码器
+    ctx->codec = avcodec_find_encoder_by_name(codec_name);
+    if (!ctx->codec) {
+        std::cerr << "Error: could not find codec with codec name:"
+                  << std::string(codec_name) << std::endl;
         return -1;
     }
 
-    pkt = av_packet_alloc();
-    if (!pkt) {
-        std::cerr << "Error: could not allocate AVPacket." << std::endl;
+    if (profile != nullptr) {
+        ctx->profile = *profile;
+    } else {
+        init_video_encoder_profile(&ctx->profile, "vod");
+    }
+    if (ctx->profile.width <= 0 || ctx->profile.height <= 0 || ctx->profile.fps <= 0) {
+        std::cerr << "Error: invalid encoder profile." << std::endl;
         return -1;
     }
 
-    frame = av_frame_alloc();
-    if (!frame) {
-        std::cerr << "Error: could not allocate AVFrame." << std::endl;
+    // 创建并打开编码器上下文结构
+    ctx->codec_ctx = open_encoder_context(ctx, false);
+    if (!ctx->codec_ctx) {
         return -1;
     }
-    frame->width = codec_ctx->width;
-    frame->height = codec_ctx->height;
-    frame->format = codec_ctx->pix_fmt;
 
-    result = av_frame_get_buffer(frame, 0);
+    // 帧缓冲区的大小由编码参数决定，池里的 frame 取出来就可以直接写入
+    int32_t result = frame_pool_init(&ctx->frame_pool, ctx->codec_ctx->width,
+                                     ctx->codec_ctx->height, ctx->codec_ctx->pix_fmt);
     if (result < 0) {
-        std::cerr << "Error: could not get AVFrame buffer." << std::endl;
+        return -1;
+    }
+    packet_pool_init(&ctx->packet_pool);
+
+    ctx->pkt = packet_pool_get(&ctx->packet_pool);
+    if (!ctx->pkt) {
+        return -1;
+    }
+
+    ctx->frame = frame_pool_get(&ctx->frame_pool);
+    if (!ctx->frame) {
         return -1;
     }
 
     return 0;
 }
 
-void destroy_video_encoder() {
+void destroy_video_encoder(VideoEncoderContext *ctx) {
     // 释放编码器上下文结构
-    avcodec_free_context(&codec_ctx);
-    // 释放 Frame 和 Packet 结构
-    av_frame_free(&frame);
-    av_packet_free(&pkt);
+    avcodec_free_context(&ctx->codec_ctx);
+    // Frame 和 Packet 还给对象池，再统一释放
+    frame_pool_put(&ctx->frame_pool, ctx->frame);
+    ctx->frame = nullptr;
+    packet_pool_put(&ctx->packet_pool, ctx->pkt);
+    ctx->pkt = nullptr;
+    std::cout << "Pool allocated frames:" << ctx->frame_pool.nb_allocated
+              << ", packets:" << ctx->packet_pool.nb_allocated << std::endl;
+    frame_pool_uninit(&ctx->frame_pool);
+    packet_pool_uninit(&ctx->packet_pool);
 }
 
 // 编码 frame 为 packet 并写入文件
-static int32_t encode_frame(bool flushing) {
+static int32_t encode_frame(VideoEncoderContext *ctx, IoContext *io, bool flushing) {
     int32_t result = 0;
     if (!flushing) {
-        std::cout << "Send frame to encoder with pts: " << frame->pts << std::endl;
+        std::cout << "Send frame to encoder with pts: " << ctx->frame->pts << std::endl;
     }
 
-    result = avcodec_send_frame(codec_ctx, flushing ? nullptr : frame);
+    result = avcodec_send_frame(ctx->codec_ctx, flushing ? nullptr : ctx->frame);
     if (result < 0) {
         std::cerr << "Error: avcodec_send_frame failed." << std::endl;
         return result;
     }
 
     while (result >= 0) {
-        result = avcodec_receive_packet(codec_ctx, pkt);
+        result = avcodec_receive_packet(ctx->codec_ctx, ctx->pkt);
         if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
             return 1;
         } else if (result < 0) {
@@ -120,43 +228,466 @@ static int32_t encode_frame(bool flushing) {
         if (flushing) {
             std::cout << "Flushing:";
         }
-        std::cout << "Got encoded package with dts:" << pkt->dts
-                  << ", pts:" << pkt->pts << ", " << std::endl;
-//        write_pkt_to_file(pkt);
+        std::cout << "Got encoded package with dts:" << ctx->pkt->dts
+                  << ", pts:" << ctx->pkt->pts << ", " << std::endl;
+        write_pkt_to_file(io, ctx->pkt);
     }
     return 0;
 }
 
-int32_t encoding(int32_t frame_cnt) {
+int32_t encoding(VideoEncoderContext *ctx, IoContext *io, int32_t frame_cnt) {
     int result = 0;
     for (size_t i = 0; i < frame_cnt; i++) {
-        result = av_frame_make_writable(frame);
+        result = av_frame_make_writable(ctx->frame);
         if (result < 0) {
             std::cerr << "Error: could not av_frame_make_writable." << std::endl;
             return result;
         }
 
-        result = read_yuv_to_frame(frame);
+        result = read_yuv_to_frame(io, ctx->frame);
         if (result < 0) {
             std::cerr << "Error: read_yuv_to_frame failed." << std::endl;
             return result;
         }
-        frame->pts = i;
+        ctx->frame->pts = i;
 
-        result = write_frame_to_yuv(frame);
-        continue;
-
-        result = encode_frame(false);
+        result = encode_frame(ctx, io, false);
         if (result < 0) {
             std::cerr << "Error: encode_frame failed." << std::endl;
             return result;
         }
     }
-    result = encode_frame(true);
+    result = encode_frame(ctx, io, true);
     if (result < 0) {
         std::cerr << "Error: flushing failed." << std::endl;
         return result;
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * 流水线编码
+ * 读文件、编码、写文件分别在三个线程里执行，用 SpscQueue 串起来：
+ *   read -> frame_queue -> encode -> pkt_queue -> write
+ * AVFrame/AVPacket 预先分配好放在 free_frames/free_pkts 里循环使用，
+ * 用完后由下游还给上游，运行过程中不再分配。
+ * 队列里的 nullptr 表示输入结束。
+ * 每个阶段分别统计干活的时间和等队列的时间，利用率最高的阶段就是瓶颈。
+ * 任何一个阶段出错都置位 aborted，另外两个阶段在等队列时看到后退出。
+ */
+#define PIPELINE_FRAMES 8
+#define PIPELINE_PKTS 32
+
+using Clock = std::chrono::steady_clock;
+
+typedef struct StageStats {
+    const char *name;
+    double busy_ms;
+    double wait_ms;
+    int64_t items;
+} StageStats;
+
+static double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// 队列空或满时先让出 CPU，多次失败后短暂休眠，避免空转占满一个核
+static void backoff(int32_t &spins) {
+    if (++spins < 64) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+template<typename T>
+static bool wait_push(SpscQueue<T> &q, const T &value, StageStats *st,
+                      std::atomic<bool> *aborted) {
+    auto start = Clock::now();
+    int32_t spins = 0;
+    while (!q.push(value)) {
+        if (*aborted) {
+            return false;
+        }
+        backoff(spins);
+    }
+    st->wait_ms += elapsed_ms(start);
+    return true;
+}
+
+template<typename T>
+static bool wait_pop(SpscQueue<T> &q, T &value, StageStats *st,
+                     std::atomic<bool> *aborted) {
+    auto start = Clock::now();
+    int32_t spins = 0;
+    while (!q.pop(value)) {
+        if (*aborted) {
+            return false;
+        }
+        backoff(spins);
+    }
+    st->wait_ms += elapsed_ms(start);
+    return true;
+}
+
+static void read_stage(IoContext *io, int32_t frame_cnt, SpscQueue<AVFrame *> *free_frames,
+                       SpscQueue<AVFrame *> *frame_queue, StageStats *st,
+                       std::atomic<bool> *aborted, int32_t *ret) {
+    for (int32_t i = 0; i < frame_cnt; i++) {
+        AVFrame *f = nullptr;
+        if (!wait_pop(*free_frames, f, st, aborted)) {
+            return;
+        }
+        auto start = Clock::now();
+        // 编码器还持有上一次的数据时 make_writable 会复制一份，通常不会发生
+        *ret = av_frame_make_writable(f);
+        if (*ret >= 0) {
+            *ret = read_yuv_to_frame(io, f);
+        }
+        st->busy_ms += elapsed_ms(start);
+        if (*ret < 0) {
+            std::cerr << "Error: read_yuv_to_frame failed." << std::endl;
+            *aborted = true;
+            return;
+        }
+        f->pts = i;
+        st->items++;
+        if (!wait_push(*frame_queue, f, st, aborted)) {
+            return;
+        }
+    }
+    wait_push(*frame_queue, (AVFrame *) nullptr, st, aborted);
+}
+
+// 把编码器里已经能取出的 packet 全部交给写线程
+static int32_t drain_packets(AVCodecContext *ctx, AVPacket *&spare,
+                             SpscQueue<AVPacket *> *free_pkts,
+                             SpscQueue<AVPacket *> *pkt_queue, StageStats *st,
+                             std::atomic<bool> *aborted) {
+    while (true) {
+        if (!spare && !wait_pop(*free_pkts, spare, st, aborted)) {
+            return -1;
+        }
+        auto start = Clock::now();
+        int32_t result = avcodec_receive_packet(ctx, spare);
+        st->busy_ms += elapsed_ms(start);
+        if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
+            return 0;
+        } else if (result < 0) {
+            std::cerr << "Error: avcodec_receive_packet failed." << std::endl;
+            return result;
+        }
+        if (!wait_push(*pkt_queue, spare, st, aborted)) {
+            return -1;
+        }
+        spare = nullptr;
+    }
+}
+
+static void encode_stage(AVCodecContext *codec_ctx, SpscQueue<AVFrame *> *free_frames,
+                         SpscQueue<AVFrame *> *frame_queue, SpscQueue<AVPacket *> *free_pkts,
+                         SpscQueue<AVPacket *> *pkt_queue, StageStats *st,
+                         std::atomic<bool> *aborted, int32_t *ret) {
+    AVPacket *spare = nullptr;
+    while (true) {
+        AVFrame *f = nullptr;
+        if (!wait_pop(*frame_queue, f, st, aborted)) {
+            break;
+        }
+        auto start = Clock::now();
+        *ret = avcodec_send_frame(codec_ctx, f);
+        st->busy_ms += elapsed_ms(start);
+        if (*ret < 0) {
+            std::cerr << "Error: avcodec_send_frame failed." << std::endl;
+            break;
+        }
+        *ret = drain_packets(codec_ctx, spare, free_pkts, pkt_queue, st, aborted);
+        if (*ret < 0) {
+            break;
+        }
+        if (!f) {
+            // flush 完成，通知写线程结束
+            wait_push(*pkt_queue, (AVPacket *) nullptr, st, aborted);
+            break;
+        }
+        st->items++;
+        // 写回空闲队列，生产者是编码线程，消费者是读线程
+        if (!wait_push(*free_frames, f, st, aborted)) {
+            break;
+        }
+    }
+    // 出错时让另外两个线程退出，没有交出去的 frame/packet 由 pipelined_encoding 统一释放
+    if (*ret < 0) {
+        *aborted = true;
+    }
+}
+
+static void write_stage(IoContext *io, SpscQueue<AVPacket *> *free_pkts,
+                        SpscQueue<AVPacket *> *pkt_queue, StageStats *st,
+                        std::atomic<bool> *aborted) {
+    while (true) {
+        AVPacket *p = nullptr;
+        if (!wait_pop(*pkt_queue, p, st, aborted) || !p) {
+            return;
+        }
+        auto start = Clock::now();
+        write_pkt_to_file(io, p);
+        av_packet_unref(p);
+        st->busy_ms += elapsed_ms(start);
+        st->items++;
+        if (!wait_push(*free_pkts, p, st, aborted)) {
+            return;
+        }
+    }
+}
+
+int32_t pipelined_encoding(VideoEncoderContext *ctx, IoContext *io, int32_t frame_cnt) {
+    SpscQueue<AVFrame *> free_frames(PIPELINE_FRAMES), frame_queue(PIPELINE_FRAMES);
+    SpscQueue<AVPacket *> free_pkts(PIPELINE_PKTS), pkt_queue(PIPELINE_PKTS);
+    std::vector<AVFrame *> frames;
+    std::vector<AVPacket *> pkts;
+    int32_t result = 0;
+
+    for (size_t i = 0; i < free_frames.capacity(); i++) {
+        AVFrame *f = frame_pool_get(&ctx->frame_pool);
+        if (!f) {
+            result = -1;
+            break;
+        }
+        frames.push_back(f);
+        free_frames.push(f);
+    }
+    for (size_t i = 0; i < free_pkts.capacity() && result >= 0; i++) {
+        AVPacket *p = packet_pool_get(&ctx->packet_pool);
+        if (!p) {
+            result = -1;
+            break;
+        }
+        pkts.push_back(p);
+        free_pkts.push(p);
+    }
+
+    if (result >= 0) {
+        StageStats read_st = {"read"}, encode_st = {"encode"}, write_st = {"write"};
+        int32_t read_ret = 0, encode_ret = 0;
+        std::atomic<bool> aborted{false};
+        auto start = Clock::now();
+        std::thread reader(read_stage, io, frame_cnt, &free_frames, &frame_queue,
+                           &read_st, &aborted, &read_ret);
+        std::thread writer(write_stage, io, &free_pkts, &pkt_queue, &write_st, &aborted);
+        encode_stage(ctx->codec_ctx, &free_frames, &frame_queue, &free_pkts, &pkt_queue,
+                     &encode_st, &aborted, &encode_ret);
+        reader.join();
+        writer.join();
+        double total_ms = elapsed_ms(start);
+
+        std::cout << "Pipeline finished in " << total_ms << " ms" << std::endl;
+        for (StageStats *st: {&read_st, &encode_st, &write_st}) {
+            std::cout << "  " << st->name << ": items:" << st->items
+                      << ", busy:" << st->busy_ms << " ms, wait:" << st->wait_ms
+                      << " ms, utilisation:" << st->busy_ms * 100.0 / total_ms << "%"
+                      << std::endl;
+        }
+        result = read_ret < 0 ? read_ret : encode_ret;
+    } else {
+        std::cerr << "Error: could not allocate pipeline frames/packets." << std::endl;
+    }
+
+    for (AVFrame *f: frames) {
+        frame_pool_put(&ctx->frame_pool, f);
+    }
+    for (AVPacket *p: pkts) {
+        packet_pool_put(&ctx->packet_pool, p);
+    }
+    return result < 0 ? result : 0;
+}
+
+/**
+ * 并行分段编码
+ * 输入按 SEGMENT_GOPS 个 GOP 切成若干段，每段由工作线程用独立的编码器
+ * 编成一段完整的码流（closed GOP，以 IDR 开头），主线程按顺序拼接写出。
+ * H.264 Annex-B 码流的每段都带有 SPS/PPS，直接首尾相接就是合法的码流。
+ * 同时在内存中的分段数不超过 workers * 2，长输入也不会把整个文件读进内存。
+ */
+#define SEGMENT_GOPS 4
+
+typedef struct EncodeSegment {
+    int64_t first_pts;
+    std::vector<AVFrame *> frames;
+    std::vector<uint8_t> bitstream;
+    bool done;
+    int32_t result;
+} EncodeSegment;
+
+// 主线程和工作线程之间的分段队列，每次 parallel_encoding 各用一个
+typedef struct SegmentQueue {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<EncodeSegment *> pending;
+    bool finished;
+} SegmentQueue;
+
+// 用一个新的编码器把一段帧编成码流，结果追加在 seg->bitstream 中
+static int32_t encode_segment(VideoEncoderContext *ctx, EncodeSegment *seg) {
+    AVCodecContext *enc_ctx = open_encoder_context(ctx, true);
+    AVPacket *seg_pkt = packet_pool_get(&ctx->packet_pool);
+    if (!enc_ctx || !seg_pkt) {
+        avcodec_free_context(&enc_ctx);
+        packet_pool_put(&ctx->packet_pool, seg_pkt);
+        return -1;
+    }
+
+    int32_t result = 0;
+    for (size_t i = 0; i <= seg->frames.size() && result >= 0; i++) {
+        bool flushing = i == seg->frames.size();
+        result = avcodec_send_frame(enc_ctx, flushing ? nullptr : seg->frames[i]);
+        if (result < 0) {
+            std::cerr << "Error: avcodec_send_frame failed." << std::endl;
+            break;
+        }
+        while (true) {
+            result = avcodec_receive_packet(enc_ctx, seg_pkt);
+            if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
+                result = 0;
+                break;
+            } else if (result < 0) {
+                std::cerr << "Error: avcodec_receive_packet failed." << std::endl;
+                break;
+            }
+            seg->bitstream.insert(seg->bitstream.end(), seg_pkt->data,
+                                  seg_pkt->data + seg_pkt->size);
+            av_packet_unref(seg_pkt);
+        }
+    }
+
+    avcodec_free_context(&enc_ctx);
+    packet_pool_put(&ctx->packet_pool, seg_pkt);
+    return result;
+}
+
+static void segment_worker(VideoEncoderContext *ctx, SegmentQueue *queue) {
+    while (true) {
+        EncodeSegment *seg = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(queue->mutex);
+            queue->cond.wait(lock, [queue] { return queue->finished || !queue->pending.empty(); });
+            if (queue->pending.empty()) {
+                return;
+            }
+            seg = queue->pending.front();
+            queue->pending.pop_front();
+        }
+
+        int32_t result = encode_segment(ctx, seg);
+        // 编码完成后输入帧就没用了，尽早还给对象池，主线程读下一段时复用
+        for (AVFrame *f: seg->frames) {
+            frame_pool_put(&ctx->frame_pool, f);
+        }
+        seg->frames.clear();
+
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        seg->result = result;
+        seg->done = true;
+        queue->cond.notify_all();
+    }
+}
+
+// 从输入文件读取一段帧，读到 frame_cnt 为止
+static int32_t read_segment(VideoEncoderContext *ctx, IoContext *io, EncodeSegment *seg,
+                            int64_t first_pts, int32_t seg_frames) {
+    seg->first_pts = first_pts;
+    for (int32_t i = 0; i < seg_frames; i++) {
+        AVFrame *f = frame_pool_get(&ctx->frame_pool);
+        if (!f) {
+            return -1;
+        }
+        seg->frames.push_back(f);
+        if (read_yuv_to_frame(io, f) < 0) {
+            std::cerr << "Error: read_yuv_to_frame failed." << std::endl;
+            return -1;
+        }
+        f->pts = first_pts + i;
+    }
+    return 0;
+}
+
+static void free_segment(VideoEncoderContext *ctx, EncodeSegment *seg) {
+    for (AVFrame *f: seg->frames) {
+        frame_pool_put(&ctx->frame_pool, f);
+    }
+    delete seg;
+}
+
+int32_t parallel_encoding(VideoEncoderContext *ctx, IoContext *io, int32_t frame_cnt,
+                          int32_t workers) {
+    if (workers <= 0) {
+        workers = (int32_t) std::thread::hardware_concurrency();
+        if (workers <= 0) {
+            workers = 1;
+        }
+    }
+    const int32_t seg_len = ctx->codec_ctx->gop_size * SEGMENT_GOPS;
+    const size_t max_inflight = (size_t) workers * 2;
+    std::cout << "Parallel encoding with " << workers << " workers, "
+              << seg_len << " frames per segment" << std::endl;
+
+    SegmentQueue queue;
+    queue.finished = false;
+    std::vector<std::thread> threads;
+    for (int32_t i = 0; i < workers; i++) {
+        threads.emplace_back(segment_worker, ctx, &queue);
+    }
+
+    // inflight 按输入顺序保存所有已提交的分段，队首编码完成后立刻写出
+    std::deque<EncodeSegment *> inflight;
+    int64_t next_pts = 0;
+    int32_t result = 0;
+    while (result >= 0 && (next_pts < frame_cnt || !inflight.empty())) {
+        if (next_pts < frame_cnt && inflight.size() < max_inflight) {
+            int32_t n = std::min<int64_t>(seg_len, frame_cnt - next_pts);
+            EncodeSegment *seg = new EncodeSegment();
+            result = read_segment(ctx, io, seg, next_pts, n);
+            if (result < 0) {
+                free_segment(ctx, seg);
+                break;
+            }
+            next_pts += n;
+            inflight.push_back(seg);
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.pending.push_back(seg);
+            queue.cond.notify_all();
+            continue;
+        }
+
+        EncodeSegment *seg = inflight.front();
+        {
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            queue.cond.wait(lock, [seg] { return seg->done; });
+        }
+        inflight.pop_front();
+        result = seg->result;
+        if (result >= 0) {
+            std::cout << "Write segment from pts:" << seg->first_pts
+                      << ", size:" << seg->bitstream.size() << std::endl;
+            write_packed_data_to_file(io, seg->bitstream.data(),
+                                      (int32_t) seg->bitstream.size());
+        }
+        free_segment(ctx, seg);
+    }
+
+    // 出错时丢弃还没开始编码的分段，等工作线程退出后释放所有分段
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.pending.clear();
+        queue.finished = true;
+        queue.cond.notify_all();
+    }
+    for (std::thread &t: threads) {
+        t.join();
+    }
+    for (EncodeSegment *seg: inflight) {
+        free_segment(ctx, seg);
+    }
+    return result < 0 ? result : 0;
+}
@@ -0,0 +1,109 @@
+/**
+ * 音频解码线程和 SDL 音频回调之间的字节环形队列，C 和 C++ 都可以包含
+ *
+ * 只有一个写者（解码线程）和一个读者（音频回调），读写下标都是单调递增的字节计数，
+ * windex 只由写者更新，rindex 只由读者更新，读写都只是 memcpy 加一次原子更新，
+ * 不加锁、不等待、不分配内存，可以放心在 SDL 的实时音频线程里调用。
+ * 队列满时写者自己决定怎么等，读者读不够时由调用者补静音。
+ */
+
+#ifndef SFFPLAY_AUDIO_RING_H
+#define SFFPLAY_AUDIO_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavutil/mem.h>
+#ifdef __cplusplus
+}
+#endif
+
+#include <SDL.h>
+#include <string.h>
+
+typedef struct AudioRing {
+    uint8_t *buf;
+    // 字节数，必须是 2 的幂
+    unsigned int capacity;
+    SDL_atomic_t windex;
+    SDL_atomic_t rindex;
+} AudioRing;
+
+static inline int audio_ring_init(AudioRing *r, unsigned int capacity) {
+    memset(r, 0, sizeof(AudioRing));
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+        return -1;
+    r->buf = (uint8_t *) av_malloc(capacity);
+    if (!r->buf)
+        return -1;
+    r->capacity = capacity;
+    return 0;
+}
+
+// 可以读取的字节数
+static inline unsigned int audio_ring_available(AudioRing *r) {
+    return (unsigned) SDL_AtomicGet(&r->windex) - (unsigned) SDL_AtomicGet(&r->rindex);
+}
+
+// 可以写入的字节数
+static inline unsigned int audio_ring_space(AudioRing *r) {
+    return r->capacity - audio_ring_available(r);
+}
+
+/**
+ * 写入最多 len 字节，返回实际写入的字节数，只能在写者线程调用
+ */
+static inline unsigned int audio_ring_write(AudioRing *r, const uint8_t *data, unsigned int len) {
+    unsigned int w = (unsigned) SDL_AtomicGet(&r->windex);
+    unsigned int space = r->capacity - (w - (unsigned) SDL_AtomicGet(&r->rindex));
+    unsigned int pos = w & (r->capacity - 1);
+    unsigned int len1;
+
+    if (len > space)
+        len = space;
+    // 写到末尾后回绕到开头，最多分两段拷贝
+    len1 = r->capacity - pos;
+    if (len1 > len)
+        len1 = len;
+    memcpy(r->buf + pos, data, len1);
+    memcpy(r->buf, data + len1, len - len1);
+    // 先写数据再发布下标，读者看到新的 windex 时数据一定已经写好
+    SDL_AtomicSet(&r->windex, (int) (w + len));
+    return len;
+}
+
+/**
+ * 读取最多 len 字节到 dst，返回实际读取的字节数，只能在读者线程调用
+ */
+static inline unsigned int audio_ring_read(AudioRing *r, uint8_t *dst, unsigned int len) {
+    unsigned int rd = (unsigned) SDL_AtomicGet(&r->rindex);
+    unsigned int avail = (unsigned) SDL_AtomicGet(&r->windex) - rd;
+    unsigned int pos = rd & (r->capacity - 1);
+    unsigned int len1;
+
+    if (len > avail)
+        len = avail;
+    len1 = r->capacity - pos;
+    if (len1 > len)
+        len1 = len;
+    memcpy(dst, r->buf + pos, len1);
+    memcpy(dst + len1, r->buf, len - len1);
+    // 数据拷走之后再发布下标，写者才可以覆盖这段空间
+    SDL_AtomicSet(&r->rindex, (int) (rd + len));
+    return len;
+}
+
+/**
+ * 丢掉所有可以读取的数据，只能在读者线程调用
+ * 写者要清空队列（比如 seek 之后）时请求读者来做，不能自己移动 rindex
+ */
+static inline void audio_ring_skip_all(AudioRing *r) {
+    SDL_AtomicSet(&r->rindex, SDL_AtomicGet(&r->windex));
+}
+
+static inline void audio_ring_destroy(AudioRing *r) {
+    av_freep(&r->buf);
+    r->capacity = 0;
+}
+
+#endif //SFFPLAY_AUDIO_RING_H
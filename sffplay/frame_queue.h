@@ -0,0 +1,170 @@
+/**
+ * 播放器共用的解码帧队列，C 和 C++ 都可以包含，实现和 ffplay 的 FrameQueue 相同
+ */
+
+#ifndef SFFPLAY_FRAME_QUEUE_H
+#define SFFPLAY_FRAME_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavcodec/avcodec.h>
+#ifdef __cplusplus
+}
+#endif
+
+#include <SDL.h>
+#include <string.h>
+
+#define FRAME_QUEUE_MAX_SIZE 32
+
+typedef struct Frame {
+    AVFrame *frame;
+    double pts;           // 显示时间，单位秒
+    double duration;      // 估算的帧时长，单位秒
+    int serial;           // 解码这一帧的 packet 的 serial，seek 之后旧的帧直接丢弃
+    double queued_time;   // 放进队列的时刻，单位秒，用来统计帧在队列里等了多久
+} Frame;
+
+/**
+ * AVFrame并不直接包含数据，而是包含使用data指针指向数据，所有可以用
+ * 一个环形队列表示，循环利用AVFrame，更新环形队列指针
+ * 和 ffplay 一样，解码线程通过 av_frame_move_ref 把数据交给队列中的 AVFrame，
+ * 显示完之后 av_frame_unref，AVFrame 结构本身一直复用。
+ * keep_last 为 1 时，最后显示的一帧留在队列里（rindex 位置），
+ * 暂停或者窗口重绘时可以用 frame_queue_peek_last 再画一次。
+ */
+typedef struct FrameQueue {
+    Frame queue[FRAME_QUEUE_MAX_SIZE];
+    int rindex;  // read index
+    int windex;  // write index
+    int size;
+    int max_size;
+    int keep_last;
+    int rindex_shown;  // rindex 位置的帧是否已经显示过
+    int abort_request;
+
+    // 占用统计
+    int64_t nb_pushed;      // 放入的总帧数
+    int max_occupancy;      // 出现过的最多未显示帧数
+    int64_t nb_full_waits;  // 队列满导致解码线程等待的次数
+    int64_t nb_underruns;   // 刷新时没有新帧可以显示的次数
+
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+} FrameQueue;
+
+/**
+ * 初始化FrameQueue
+ */
+static inline int frame_queue_init(FrameQueue *f, int max_size, int keep_last) {
+    memset(f, 0, sizeof(FrameQueue));
+    f->mutex = SDL_CreateMutex();
+    f->cond = SDL_CreateCond();
+    if (!f->mutex || !f->cond) {
+        return -1;
+    }
+    f->max_size = FFMIN(max_size, FRAME_QUEUE_MAX_SIZE);
+    f->keep_last = !!keep_last;
+    for (int i = 0; i < f->max_size; i++) {
+        if (!(f->queue[i].frame = av_frame_alloc())) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static inline void frame_queue_destroy(FrameQueue *f) {
+    for (int i = 0; i < f->max_size; i++) {
+        av_frame_unref(f->queue[i].frame);
+        av_frame_free(&f->queue[i].frame);
+    }
+    SDL_DestroyMutex(f->mutex);
+    SDL_DestroyCond(f->cond);
+}
+
+// 唤醒等待中的解码线程和显示线程，之后 peek_writable/peek_readable 都返回 NULL
+static inline void frame_queue_abort(FrameQueue *f) {
+    SDL_LockMutex(f->mutex);
+    f->abort_request = 1;
+    SDL_CondSignal(f->cond);
+    SDL_UnlockMutex(f->mutex);
+}
+
+// 下一个要显示的帧
+static inline Frame *frame_queue_peek(FrameQueue *f) {
+    return &f->queue[(f->rindex + f->rindex_shown) % f->max_size];
+}
+
+// 再下一个要显示的帧，用来计算当前帧的显示时长
+static inline Frame *frame_queue_peek_next(FrameQueue *f) {
+    return &f->queue[(f->rindex + f->rindex_shown + 1) % f->max_size];
+}
+
+// 上一次显示的帧
+static inline Frame *frame_queue_peek_last(FrameQueue *f) {
+    return &f->queue[f->rindex];
+}
+
+// 未显示的帧数
+static inline int frame_queue_nb_remaining(FrameQueue *f) {
+    return f->size - f->rindex_shown;
+}
+
+// 等待一个可以写入的位置，队列满时阻塞
+static inline Frame *frame_queue_peek_writable(FrameQueue *f) {
+    SDL_LockMutex(f->mutex);
+    if (f->size >= f->max_size) {
+        f->nb_full_waits++;
+    }
+    while (f->size >= f->max_size && !f->abort_request) {
+        SDL_CondWait(f->cond, f->mutex);
+    }
+    SDL_UnlockMutex(f->mutex);
+
+    if (f->abort_request)
+        return NULL;
+    return &f->queue[f->windex];
+}
+
+// 等待一个可以显示的帧，队列空时阻塞
+static inline Frame *frame_queue_peek_readable(FrameQueue *f) {
+    SDL_LockMutex(f->mutex);
+    while (f->size - f->rindex_shown <= 0 && !f->abort_request) {
+        SDL_CondWait(f->cond, f->mutex);
+    }
+    SDL_UnlockMutex(f->mutex);
+
+    if (f->abort_request)
+        return NULL;
+    return frame_queue_peek(f);
+}
+
+// 写完 peek_writable 返回的帧之后调用
+static inline void frame_queue_push(FrameQueue *f) {
+    if (++f->windex == f->max_size)
+        f->windex = 0;
+    SDL_LockMutex(f->mutex);
+    f->size++;
+    f->nb_pushed++;
+    f->max_occupancy = FFMAX(f->max_occupancy, f->size - f->rindex_shown);
+    SDL_CondSignal(f->cond);
+    SDL_UnlockMutex(f->mutex);
+}
+
+// 显示完一帧之后调用，keep_last 时第一次只标记为已显示
+static inline void frame_queue_next(FrameQueue *f) {
+    if (f->keep_last && !f->rindex_shown) {
+        f->rindex_shown = 1;
+        return;
+    }
+    av_frame_unref(f->queue[f->rindex].frame);
+    if (++f->rindex == f->max_size)
+        f->rindex = 0;
+    SDL_LockMutex(f->mutex);
+    f->size--;
+    SDL_CondSignal(f->cond);
+    SDL_UnlockMutex(f->mutex);
+}
+
+#endif //SFFPLAY_FRAME_QUEUE_H
@@ -0,0 +1,284 @@
+/**
+ * 视频流的关键帧索引，C 和 C++ 都可以包含
+ *
+ * 记录每个关键帧的时间戳、在文件中的字节位置和 packet 大小，
+ * seek 时二分查找目标时间之前最近的关键帧，再用 avformat_seek_file 跳过去。
+ * 索引的来源依次是：
+ * 1. 同目录下的缓存文件 <文件名>.kfidx，文件大小和修改时间都对得上才使用
+ * 2. 解复用器自带的索引，mp4、mkv 在 avformat_find_stream_info 之后就有，
+ *    时间戳和解复用器 seek 时用的一致
+ * 3. 单独打开一次文件，把这个流的 packet 扫一遍
+ * 前两种只读内存或者一个小文件，打开文件时用 keyframe_index_build 建立；
+ * 第三种要把整个文件读一遍（TS、裸流、FLV），keyframe_index_build_scan 应该放在后台线程里做，
+ * 不能挡住第一帧。后两种建好之后写回缓存文件，下次打开同一个文件就不用再扫。
+ */
+
+#ifndef SFFPLAY_KEYFRAME_INDEX_H
+#define SFFPLAY_KEYFRAME_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavformat/avformat.h>
+#ifdef __cplusplus
+}
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "probe_cache.h"
+
+#define KEYFRAME_INDEX_MAGIC "sffplay-kfidx 1"
+
+#define KEYFRAME_INDEX_FROM_CACHE 0
+#define KEYFRAME_INDEX_FROM_DEMUXER 1
+#define KEYFRAME_INDEX_FROM_SCAN 2
+
+typedef struct KeyframeEntry {
+    int64_t pts;   // 单位是所属流的 time_base
+    int64_t pos;   // packet 在文件中的字节位置，不知道时为 -1
+    int size;
+} KeyframeEntry;
+
+typedef struct KeyframeIndex {
+    KeyframeEntry *entries;  // 按 pts 升序
+    int nb_entries;
+    int capacity;
+    int stream_index;
+    AVRational time_base;
+    // 相邻关键帧之间最大的间隔，单位 time_base，seek 之后最多要往后解码这么长
+    int64_t max_gop;
+} KeyframeIndex;
+
+static inline int keyframe_index_add(KeyframeIndex *idx, int64_t pts, int64_t pos, int size) {
+    if (idx->nb_entries == idx->capacity) {
+        int capacity = idx->capacity ? idx->capacity * 2 : 256;
+        KeyframeEntry *entries = (KeyframeEntry *) av_realloc(idx->entries, capacity * sizeof(KeyframeEntry));
+        if (!entries)
+            return -1;
+        idx->entries = entries;
+        idx->capacity = capacity;
+    }
+    idx->entries[idx->nb_entries].pts = pts;
+    idx->entries[idx->nb_entries].pos = pos;
+    idx->entries[idx->nb_entries].size = size;
+    idx->nb_entries++;
+    return 0;
+}
+
+static inline int keyframe_entry_cmp(const void *a, const void *b) {
+    int64_t pa = ((const KeyframeEntry *) a)->pts;
+    int64_t pb = ((const KeyframeEntry *) b)->pts;
+    return pa < pb ? -1 : pa > pb;
+}
+
+// 排序并统计最大 GOP 长度，最后一个 GOP 算到流结束为止
+static inline void keyframe_index_finish(KeyframeIndex *idx, int64_t stream_end) {
+    int i;
+    qsort(idx->entries, idx->nb_entries, sizeof(KeyframeEntry), keyframe_entry_cmp);
+    idx->max_gop = 0;
+    for (i = 1; i < idx->nb_entries; i++) {
+        idx->max_gop = FFMAX(idx->max_gop, idx->entries[i].pts - idx->entries[i - 1].pts);
+    }
+    if (idx->nb_entries > 0 && stream_end != AV_NOPTS_VALUE) {
+        idx->max_gop = FFMAX(idx->max_gop, stream_end - idx->entries[idx->nb_entries - 1].pts);
+    }
+}
+
+/**
+ * 返回 pts 小于等于 ts 的最后一个关键帧的下标，ts 比第一个关键帧还早时返回 0，索引为空时返回 -1
+ */
+static inline int keyframe_index_lookup(const KeyframeIndex *idx, int64_t ts) {
+    int lo = 0, hi = idx->nb_entries - 1, mid;
+    if (idx->nb_entries == 0)
+        return -1;
+    while (lo < hi) {
+        mid = lo + (hi - lo + 1) / 2;
+        if (idx->entries[mid].pts <= ts)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+static inline void keyframe_index_free(KeyframeIndex *idx) {
+    av_freep(&idx->entries);
+    idx->nb_entries = 0;
+    idx->capacity = 0;
+}
+
+static inline void keyframe_index_cache_path(const char *filename, char *path, size_t size) {
+    snprintf(path, size, "%s.kfidx", filename);
+}
+
+/**
+ * 读取缓存文件，第一行是 magic、文件大小、修改时间、流下标、time_base 和最大 GOP，
+ * 之后每行一个关键帧：pts pos size
+ */
+static inline int keyframe_index_load(KeyframeIndex *idx, const char *filename, const struct stat *st) {
+    char path[1100], magic[32];
+    long long file_size, mtime, max_gop, pts, pos;
+    int stream_index, tb_num, tb_den, size, ret = -1;
+    FILE *fp;
+
+    keyframe_index_cache_path(filename, path, sizeof(path));
+    fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    if (!fgets(magic, sizeof(magic), fp) || strncmp(magic, KEYFRAME_INDEX_MAGIC, strlen(KEYFRAME_INDEX_MAGIC)) != 0)
+        goto end;
+    if (fscanf(fp, "%lld %lld %d %d %d %lld", &file_size, &mtime, &stream_index,
+               &tb_num, &tb_den, &max_gop) != 6)
+        goto end;
+    // 源文件变了，缓存作废
+    if (file_size != (long long) st->st_size || mtime != (long long) st->st_mtime ||
+        stream_index != idx->stream_index)
+        goto end;
+    while (fscanf(fp, "%lld %lld %d", &pts, &pos, &size) == 3) {
+        if (keyframe_index_add(idx, pts, pos, size) < 0)
+            goto end;
+    }
+    idx->time_base.num = tb_num;
+    idx->time_base.den = tb_den;
+    idx->max_gop = max_gop;
+    ret = idx->nb_entries > 0 ? 0 : -1;
+
+    end:
+    fclose(fp);
+    if (ret < 0)
+        idx->nb_entries = 0;
+    return ret;
+}
+
+static inline int keyframe_index_save(const KeyframeIndex *idx, const char *filename, const struct stat *st) {
+    char path[1100];
+    int i;
+    FILE *fp;
+
+    keyframe_index_cache_path(filename, path, sizeof(path));
+    fp = fopen(path, "w");
+    if (!fp)
+        return -1;
+    fprintf(fp, "%s\n%lld %lld %d %d %d %lld\n", KEYFRAME_INDEX_MAGIC,
+            (long long) st->st_size, (long long) st->st_mtime, idx->stream_index,
+            idx->time_base.num, idx->time_base.den, (long long) idx->max_gop);
+    for (i = 0; i < idx->nb_entries; i++) {
+        fprintf(fp, "%lld %lld %d\n", (long long) idx->entries[i].pts,
+                (long long) idx->entries[i].pos, idx->entries[i].size);
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+/**
+ * 单独打开一次文件，读出这个流所有带关键帧标记的 packet，返回流结束的时间戳
+ * 打开文件和播放时一样走探测缓存，use_probe_cache 的含义和 probe_cache_open_input 的一样；
+ * *abort_request 变成非 0 时提前返回 -1
+ */
+static inline int keyframe_index_scan(KeyframeIndex *idx, const char *filename, int64_t *stream_end,
+                                      int use_probe_cache, const int *abort_request) {
+    AVFormatContext *fmt = NULL;
+    AVPacket *pkt;
+    int64_t ts;
+    int ret = 0, hit;
+
+    if (probe_cache_open_input(&fmt, filename, NULL, use_probe_cache, &hit) < 0)
+        return -1;
+    pkt = av_packet_alloc();
+    if (!pkt) {
+        ret = -1;
+        goto end;
+    }
+    while (!*abort_request && av_read_frame(fmt, pkt) >= 0) {
+        if (pkt->stream_index == idx->stream_index) {
+            ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            if (ts != AV_NOPTS_VALUE) {
+                if ((pkt->flags & AV_PKT_FLAG_KEY) && keyframe_index_add(idx, ts, pkt->pos, pkt->size) < 0) {
+                    ret = -1;
+                }
+                *stream_end = FFMAX(*stream_end == AV_NOPTS_VALUE ? ts : *stream_end, ts + pkt->duration);
+            }
+        }
+        av_packet_unref(pkt);
+        if (ret < 0)
+            break;
+    }
+    if (*abort_request)
+        ret = -1;
+
+    end:
+    av_packet_free(&pkt);
+    avformat_close_input(&fmt);
+    return ret;
+}
+
+/**
+ * 用缓存文件或者解复用器自带的索引为 fmt 中的 stream_index 流建立关键帧索引，不读文件内容
+ * 成功时返回 KEYFRAME_INDEX_FROM_CACHE 或 KEYFRAME_INDEX_FROM_DEMUXER；
+ * 两种都没有时返回 -1，需要的话再用 keyframe_index_build_scan 扫描，扫完之前只能按时间戳直接 seek
+ */
+static inline int keyframe_index_build(KeyframeIndex *idx, const char *filename,
+                                       AVFormatContext *fmt, int stream_index) {
+    AVStream *st = fmt->streams[stream_index];
+    int64_t stream_end = AV_NOPTS_VALUE;
+    struct stat file_stat;
+    int have_stat, source, i, n;
+
+    memset(idx, 0, sizeof(KeyframeIndex));
+    idx->stream_index = stream_index;
+    idx->time_base = st->time_base;
+
+    have_stat = stat(filename, &file_stat) == 0;
+    if (have_stat && keyframe_index_load(idx, filename, &file_stat) == 0)
+        return KEYFRAME_INDEX_FROM_CACHE;
+
+    n = avformat_index_get_entries_count(st);
+    for (i = 0; i < n; i++) {
+        const AVIndexEntry *e = avformat_index_get_entry(st, i);
+        if (e && (e->flags & AVINDEX_KEYFRAME) && keyframe_index_add(idx, e->timestamp, e->pos, e->size) < 0)
+            return -1;
+    }
+    if (idx->nb_entries > 0) {
+        source = KEYFRAME_INDEX_FROM_DEMUXER;
+        if (st->duration != AV_NOPTS_VALUE)
+            stream_end = (st->start_time != AV_NOPTS_VALUE ? st->start_time : 0) + st->duration;
+    } else {
+        keyframe_index_free(idx);
+        return -1;
+    }
+    keyframe_index_finish(idx, stream_end);
+
+    if (have_stat)
+        keyframe_index_save(idx, filename, &file_stat);
+    return source;
+}
+
+/**
+ * 扫描整个文件建立 stream_index 流的关键帧索引并写回缓存文件，要读完整个文件，不要在播放路径上调用
+ * 成功返回 KEYFRAME_INDEX_FROM_SCAN，失败或者 *abort_request 变成非 0 时返回 -1
+ */
+static inline int keyframe_index_build_scan(KeyframeIndex *idx, const char *filename, int stream_index,
+                                            AVRational time_base, int use_probe_cache,
+                                            const int *abort_request) {
+    int64_t stream_end = AV_NOPTS_VALUE;
+    struct stat file_stat;
+
+    memset(idx, 0, sizeof(KeyframeIndex));
+    idx->stream_index = stream_index;
+    idx->time_base = time_base;
+    if (keyframe_index_scan(idx, filename, &stream_end, use_probe_cache, abort_request) < 0 ||
+        idx->nb_entries == 0) {
+        keyframe_index_free(idx);
+        return -1;
+    }
+    keyframe_index_finish(idx, stream_end);
+
+    if (stat(filename, &file_stat) == 0)
+        keyframe_index_save(idx, filename, &file_stat);
+    return KEYFRAME_INDEX_FROM_SCAN;
+}
+
+#endif //SFFPLAY_KEYFRAME_INDEX_H
@@ -0,0 +1,141 @@
+/**
+ * 播放器各阶段耗时的直方图，C 和 C++ 都可以包含
+ *
+ * 每个直方图只由一个线程写（解码线程或者渲染线程），所以记录一个样本不需要加锁，
+ * 也不需要原子的读-改-写：写线程自己读出计数加一再 SDL_AtomicSet 回去，别的线程随时可以读。
+ * 导出时各个桶不是同一时刻的快照，最多差正在记录的那一两个样本，用来看分布足够了。
+ *
+ * 桶按对数划分：每个 2 倍区间分成 LATENCY_HIST_STEPS 个桶，
+ * 第 i 个桶是 [2^(i/STEPS), 2^((i+1)/STEPS)) 微秒，不到 1 微秒的算进第 0 个桶，
+ * 超出范围的算进最后一个桶。百分位取所在桶的上界，误差不超过 2^(1/STEPS) 倍（约 19%）。
+ */
+
+#ifndef SFFPLAY_LATENCY_HISTOGRAM_H
+#define SFFPLAY_LATENCY_HISTOGRAM_H
+
+#include <SDL.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+
+#define LATENCY_HIST_STEPS 4
+// 4 * 25 个桶，最大到 2^25 微秒，约 33 秒
+#define LATENCY_HIST_BUCKETS 100
+
+typedef struct LatencyHistogram {
+    const char *name;
+    SDL_atomic_t count;
+    SDL_atomic_t max_us;
+    SDL_atomic_t buckets[LATENCY_HIST_BUCKETS];
+} LatencyHistogram;
+
+static inline void latency_histogram_init(LatencyHistogram *h, const char *name) {
+    int i;
+    h->name = name;
+    SDL_AtomicSet(&h->count, 0);
+    SDL_AtomicSet(&h->max_us, 0);
+    for (i = 0; i < LATENCY_HIST_BUCKETS; i++)
+        SDL_AtomicSet(&h->buckets[i], 0);
+}
+
+// 记录一个样本，单位秒，负数按绝对值记录；只能由这个直方图的写线程调用
+static inline void latency_histogram_add(LatencyHistogram *h, double seconds) {
+    double us = fabs(seconds) * 1e6;
+    int i = us < 1 ? 0 : (int) (LATENCY_HIST_STEPS * log2(us));
+    int v = us >= INT_MAX ? INT_MAX : (int) us;
+
+    if (i >= LATENCY_HIST_BUCKETS)
+        i = LATENCY_HIST_BUCKETS - 1;
+    SDL_AtomicSet(&h->buckets[i], SDL_AtomicGet(&h->buckets[i]) + 1);
+    if (v > SDL_AtomicGet(&h->max_us))
+        SDL_AtomicSet(&h->max_us, v);
+    SDL_AtomicSet(&h->count, SDL_AtomicGet(&h->count) + 1);
+}
+
+// 第 i 个桶的下界，单位毫秒，第 0 个桶从 0 开始
+static inline double latency_histogram_bucket_low(int i) {
+    return i == 0 ? 0 : pow(2, (double) i / LATENCY_HIST_STEPS) / 1000;
+}
+
+static inline double latency_histogram_bucket_high(int i) {
+    return pow(2, (double) (i + 1) / LATENCY_HIST_STEPS) / 1000;
+}
+
+// 百分位 p（0 到 1），单位毫秒，没有样本时返回 0
+static inline double latency_histogram_percentile(LatencyHistogram *h, double p) {
+    int64_t total = 0, seen = 0;
+    int i;
+
+    for (i = 0; i < LATENCY_HIST_BUCKETS; i++)
+        total += SDL_AtomicGet(&h->buckets[i]);
+    if (total == 0)
+        return 0;
+    for (i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += SDL_AtomicGet(&h->buckets[i]);
+        if (seen >= p * total)
+            break;
+    }
+    if (i == LATENCY_HIST_BUCKETS)
+        i--;
+    // 上界不会超过实际的最大值
+    return fmin(latency_histogram_bucket_high(i), SDL_AtomicGet(&h->max_us) / 1000.0);
+}
+
+// 打印一行：样本数、p50/p90/p99 和最大值
+static inline void latency_histogram_print(LatencyHistogram *h) {
+    printf("  %-13s n=%-7d p50=%.3f p90=%.3f p99=%.3f max=%.3f ms\n", h->name, SDL_AtomicGet(&h->count),
+           latency_histogram_percentile(h, 0.5), latency_histogram_percentile(h, 0.9),
+           latency_histogram_percentile(h, 0.99), SDL_AtomicGet(&h->max_us) / 1000.0);
+}
+
+// CSV 的表头，和 latency_histogram_write_csv 的列对应
+static inline void latency_histogram_csv_header(FILE *fp) {
+    fprintf(fp, "file,time_s,stage,bucket_low_ms,bucket_high_ms,count\n");
+}
+
+/**
+ * 写一个加双引号的字符串，文件名里可能有逗号和引号
+ * CSV 里的引号写两次，JSON 里的引号和反斜杠前面加反斜杠
+ */
+static inline void latency_histogram_write_string(FILE *fp, const char *s, int json) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"')
+            fputc(json ? '\\' : '"', fp);
+        else if (*s == '\\' && json)
+            fputc('\\', fp);
+        fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+// 每个非空的桶一行，time_s 用来区分同一次播放中的多次导出
+static inline void latency_histogram_write_csv(LatencyHistogram *h, FILE *fp, const char *file, double time_s) {
+    int i, n;
+    for (i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        if ((n = SDL_AtomicGet(&h->buckets[i])) == 0)
+            continue;
+        latency_histogram_write_string(fp, file, 0);
+        fprintf(fp, ",%.3f,%s,%.6f,%.6f,%d\n", time_s, h->name,
+                latency_histogram_bucket_low(i), latency_histogram_bucket_high(i), n);
+    }
+}
+
+// 写一个 JSON 对象：统计值和非空的桶，桶是 [下界, 上界, 计数] 的数组
+static inline void latency_histogram_write_json(LatencyHistogram *h, FILE *fp) {
+    int i, n, first = 1;
+    fprintf(fp, "{\"stage\":\"%s\",\"count\":%d,\"p50_ms\":%.6f,\"p90_ms\":%.6f,\"p99_ms\":%.6f,"
+                "\"max_ms\":%.6f,\"buckets\":[", h->name, SDL_AtomicGet(&h->count),
+            latency_histogram_percentile(h, 0.5), latency_histogram_percentile(h, 0.9),
+            latency_histogram_percentile(h, 0.99), SDL_AtomicGet(&h->max_us) / 1000.0);
+    for (i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        if ((n = SDL_AtomicGet(&h->buckets[i])) == 0)
+            continue;
+        fprintf(fp, "%s[%.6f,%.6f,%d]", first ? "" : ",",
+                latency_histogram_bucket_low(i), latency_histogram_bucket_high(i), n);
+        first = 0;
+    }
+    fprintf(fp, "]}");
+}
+
+#endif //SFFPLAY_LATENCY_HISTOGRAM_H
@@ -0,0 +1,325 @@
+/**
+ * 播放器共用的 AVPacket 队列，C 和 C++ 都可以包含
+ *
+ * 解复用线程只 put、解码线程只 get，所以实现成单生产者单消费者的环形队列：
+ * 每个槽位在 packet_queue_init 时用 av_packet_alloc 预先分配好，
+ * put/get 只是 av_packet_move_ref 加上一次读写下标的原子更新，不加锁也不分配内存。
+ * 只有队列空（消费者）或者满（生产者）时才需要等待，这时退回到 mutex + cond：
+ * 等待方先置 *_waiting 再检查一次队列，唤醒方更新下标后看到 *_waiting 才去加锁 signal，
+ * SDL_AtomicSet/SDL_AtomicGet 都是顺序一致的，不会丢失唤醒。
+ *
+ * 队列中 packet 的总字节数和总时长（pkt->duration，单位是所属流的 time_base）
+ * 分别由生产者和消费者各自累加、相减得到，任何线程都可以读取。
+ * 时长按 int64_t 累加，1/90000、1/1000000 这样的 time_base 下也不会回绕；
+ * 64 位的值在 32 位平台上不能原子读写，累计时长各自用一个 seqlock（seqlock.h）发布。
+ *
+ * 回压：packet_queue_set_limits 设置字节数和时长上限，解复用线程读下一个 packet 之前
+ * 调用 packet_queue_wait_space，超过上限时在 not_full 上睡眠，
+ * 消费者每取走一个 packet 都会检查 producer_waiting，降到上限以下的那一刻就被唤醒，不需要轮询。
+ *
+ * serial：seek 之后生产者调用 packet_queue_start_serial 把 serial 加一，
+ * 之后放入的 packet 都带上新的 serial。生产者不能清空队列，seek 之前的旧 packet
+ * 由消费者用 packet_queue_get_serial 取出时和当前 serial 比较后丢掉。
+ *
+ * 每个 packet 放入时记下 SDL_GetPerformanceCounter，packet_queue_get_timed 取出时
+ * 返回它在队列里待了多少秒，用来统计各阶段的耗时。
+ */
+
+#ifndef SFFPLAY_PACKET_QUEUE_H
+#define SFFPLAY_PACKET_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+#include <libavcodec/avcodec.h>
+#ifdef __cplusplus
+}
+#endif
+
+#include <SDL.h>
+#include <string.h>
+
+#include "seqlock.h"
+
+// 队列能容纳的 packet 数，必须是 2 的幂，可以在包含头文件之前重新定义
+#ifndef PACKET_QUEUE_CAPACITY
+#define PACKET_QUEUE_CAPACITY 1024
+#endif
+
+typedef struct PacketQueue {
+    AVPacket *slots[PACKET_QUEUE_CAPACITY];
+    int serials[PACKET_QUEUE_CAPACITY];
+    Uint64 put_ticks[PACKET_QUEUE_CAPACITY];
+    // 读写下标单调递增（按 unsigned 回绕），windex 只由生产者写，rindex 只由消费者写
+    SDL_atomic_t windex;
+    SDL_atomic_t rindex;
+
+    // 累计放入 / 取出的字节数，按 unsigned 回绕，相减就是队列中的总字节数
+    SDL_atomic_t put_bytes, get_bytes;
+    // 累计放入 / 取出的时长，put_duration 只由生产者写，get_duration 只由消费者写
+    SeqLock put_duration_seq, get_duration_seq;
+    int64_t put_duration, get_duration;
+
+    // 置 1 后 packet_queue_get/put 立刻返回 -1，阻塞中的线程也会被唤醒
+    SDL_atomic_t abort_request;
+    // 生产者已经放完所有 packet，队列取空后 packet_queue_get 返回 -1
+    SDL_atomic_t finished;
+    // 只由生产者修改
+    SDL_atomic_t serial;
+
+    // 回压上限，0 表示不限制；max_duration 的单位是所属流的 time_base
+    int max_bytes;
+    int64_t max_duration;
+
+    SDL_atomic_t consumer_waiting;
+    SDL_atomic_t producer_waiting;
+    SDL_mutex *mutex;
+    SDL_cond *not_empty;
+    SDL_cond *not_full;
+} PacketQueue;
+
+static inline unsigned packet_queue_nb_packets(PacketQueue *q) {
+    return (unsigned) SDL_AtomicGet(&q->windex) - (unsigned) SDL_AtomicGet(&q->rindex);
+}
+
+// 队列中所有 packet 的字节数
+static inline int packet_queue_size(PacketQueue *q) {
+    return (int) ((unsigned) SDL_AtomicGet(&q->put_bytes) -
+                  (unsigned) SDL_AtomicGet(&q->get_bytes));
+}
+
+// 只能由 total 的写者调用
+static inline void packet_queue_add_duration(SeqLock *seq, int64_t *total, int64_t duration) {
+    seqlock_write_begin(seq);
+    *total += duration;
+    seqlock_write_end(seq);
+}
+
+// 任何线程都可以调用，碰上写者正在更新时重读
+static inline int64_t packet_queue_read_duration(SeqLock *seq, const int64_t *total) {
+    int64_t value;
+    int start;
+    do {
+        start = seqlock_read_begin(seq);
+        value = *total;
+    } while (!seqlock_read_valid(seq, start));
+    return value;
+}
+
+// 队列中所有 packet 的时长，单位是所属流的 time_base
+static inline int64_t packet_queue_duration(PacketQueue *q) {
+    return packet_queue_read_duration(&q->put_duration_seq, &q->put_duration) -
+           packet_queue_read_duration(&q->get_duration_seq, &q->get_duration);
+}
+
+// 设置回压上限，在生产者开始放入 packet 之前调用
+static inline void packet_queue_set_limits(PacketQueue *q, int max_bytes, int64_t max_duration) {
+    q->max_bytes = max_bytes;
+    q->max_duration = max_duration;
+}
+
+// 队列中的 packet 已经达到字节数或者时长上限
+static inline int packet_queue_over_limit(PacketQueue *q) {
+    return (q->max_bytes > 0 && packet_queue_size(q) >= q->max_bytes) ||
+           (q->max_duration > 0 && packet_queue_duration(q) >= q->max_duration);
+}
+
+static inline void packet_queue_wake(PacketQueue *q, SDL_atomic_t *waiting, SDL_cond *cond) {
+    if (SDL_AtomicGet(waiting)) {
+        SDL_LockMutex(q->mutex);
+        SDL_CondSignal(cond);
+        SDL_UnlockMutex(q->mutex);
+    }
+}
+
+//// 初始化队列
+static inline int packet_queue_init(PacketQueue *q) {
+    int i;
+    memset(q, 0, sizeof(PacketQueue));
+    for (i = 0; i < PACKET_QUEUE_CAPACITY; i++) {
+        q->slots[i] = av_packet_alloc();
+        if (!q->slots[i])
+            return -1;
+    }
+    q->mutex = SDL_CreateMutex();
+    q->not_empty = SDL_CreateCond();
+    q->not_full = SDL_CreateCond();
+    if (!q->mutex || !q->not_empty || !q->not_full)
+        return -1;
+    return 0;
+}
+
+/**
+ * 放入 packet，pkt 的引用转移到队列中，调用之后 pkt 被重置为空，可以直接复用
+ * 队列满时阻塞，abort 之后返回 -1
+ */
+static inline int packet_queue_put(PacketQueue *q, AVPacket *pkt) {
+    unsigned w = (unsigned) SDL_AtomicGet(&q->windex);
+    AVPacket *slot;
+
+    if (av_packet_make_refcounted(pkt) < 0) {
+        return -1;
+    }
+
+    while (w - (unsigned) SDL_AtomicGet(&q->rindex) >= PACKET_QUEUE_CAPACITY) {
+        if (SDL_AtomicGet(&q->abort_request)) {
+            av_packet_unref(pkt);
+            return -1;
+        }
+        SDL_LockMutex(q->mutex);
+        SDL_AtomicSet(&q->producer_waiting, 1);
+        if (w - (unsigned) SDL_AtomicGet(&q->rindex) >= PACKET_QUEUE_CAPACITY &&
+            !SDL_AtomicGet(&q->abort_request)) {
+            SDL_CondWait(q->not_full, q->mutex);
+        }
+        SDL_AtomicSet(&q->producer_waiting, 0);
+        SDL_UnlockMutex(q->mutex);
+    }
+
+    slot = q->slots[w & (PACKET_QUEUE_CAPACITY - 1)];
+    av_packet_move_ref(slot, pkt);
+    q->serials[w & (PACKET_QUEUE_CAPACITY - 1)] = SDL_AtomicGet(&q->serial);
+    q->put_ticks[w & (PACKET_QUEUE_CAPACITY - 1)] = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&q->put_bytes, (int) ((unsigned) SDL_AtomicGet(&q->put_bytes) + slot->size));
+    packet_queue_add_duration(&q->put_duration_seq, &q->put_duration, slot->duration);
+    // 先写好槽位再发布下标，消费者看到新的 windex 时槽位里一定是完整的 packet
+    SDL_AtomicSet(&q->windex, (int) (w + 1));
+
+    packet_queue_wake(q, &q->consumer_waiting, q->not_empty);
+    return 0;
+}
+
+/**
+ * 等到队列降到回压上限以下，返回 0；abort 之后返回 -1
+ * 只能在生产者线程调用，和 packet_queue_put 队列满时一样在 not_full 上等待
+ */
+static inline int packet_queue_wait_space(PacketQueue *q) {
+    while (packet_queue_over_limit(q)) {
+        if (SDL_AtomicGet(&q->abort_request))
+            return -1;
+        SDL_LockMutex(q->mutex);
+        SDL_AtomicSet(&q->producer_waiting, 1);
+        if (packet_queue_over_limit(q) && !SDL_AtomicGet(&q->abort_request)) {
+            SDL_CondWait(q->not_full, q->mutex);
+        }
+        SDL_AtomicSet(&q->producer_waiting, 0);
+        SDL_UnlockMutex(q->mutex);
+    }
+    return SDL_AtomicGet(&q->abort_request) ? -1 : 0;
+}
+
+/**
+ * 取出 packet，serial 不为 NULL 时返回 packet 放入时的 serial，queued 不为 NULL 时返回它在队列里待的秒数
+ * 返回 1 表示取到，0 表示非阻塞模式下队列为空，-1 表示 abort 或者已经取完
+ */
+static inline int packet_queue_get_timed(PacketQueue *q, AVPacket *pkt, int block, int *serial, double *queued) {
+    unsigned r = (unsigned) SDL_AtomicGet(&q->rindex);
+    AVPacket *slot;
+
+    for (;;) {
+        if (SDL_AtomicGet(&q->abort_request))
+            return -1;
+        if ((unsigned) SDL_AtomicGet(&q->windex) != r)
+            break;
+        if (SDL_AtomicGet(&q->finished)) {
+            // finished 之后再确认一次，避免漏掉生产者最后放入的 packet
+            if ((unsigned) SDL_AtomicGet(&q->windex) != r)
+                break;
+            return -1;
+        }
+        if (!block)
+            return 0;
+
+        SDL_LockMutex(q->mutex);
+        SDL_AtomicSet(&q->consumer_waiting, 1);
+        if ((unsigned) SDL_AtomicGet(&q->windex) == r &&
+            !SDL_AtomicGet(&q->abort_request) && !SDL_AtomicGet(&q->finished)) {
+            SDL_CondWait(q->not_empty, q->mutex);
+        }
+        SDL_AtomicSet(&q->consumer_waiting, 0);
+        SDL_UnlockMutex(q->mutex);
+    }
+
+    slot = q->slots[r & (PACKET_QUEUE_CAPACITY - 1)];
+    if (serial)
+        *serial = q->serials[r & (PACKET_QUEUE_CAPACITY - 1)];
+    if (queued)
+        *queued = (double) (SDL_GetPerformanceCounter() - q->put_ticks[r & (PACKET_QUEUE_CAPACITY - 1)]) /
+                  (double) SDL_GetPerformanceFrequency();
+    SDL_AtomicSet(&q->get_bytes, (int) ((unsigned) SDL_AtomicGet(&q->get_bytes) + slot->size));
+    packet_queue_add_duration(&q->get_duration_seq, &q->get_duration, slot->duration);
+    av_packet_move_ref(pkt, slot);
+    // 槽位已经搬空，发布 rindex 之后生产者才可以重新写入
+    SDL_AtomicSet(&q->rindex, (int) (r + 1));
+
+    packet_queue_wake(q, &q->producer_waiting, q->not_full);
+    return 1;
+}
+
+static inline int packet_queue_get_serial(PacketQueue *q, AVPacket *pkt, int block, int *serial) {
+    return packet_queue_get_timed(q, pkt, block, serial, NULL);
+}
+
+static inline int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block) {
+    return packet_queue_get_serial(q, pkt, block, NULL);
+}
+
+static inline int packet_queue_serial(PacketQueue *q) {
+    return SDL_AtomicGet(&q->serial);
+}
+
+/**
+ * seek 之后由生产者调用，之后放入的 packet 属于新的 serial；
+ * 同时清掉 finished，读到文件末尾之后还可以 seek 回去继续放
+ */
+static inline void packet_queue_start_serial(PacketQueue *q) {
+    SDL_AtomicAdd(&q->serial, 1);
+    SDL_AtomicSet(&q->finished, 0);
+}
+
+/**
+ * 丢弃队列中的所有 packet
+ * 只能在消费者线程调用，或者生产者已经停止之后调用
+ */
+static inline void packet_queue_flush(PacketQueue *q) {
+    unsigned r = (unsigned) SDL_AtomicGet(&q->rindex);
+    unsigned w = (unsigned) SDL_AtomicGet(&q->windex);
+    AVPacket *slot;
+
+    for (; r != w; r++) {
+        slot = q->slots[r & (PACKET_QUEUE_CAPACITY - 1)];
+        SDL_AtomicSet(&q->get_bytes, (int) ((unsigned) SDL_AtomicGet(&q->get_bytes) + slot->size));
+        packet_queue_add_duration(&q->get_duration_seq, &q->get_duration, slot->duration);
+        av_packet_unref(slot);
+    }
+    SDL_AtomicSet(&q->rindex, (int) r);
+    packet_queue_wake(q, &q->producer_waiting, q->not_full);
+}
+
+static inline void packet_queue_abort(PacketQueue *q) {
+    SDL_AtomicSet(&q->abort_request, 1);
+    SDL_LockMutex(q->mutex);
+    SDL_CondSignal(q->not_empty);
+    SDL_CondSignal(q->not_full);
+    SDL_UnlockMutex(q->mutex);
+}
+
+static inline void packet_queue_finish(PacketQueue *q) {
+    SDL_AtomicSet(&q->finished, 1);
+    SDL_LockMutex(q->mutex);
+    SDL_CondSignal(q->not_empty);
+    SDL_UnlockMutex(q->mutex);
+}
+
+static inline void packet_queue_destroy(PacketQueue *q) {
+    int i;
+    packet_queue_flush(q);
+    for (i = 0; i < PACKET_QUEUE_CAPACITY; i++) {
+        av_packet_free(&q->slots[i]);
+    }
+    SDL_DestroyMutex(q->mutex);
+    SDL_DestroyCond(q->not_empty);
+    SDL_DestroyCond(q->not_full);
+}
+
+#endif //SFFPLAY_PACKET_QUEUE_H
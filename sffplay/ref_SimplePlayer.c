@@ -10,9 +10,17 @@
 #include <libavutil/time.h>
 #include <libswresample/swresample.h>
 
+#include "audio_ring.h"
+#include "packet_queue.h"
+#include "probe_cache.h"
+#include "seqlock.h"
+
 #define SDL_AUDIO_BUFFER_SIZE 1024
 #define MAX_AUDIO_FRAME_SIZE 192000 //channels(2) * data_size(2) * sample_rate(48000)
 
+// 解码线程和音频回调之间环形缓冲区的字节数，48kHz 双声道 S16 时大约 340ms
+#define AUDIO_RING_SIZE (64 * 1024)
+
 #define MAX_AUDIOQ_SIZE (5 * 16 * 1024)
 #define MAX_VIDEOQ_SIZE (5 * 256 * 1024)
 
@@ -25,15 +33,6 @@
 #define VIDEO_PICTURE_QUEUE_SIZE 1
 
 
-typedef struct PacketQueue {
-    AVPacketList *first_pkt, *last_pkt;
-    int nb_packets;
-    int size;
-    SDL_mutex *mutex;
-    SDL_cond *cond;
-} PacketQueue;
-
-
 typedef struct VideoPicture {
     AVFrame *frame;
     int width, height; /* source height & width */
@@ -45,7 +44,7 @@ typedef struct VideoState {
     AVFormatContext *pFormatCtx;
     int videoStream, audioStream;
 
-    double audio_clock;
+    double audio_clock; ///<pts after the last sample written to audio_ring, only used by the audio decode thread
     double frame_timer;
     double frame_last_pts;
     double frame_last_delay;
@@ -58,16 +57,22 @@ typedef struct VideoState {
     AVStream *audio_st;
     AVCodecContext *audio_ctx, typo;
     PacketQueue audioq;
-    uint8_t audio_buf[(MAX_AUDIO_FRAME_SIZE * 3) / 2];
-    unsigned int audio_buf_size;
-    unsigned int audio_buf_index;
-    AVFrame audio_frame;
-
-    AVPacket audio_pkt;
-    uint8_t *audio_pkt_data;
-    int audio_pkt_size;
+    // 解码线程写入重采样后的 S16 双声道数据，audio_callback 只从这里拷贝
+    AudioRing audio_ring;
+    /**
+     * 解码线程每写进 audio_ring 一段就发布一次：写到 audio_ring_windex 字节处时的 pts，
+     * 两个值通过 audio_ring_seq 一起发布，视频线程读到的 pts 和下标总是同一次写入的
+     */
+    SeqLock audio_ring_seq;
+    double audio_ring_pts;
+    unsigned int audio_ring_windex;
+    // 解码线程等 audio_ring 腾出空间时睡在 audio_ring_sem 上，睡之前把 audio_ring_waiting 置 1，回调读完之后叫醒它
+    SDL_sem *audio_ring_sem;
+    SDL_atomic_t audio_ring_waiting;
     int audio_hw_buf_size;
     struct SwrContext *audio_swr_ctx;
+    // 回调时环形缓冲区数据不够、补了静音的次数
+    SDL_atomic_t audio_underruns;
 
     //video
     AVStream *video_st;
@@ -81,6 +86,7 @@ typedef struct VideoState {
 
     SDL_Thread *parse_tid;
     SDL_Thread *video_tid;
+    SDL_Thread *audio_tid;
 
     int quit;
 } VideoState;
@@ -102,188 +108,137 @@ static int resize = 1;
    can be global in case we need it. */
 VideoState *global_video_state;
 
-//// 初始化队列
-void packet_queue_init(PacketQueue *q) {
-    memset(q, 0, sizeof(PacketQueue));
-    q->mutex = SDL_CreateMutex();
-    q->cond = SDL_CreateCond();
-}
-
-int packet_queue_put(PacketQueue *q, AVPacket *pkt) {
-
-    AVPacketList *pkt1;
-    if (av_packet_make_refcounted(pkt) < 0) {
-        return -1;
-    }
-    pkt1 = av_malloc(sizeof(AVPacketList));
-    if (!pkt1)
-        return -1;
-    pkt1->pkt = *pkt;
-    pkt1->next = NULL;
-
-    SDL_LockMutex(q->mutex);
-
-    if (!q->last_pkt)
-        q->first_pkt = pkt1;
-    else
-        q->last_pkt->next = pkt1;
-    q->last_pkt = pkt1;
-    q->nb_packets++;
-    q->size += pkt1->pkt.size;
-    SDL_CondSignal(q->cond);
-
-    SDL_UnlockMutex(q->mutex);
-    return 0;
-}
-
-int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block) {
-    AVPacketList *pkt1;
-    int ret;
-
-    SDL_LockMutex(q->mutex);
-
-    for (;;) {
-
-        if (global_video_state->quit) {
-            ret = -1;
-            break;
-        }
-
-        pkt1 = q->first_pkt;
-        if (pkt1) {
-            q->first_pkt = pkt1->next;
-            if (!q->first_pkt)
-                q->last_pkt = NULL;
-            q->nb_packets--;
-            q->size -= pkt1->pkt.size;
-            *pkt = pkt1->pkt;
-            av_free(pkt1);
-            ret = 1;
-            break;
-        } else if (!block) {
-            ret = 0;
-            break;
-        } else {
-            SDL_CondWait(q->cond, q->mutex);
-        }
-    }
-    SDL_UnlockMutex(q->mutex);
-    return ret;
+// 每秒钟音频播放的字节数，重采样输出的是双声道 S16
+static int audio_bytes_per_sec(VideoState *is) {
+    return is->audio_st ? is->audio_ctx->sample_rate * 2 * 2 : 0;
 }
 
 double get_audio_clock(VideoState *is) {
     double pts;
-    int hw_buf_size, bytes_per_sec, n;
-
-    //上一步获取的PTS
-    pts = is->audio_clock;
-    // 音频缓冲区还没有播放的数据
-    hw_buf_size = is->audio_buf_size - is->audio_buf_index;
-    // 每秒钟音频播放的字节数
-    bytes_per_sec = 0;
-    n = is->audio_ctx->channels * 2;
-    if (is->audio_st) {
-        bytes_per_sec = is->audio_ctx->sample_rate * n;
-    }
+    unsigned int windex;
+    int bytes_per_sec, unplayed, seq;
+
+    // 解码线程发布的 pts 和对应的写下标，碰上正在发布时重读
+    do {
+        seq = seqlock_read_begin(&is->audio_ring_seq);
+        pts = is->audio_ring_pts;
+        windex = is->audio_ring_windex;
+    } while (!seqlock_read_valid(&is->audio_ring_seq, seq));
+    /**
+     * 减去环形缓冲区中到 windex 为止还没有播放的数据
+     * 解码线程可能又写了一段还没发布，回调读过了 windex 时差值是负数
+     */
+    unplayed = (int) (windex - (unsigned) SDL_AtomicGet(&is->audio_ring.rindex));
+    bytes_per_sec = audio_bytes_per_sec(is);
     if (bytes_per_sec) {
-        pts -= (double) hw_buf_size / bytes_per_sec;
+        pts -= (double) unplayed / bytes_per_sec;
     }
     return pts;
 }
 
-//// 音频帧解码
-int audio_decode_frame(VideoState *is, uint8_t *audio_buf, int buf_size, double *pts_ptr) {
-
-    int len1, data_size = 0;
-    AVPacket *pkt = &is->audio_pkt;
-    double pts;
-    int n;
-
-
-    for (;;) {
-        while (is->audio_pkt_size > 0) {
-            avcodec_send_packet(is->audio_ctx, pkt);
-            while (avcodec_receive_frame(is->audio_ctx, &is->audio_frame) == 0) {
-                len1 = is->audio_frame.pkt_size;
-
-                if (len1 < 0) {
-                    /* if error, skip frame */
-                    is->audio_pkt_size = 0;
-                    break;
-                }
-
-                data_size = 2 * is->audio_frame.nb_samples * 2;
-                assert(data_size <= buf_size);
-
-                swr_convert(is->audio_swr_ctx,
-                            &audio_buf,
-                            MAX_AUDIO_FRAME_SIZE * 3 / 2,
-                            (const uint8_t **) is->audio_frame.data,
-                            is->audio_frame.nb_samples);
-
-            }
-            is->audio_pkt_data += len1;
-            is->audio_pkt_size -= len1;
-            if (data_size <= 0) {
-                /* No data yet, get more frames */
-                continue;
-            }
-            pts = is->audio_clock;
-            *pts_ptr = pts;
-            n = 2 * is->audio_ctx->channels;
-            is->audio_clock += (double) data_size /
-                               (double) (n * is->audio_ctx->sample_rate);
-            /* We have data, return it and come back for more later */
-            return data_size;
-        }
-        if (pkt->data)
-            av_packet_unref(pkt);
-
+/**
+ * 把重采样后的数据全部写进环形缓冲区，end_pts 是这段数据最后一个采样之后的 pts
+ * 每写进一段就发布一次当时的写下标和 pts，视频线程读到的时钟不会因为写了一半而往回跳
+ * 满了说明已经缓存了足够多的音频，睡到回调取走一些再写，音频回调不会因此等待
+ */
+static int audio_ring_write_all(VideoState *is, const uint8_t *data, unsigned int len, double end_pts) {
+    unsigned int written;
+    int bytes_per_sec = audio_bytes_per_sec(is);
+    while (len > 0) {
         if (is->quit) {
             return -1;
         }
-        /* next packet */
+        // 先置 1 再看有没有空间，回调在这之后读走的数据一定会叫醒我们
+        SDL_AtomicSet(&is->audio_ring_waiting, 1);
+        written = audio_ring_write(&is->audio_ring, data, len);
+        if (written == 0) {
+            SDL_SemWait(is->audio_ring_sem);
+            continue;
+        }
+        data += written;
+        len -= written;
+        seqlock_write_begin(&is->audio_ring_seq);
+        is->audio_ring_pts = end_pts - (double) len / bytes_per_sec;
+        is->audio_ring_windex = (unsigned) SDL_AtomicGet(&is->audio_ring.windex);
+        seqlock_write_end(&is->audio_ring_seq);
+    }
+    SDL_AtomicSet(&is->audio_ring_waiting, 0);
+    return 0;
+}
+
+//// 音频解码线程，解码、重采样之后写入 audio_ring
+int decode_audio_thread(void *arg) {
+    VideoState *is = (VideoState *) arg;
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    uint8_t *out_buf = NULL;
+    unsigned int out_buf_size = 0;
+    int out_samples, data_size, ret;
+    double frame_end;
+
+    while (pkt && frame && !is->quit) {
         if (packet_queue_get(&is->audioq, pkt, 1) < 0) {
-            return -1;
+            break;
         }
-        is->audio_pkt_data = pkt->data;
-        is->audio_pkt_size = pkt->size;
-        /* if update, update the audio clock w/pts */
-        if (pkt->pts != AV_NOPTS_VALUE) {
-            is->audio_clock = av_q2d(is->audio_st->time_base) * pkt->pts;
+        ret = avcodec_send_packet(is->audio_ctx, pkt);
+        av_packet_unref(pkt);
+        if (ret < 0) {
+            /* if error, skip packet */
+            continue;
+        }
+        while (avcodec_receive_frame(is->audio_ctx, frame) == 0) {
+            out_samples = swr_get_out_samples(is->audio_swr_ctx, frame->nb_samples);
+            av_fast_malloc(&out_buf, &out_buf_size, out_samples * 2 * 2);
+            if (!out_buf) {
+                goto end;
+            }
+            out_samples = swr_convert(is->audio_swr_ctx,
+                                      &out_buf,
+                                      out_samples,
+                                      (const uint8_t **) frame->extended_data,
+                                      frame->nb_samples);
+            /* if update, update the audio clock w/pts */
+            if (frame->best_effort_timestamp != AV_NOPTS_VALUE) {
+                frame_end = av_q2d(is->audio_st->time_base) * frame->best_effort_timestamp;
+            } else {
+                frame_end = is->audio_clock;
+            }
+            frame_end += (double) frame->nb_samples / is->audio_ctx->sample_rate;
+            av_frame_unref(frame);
+            if (out_samples <= 0) {
+                continue;
+            }
+
+            data_size = out_samples * 2 * 2;
+            if (audio_ring_write_all(is, out_buf, data_size, frame_end) < 0) {
+                goto end;
+            }
+            is->audio_clock = frame_end;
         }
     }
+
+    end:
+    av_freep(&out_buf);
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    return 0;
 }
 
-//// 音频设备回调
+//// 音频设备回调，只从环形缓冲区拷贝数据，不加锁、不解码、不阻塞
 void audio_callback(void *userdata, Uint8 *stream, int len) {
 
     VideoState *is = (VideoState *) userdata;
-    int len1, audio_size;
-    double pts;
+    unsigned int len1;
 
-    SDL_memset(stream, 0, len);
-
-    while (len > 0) {
-        if (is->audio_buf_index >= is->audio_buf_size) {
-            // 音频解码
-            audio_size = audio_decode_frame(is, is->audio_buf, sizeof(is->audio_buf), &pts);
-            if (audio_size < 0) {
-                // 音频解码错误，播放静音
-                is->audio_buf_size = 1024 * 2 * 2;
-                memset(is->audio_buf, 0, is->audio_buf_size);
-            } else {
-                is->audio_buf_size = audio_size;
-            }
-            is->audio_buf_index = 0;
-        }
-        len1 = is->audio_buf_size - is->audio_buf_index;
-        if (len1 > len)
-            len1 = len;
-        SDL_MixAudio(stream, (uint8_t *) is->audio_buf + is->audio_buf_index, len1, SDL_MIX_MAXVOLUME);
-        len -= len1;
-        stream += len1;
-        is->audio_buf_index += len1;
+    len1 = audio_ring_read(&is->audio_ring, stream, len);
+    if (len1 < (unsigned int) len) {
+        // 解码线程没跟上，剩下的部分播放静音
+        SDL_memset(stream + len1, 0, len - len1);
+        SDL_AtomicAdd(&is->audio_underruns, 1);
+    }
+    // 解码线程在等空间，叫醒它，SDL_SemPost 不会阻塞
+    if (SDL_AtomicCAS(&is->audio_ring_waiting, 1, 0)) {
+        SDL_SemPost(is->audio_ring_sem);
     }
 }
 
@@ -568,10 +523,15 @@ int stream_component_open(VideoState *is, int stream_index) {
             is->audioStream = stream_index;
             is->audio_st = pFormatCtx->streams[stream_index];
             is->audio_ctx = codecCtx;
-            is->audio_buf_size = 0;
-
-            is->audio_buf_index = 0;
-            memset(&is->audio_pkt, 0, sizeof(is->audio_pkt));
+            if (audio_ring_init(&is->audio_ring, AUDIO_RING_SIZE) < 0) {
+                fprintf(stderr, "Could not allocate audio ring!\n");
+                return -1;
+            }
+            is->audio_ring_sem = SDL_CreateSemaphore(0);
+            if (!is->audio_ring_sem) {
+                fprintf(stderr, "SDL_CreateSemaphore: %s\n", SDL_GetError());
+                return -1;
+            }
             packet_queue_init(&is->audioq);
 
             //Out Audio Param
@@ -601,6 +561,9 @@ int stream_component_open(VideoState *is, int stream_index) {
             swr_init(audio_convert_ctx);
             is->audio_swr_ctx = audio_convert_ctx;
 
+            // 创建音频解码线程
+            is->audio_tid = SDL_CreateThread(decode_audio_thread, "decode_audio_thread", is);
+
             // 开始播放音频，audio_callback回调
             SDL_PauseAudio(0);
 
@@ -640,25 +603,26 @@ int demux_thread(void *arg) {
     int video_index = -1;
     int audio_index = -1;
     int i;
+    int probe_hit;
+    int64_t open_start;
 
     is->videoStream = -1;
     is->audioStream = -1;
 
     global_video_state = is;
 
-    /* open input file, and allocate format context */
-    if ((err_code = avformat_open_input(&pFormatCtx, is->filename, NULL, NULL)) < 0) {
+    /* open input file, allocate format context and retrieve stream information */
+    open_start = av_gettime_relative();
+    if ((err_code = probe_cache_open_input(&pFormatCtx, is->filename, NULL, 1, &probe_hit)) < 0) {
         av_strerror(err_code, errors, 1024);
         fprintf(stderr, "Could not open source file %s, %d(%s)\n", is->filename, err_code, errors);
         return -1;
     }
+    printf("open %s: %.1f ms, probe cache %s\n", is->filename,
+           (av_gettime_relative() - open_start) / 1000.0, probe_hit ? "hit" : "miss");
 
     is->pFormatCtx = pFormatCtx;
 
-    // Retrieve stream information
-    if (avformat_find_stream_info(pFormatCtx, NULL) < 0)
-        return -1; // Couldn't find stream information
-
     // Dump information about file onto standard error
     av_dump_format(pFormatCtx, 0, is->filename, 0);
 
@@ -694,8 +658,8 @@ int demux_thread(void *arg) {
             break;
         }
         // seek stuff goes here
-        if (is->audioq.size > MAX_AUDIOQ_SIZE ||
-            is->videoq.size > MAX_VIDEOQ_SIZE) {
+        if (packet_queue_size(&is->audioq) > MAX_AUDIOQ_SIZE ||
+            packet_queue_size(&is->videoq) > MAX_VIDEOQ_SIZE) {
             SDL_Delay(10);
             continue;
         }
@@ -782,10 +746,21 @@ int main(int argc, char *argv[]) {
             case FF_QUIT_EVENT:
             case SDL_QUIT: // 退出
                 is->quit = 1;
+                packet_queue_abort(&is->audioq);
+                packet_queue_abort(&is->videoq);
+                // 音频解码线程可能在等环形缓冲区腾出空间
+                if (is->audio_ring_sem) {
+                    SDL_SemPost(is->audio_ring_sem);
+                }
                 goto Destroy;
             case SDL_KEYDOWN:
                 if (event.key.keysym.sym == SDLK_q) {
                     is->quit = 1;
+                    packet_queue_abort(&is->audioq);
+                    packet_queue_abort(&is->videoq);
+                    if (is->audio_ring_sem) {
+                        SDL_SemPost(is->audio_ring_sem);
+                    }
                     goto Destroy;
                 }
                 break;
@@ -798,6 +773,7 @@ int main(int argc, char *argv[]) {
     }
 
     Destroy:
+    fprintf(stderr, "audio underruns: %d\n", SDL_AtomicGet(&is->audio_underruns));
     SDL_Quit();
     return 0;
 
@@ -0,0 +1,47 @@
+/**
+ * 单写者的序号锁（seqlock），C 和 C++ 都可以包含
+ *
+ * 写者改数据之前把序号加一变成奇数，改完再加一变回偶数；读者在读数据前后各读一次序号，
+ * 两次相同并且是偶数才说明读到的是一份完整的快照，否则重读或者放弃这次读取。
+ * 写者从不等待读者，读者也不会让写者等待，用来在 SDL 音频回调和其他线程之间发布几个要一起读的值，
+ * 或者发布 32 位平台上不能原子读写的 64 位计数。
+ * 同一个 SeqLock 只能有一个写者线程。
+ */
+
+#ifndef SFFPLAY_SEQLOCK_H
+#define SFFPLAY_SEQLOCK_H
+
+#include <SDL.h>
+
+typedef struct SeqLock {
+    SDL_atomic_t seq;
+} SeqLock;
+
+static inline void seqlock_write_begin(SeqLock *s) {
+    SDL_AtomicAdd(&s->seq, 1);
+    // 序号变成奇数之后才改数据
+    SDL_MemoryBarrierRelease();
+}
+
+static inline void seqlock_write_end(SeqLock *s) {
+    // 数据都改完之后序号才变回偶数
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicAdd(&s->seq, 1);
+}
+
+static inline int seqlock_read_begin(SeqLock *s) {
+    int seq = SDL_AtomicGet(&s->seq);
+    SDL_MemoryBarrierAcquire();
+    return seq;
+}
+
+/**
+ * 读完数据之后调用，seq 是 seqlock_read_begin 的返回值
+ * 返回 1 表示读到的是完整的快照，返回 0 表示读的时候写者正在改，读到的值不能用
+ */
+static inline int seqlock_read_valid(SeqLock *s, int seq) {
+    SDL_MemoryBarrierAcquire();
+    return (seq & 1) == 0 && SDL_AtomicGet(&s->seq) == seq;
+}
+
+#endif //SFFPLAY_SEQLOCK_H
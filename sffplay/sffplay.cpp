@@ -3,63 +3,148 @@
 //
 
 /**
- * 简单的视频播放器，只能解码播放视频，不能播放音频，没有倍速和快进快退
+ * 简单的视频播放器，没有倍速和快进快退
  * 读取packet后解码成frame，使用frame->data的YUV数据更新 texture
  *
- * 使用read_thread()读取文件解封装AVPacket，放入PacketQueue
- * 使用video_thread()从PacketQueue videoq队列拿AVPacket解码成AVFrame到添加到FrameQueue
- * TODO：
- * 播放音频
+ * 使用demux_thread()读取文件解封装AVPacket，放入PacketQueue
+ * 使用decode_video_thread()从PacketQueue videoq队列拿AVPacket解码成AVFrame到添加到FrameQueue
+ * 使用decode_audio_thread()从audioq取packet解码、重采样后写进 audio_ring（audio_ring.h），
+ * SDL 音频回调 audio_callback() 只从 audio_ring 拷贝数据并更新音频时钟，视频以音频时钟为准同步
+ * 主线程只负责渲染：按每一帧的 pts 算出显示时刻，到点后从FrameQueue取一帧显示，
+ * 已经错过显示时刻的帧在上传纹理之前直接丢掉
+ * 三个阶段由队列连接，解码可以领先显示 VIDEO_PICTURE_QUEUE_SIZE 帧，
+ * 某一帧解码慢时由队列中缓存的帧顶上，不会卡住画面
+ *
+ * 左右方向键后退、前进 10 秒，下上方向键后退、前进 60 秒：
+ * 用关键帧索引找到目标之前最近的关键帧，seek 过去之后解码到目标时间再显示，
+ * 文件没有现成的索引时第一次 seek 才在后台扫描建立，扫完之前按时间戳 seek，
+ * 队列中 seek 之前的 packet 和帧靠 serial 区分后丢掉
+ * ] 和 [ 在 1x、2x ... 64x 之间切换快放速度：快放时只解码关键帧，
+ * 解复用线程直接丢掉非关键帧的 packet 和音频，解码器也设置 skip_frame = AVDISCARD_NONKEY，
+ * 关键帧比原始帧率还密时再隔几个取一个，每秒解码的帧数不超过 1x 播放
+ *
+ * 解码跟不上时（比如 88.mp4 这种 4K H.264）解码线程逐级降低解码质量：
+ * 1 级跳过环路滤波，2 级再对非参考帧跳过 IDCT，3 级直接不解码非参考帧，
+ * 追上之后再逐级恢复，退出时打印每一级停留的时间
+ *
+ * 命令行给出多个文件时按播放列表依次播放：当前这一项开始播放时就在后台打开下一项，
+ * 解复用、解码线程打开文件和解码器之后把下一项的 pictq 填满再阻塞等待，
+ * 当前这一项最后一帧显示完时直接切过去，窗口和音频设备在整个列表中共用，不需要重新创建
+ *
+ * 打开文件时用 probe_cache.h 缓存的流探测结果跳过 avformat_find_stream_info，
+ * 打印打开文件花的时间和是否命中缓存
+ *
+ * --mosaic 列数x行数 在一个窗口里用网格同时播放多个文件（文件不够时循环使用），不播放音频：
+ * 每个格子有自己的解复用、解码线程，解码线程把帧缩放到格子大小再放进 pictq，
+ * 渲染线程按各自的 pts 把到点的帧上传到同一张纹理的对应区域，一次 present。
+ * 每隔几秒打印有多少路能跑满原始帧率，退出时打印每一路的统计
+ *
+ * 每一帧各阶段的耗时记在直方图里（latency_histogram.h）：packet 在 videoq 里等待的时间、解码时间、
+ * 帧在 pictq 里等待的时间、纹理上传时间和显示误差，每一项关闭时打印 p50/p90/p99，
+ * 按 s 键或者关闭时导出到 --latency 指定的文件，渲染循环里不再逐帧打印
+ *
+ * 用法：sffplay [--bench] [--no-degrade] [--loop] [--no-probe-cache]
+ *              [--mosaic 列数x行数] [--latency 文件名.csv|文件名.json] [文件名...]
+ * --bench 无界面跑分：使用 SDL 的 dummy 视频、音频驱动和软件渲染器，不按时间戳等待，
+ * 解出一帧就渲染一帧，依次跑完所有文件（默认 88.mp4、77-1s.mp4、77-3s.mp4），
+ * 每个文件打印解码帧率、队列等待时间、纹理上传时间和丢帧数
+ * --no-degrade 关闭解码降级，跑分模式下也不降级
+ * --loop 播放列表放完之后从头再来
+ * --no-probe-cache 不读探测缓存，每次都完整探测，用来对比打开文件的时间
+ * --mosaic 和 --loop 一起用时每一路放完之后从头再放；和 --bench 一起用时不显示窗口
+ * --latency 每一项关闭时把耗时直方图追加到这个文件，.json 结尾时每次导出写一行 JSON，否则写 CSV；
+ * 没有指定时按 s 键写到 sffplay-latency.csv
  */
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libswresample/swresample.h>
+#include <libswscale/swscale.h>
 }
 
 #include <SDL.h>
 
+#include "audio_ring.h"
+#include "frame_queue.h"
+#include "keyframe_index.h"
+#include "latency_histogram.h"
+#include "packet_queue.h"
+#include "probe_cache.h"
+#include "seqlock.h"
+
 #include <iostream>
 #include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <vector>
 
-//Refresh Event
-#define REFRESH_EVENT  (SDL_USEREVENT + 1)
-#define BREAK_EVENT  (SDL_USEREVENT + 2)
 #define SDL_AUDIO_BUFFER_SIZE 1024
 #define MAX_AUDIO_FRAME_SIZE 192000 //channels(2) * data_size(2) * sample_rate(48000)
+// 解码线程和音频回调之间的环形缓冲区，48kHz S16 双声道约 0.34 秒
+#define AUDIO_RING_SIZE (64 * 1024)
 
 #define MAX_AUDIOQ_SIZE (5 * 16 * 1024)
 #define MAX_VIDEOQ_SIZE (5 * 256 * 1024)
+// 每个队列最多缓存的时长，单位秒
+#define MAX_QUEUE_DURATION 2.0
 
 #define AV_SYNC_THRESHOLD 0.01
 #define AV_NOSYNC_THRESHOLD 10.0
 
-#define FF_REFRESH_EVENT (SDL_USEREVENT)
 #define FF_QUIT_EVENT (SDL_USEREVENT + 1)
 
-#define VIDEO_PICTURE_QUEUE_SIZE 1
-
-typedef struct PacketQueue {
-    // 从last_pkt插入，从first_pkt取出
-    AVPacketList *first_pkt, *last_pkt;
-    int nb_packets;
-    int size;
-    SDL_mutex *mutex;
-    SDL_cond *cond;
-} PacketQueue;
-
-typedef struct VideoPicture {
-    AVFrame *frame;
-    int width, height; /* source height & width */
-    double pts;
-} VideoPicture;
+// 距离显示时刻不到这么多秒时不再休眠，改为自旋等待，SDL_WaitEventTimeout 的误差通常在 1ms 左右
+#define SCHED_SPIN_THRESHOLD 0.002
+// 没有可显示的帧时，等待事件的超时时间，单位毫秒
+#define SCHED_IDLE_WAIT_MS 5
+
+#define VIDEO_PICTURE_QUEUE_SIZE 16
+
+// 快放的最大倍速
+#define TRICK_MAX_SPEED 64
+
+// 马赛克窗口的宽度，格子的宽度是它除以列数，格子按 16:9
+#define MOSAIC_WIDTH 1920
+// 打印一次各路帧率的间隔，单位秒
+#define MOSAIC_REPORT_INTERVAL 5.0
+// 显示帧率达到原始帧率的这个比例就算跑满
+#define MOSAIC_FULL_RATE 0.95
+
+// 解码降级的级数，0 级是正常解码
+#define DEGRADE_LEVELS 4
+// 每隔这么长时间评估一次是否落后
+#define DEGRADE_WINDOW 0.5
+// 一个评估周期内超过这个比例的帧落后就升一级
+#define DEGRADE_BEHIND_RATIO 0.25
+// 每一帧都至少领先显示时刻这么多秒，并且在当前级别待够 DEGRADE_MIN_HOLD 秒才降一级
+#define DEGRADE_RELAX_AHEAD 0.1
+#define DEGRADE_MIN_HOLD 2.0
+
+// 没有指定 --latency 时按 s 键导出到这个文件
+#define LATENCY_DEFAULT_FILE "sffplay-latency.csv"
+
+// 每一帧耗时统计的阶段，前两个由解码线程记录，后三个由渲染线程记录
+enum {
+    LATENCY_PACKET_QUEUE,  // packet 从放进 videoq 到被解码线程取出
+    LATENCY_DECODE,        // 解出这一帧花的时间，不含等 packet 和等 pictq 空位
+    LATENCY_FRAME_QUEUE,   // 帧从放进 pictq 到显示，包括按 pts 等待的时间
+    LATENCY_UPLOAD,        // 上传纹理
+    LATENCY_PRESENT_ERROR, // 实际显示时刻和计划显示时刻之差的绝对值
+    LATENCY_STAGES
+};
+
+static const char *latency_stage_names[LATENCY_STAGES] = {
+        "packet_queue", "decode", "frame_queue", "upload", "present_error"
+};
 
 typedef struct VideoState {
     char filename[1024];
     AVFormatContext *pFormatCtx;
     int videoStream, audioStream;
 
-    double audio_clock;
+    double audio_clock; ///<pts after the last sample written to audio_ring
     double frame_timer;
     double frame_last_pts;
     double frame_last_delay;
@@ -72,107 +157,884 @@ typedef struct VideoState {
     AVStream *audio_st;
     AVCodecContext *audio_ctx;
     PacketQueue audioq;
+    // 解码线程重采样的输出，写进 audio_ring 之后就可以复用
     uint8_t audio_buf[(MAX_AUDIO_FRAME_SIZE * 3) / 2];
-    unsigned int audio_buf_size;
-    unsigned int audio_buf_index;
-    AVFrame audio_frame;
-
-    AVPacket audio_pkt;
-    uint8_t *audio_pkt_data;
-    int audio_pkt_size;
-    int audio_hw_buf_size;
+    AudioRing audio_ring;
+    AVFrame *audio_frame;
+    AVPacket *audio_pkt;
     struct SwrContext *audio_swr_ctx;
+    // SDL 音频设备缓冲区的字节数，回调写入的数据要等这么多字节播完才能听到
+    int audio_hw_buf_size;
+    int audio_bytes_per_sec;
+    // 解码器已经输出了所有音频
+    SDL_atomic_t audio_finished;
+    // 音频解码器当前处理的 serial，以及 seek 之后要跳过的音频的结束时间
+    int audio_serial;
+    double audio_skip_until;
+    /**
+     * 解码线程每写完一帧发布一次：写到 audio_ring 的 audio_ring_windex 字节处时音频的 pts 和 serial，
+     * 音频回调用它和自己的 rindex 算出正在播放的 pts。三个值要一起读，由解码线程通过 audio_ring_seq 发布，
+     * 回调碰上正在发布时这一次不更新时钟，不等解码线程
+     */
+    SeqLock audio_ring_seq;
+    double audio_ring_pts;
+    unsigned int audio_ring_windex;
+    int audio_ring_serial;
+    // seek 之后解码线程置 1 请求音频回调丢掉 audio_ring 里的旧数据，回调丢完之后清 0
+    SDL_atomic_t audio_flush_req;
+    /**
+     * 解码线程等 audio_ring 腾出空间或者等 flush 完成时睡在 audio_ring_sem 上，睡之前把 audio_ring_waiting 置 1，
+     * 音频回调每次读完看到它是 1 就清 0 并 SDL_SemPost（不会阻塞），stream_close 也会 post 一次让它退出
+     */
+    SDL_sem *audio_ring_sem;
+    SDL_atomic_t audio_ring_waiting;
+    // 音频回调需要数据时 audio_ring 不够，只能补静音的次数
+    SDL_atomic_t audio_underruns;
+
+    /**
+     * 音频时钟，只由音频回调通过 audclk_seq 更新，渲染线程和解码线程读取
+     * 在 audclk_time 时刻扬声器正在播放 serial 为 audclk_serial 的 audclk_pts，之后按真实时间外推，
+     * audclk_serial 不是 audioq 当前的 serial（seek 之后新的音频还没播出来）时时钟无效
+     */
+    SeqLock audclk_seq;
+    double audclk_pts;
+    double audclk_time;
+    int audclk_serial;
+    /**
+     * 暂停状态，只由渲染线程通过 audclk_pause_seq 更新：暂停时时钟停在 audclk_pause_pts，
+     * 恢复之后到音频回调更新时钟之前（audclk_time 早于 audclk_resume_time）也停在这里
+     */
+    SeqLock audclk_pause_seq;
+    int audclk_paused;
+    double audclk_pause_pts;
+    double audclk_resume_time;
 
     //video
     AVStream *video_st;
     AVCodecContext *video_ctx;
     PacketQueue videoq;
-
-    VideoPicture pictq[VIDEO_PICTURE_QUEUE_SIZE];
-    int pictq_size, pictq_rindex , pictq_windex;
-    SDL_mutex *pictq_mutex;
-    SDL_cond *pictq_cond;
+    FrameQueue pictq;
+    // 解码线程已经把所有帧都放进 pictq
+    SDL_atomic_t video_finished;
+    // 解码后发现已经落后于音频时钟而丢掉的帧（解码线程）
+    int64_t frame_drops_early;
+    // 显示前发现已经错过显示时刻而丢掉的帧（渲染线程）
+    int64_t frame_drops_late;
+
+    // 视频流和解码器打开之后置 1，失败置 -1，主线程等它来创建窗口
+    int ready;
+    SDL_mutex *ready_mutex;
+    SDL_cond *ready_cond;
 
     SDL_Thread *parse_tid;
     SDL_Thread *video_tid;
+    SDL_Thread *audio_tid;
+
+    /**
+     * seek：主线程设置 seek_pos 和 seek_req，解复用线程 seek 之后设置 seek_target 并开始新的 serial，
+     * 读到文件末尾的解复用线程和已经冲刷完解码器的解码线程在 seek_cond 上等待 seek
+     *
+     * 关键帧索引：缓存或者解复用器自带的在打开文件时就有；都没有时第一次 seek 才在 kf_tid 里扫描文件，
+     * 扫完之前按时间戳直接 seek。kf_tid 填好 kf_index 之后再置 has_kf_index，之后 kf_index 只读
+     */
+    KeyframeIndex kf_index;
+    SDL_atomic_t has_kf_index;
+    SDL_Thread *kf_tid;
+    SDL_atomic_t seek_req;
+    double seek_pos;
+    double seek_target;
+    double seek_keyframe;
+    SDL_mutex *seek_mutex;
+    SDL_cond *seek_cond;
+    // 主线程：请求 seek 的时刻，用来统计从按键到新画面显示出来的延迟
+    int seek_pending;
+    double seek_request_time;
+    int64_t nb_seeks;
+    double max_seek_latency;
+    // 解码线程：seek 之后为了解码到目标时间而解码但不显示的帧数
+    int seek_frames_skipped;
+
+    // 解码降级：当前级别、级别变化次数和每一级停留的时间，由解码线程更新
+    int degrade_level;
+    int degrade_changes;
+    double degrade_seconds[DEGRADE_LEVELS];
+
+    /**
+     * 播放速度，1 为正常播放，大于 1 时只显示关键帧
+     * 主线程设置 req_speed 并发起一次原地 seek，解复用线程 seek 时把它改成 speed，
+     * 所以同一个 serial 的 packet 和帧都对应同一个 speed
+     */
+    int req_speed;
+    int speed;
+    // 视频的帧间隔，单位秒；快放时上一个送去解码的关键帧的时间
+    double frame_interval;
+    double trick_last_pts;
+
+    // 上传纹理的帧数
+    int64_t nb_uploads;
+
+    // 马赛克模式下格子的大小，解码线程把帧缩放到这个大小，tile_w 为 0 时不缩放
+    int tile_w;
+    int tile_h;
+    struct SwsContext *tile_sws;
+    AVBufferPool *tile_pool;
+    AVFrame *tile_frame;
+
+    // 耗时统计，单位秒：解码线程等 packet、解码、等 FrameQueue 空位，渲染线程上传纹理、等待新帧
+    double wait_packet_seconds;
+    double decode_seconds;
+    double wait_frame_seconds;
+    double upload_seconds;
+    double render_wait_seconds;
+    // 每一帧各阶段耗时的直方图，下标是 LATENCY_*
+    LatencyHistogram latency[LATENCY_STAGES];
 
     int quit;
 } VideoState;
 
 VideoState *global_video_state;
 
-//// 初始化队列
-void packet_queue_init(PacketQueue *q) {
-    memset(q, 0, sizeof(PacketQueue));
-    q->mutex = SDL_CreateMutex();
-    q->cond = SDL_CreateCond();
+static bool benchMode = false;
+static bool degradeEnabled = true;
+static bool loopPlaylist = false;
+static bool probeCache = true;
+static int mosaicCols = 0;
+static int mosaicRows = 0;
+static int mosaicTileW = 0;
+static int mosaicTileH = 0;
+static const char *latencyFile = nullptr;
+// 导出耗时直方图时 time_s 的起点
+static double appStartTime = 0;
+// 关闭上一项的线程和主线程可能同时导出到同一个文件
+static SDL_SpinLock latencyFileLock = 0;
+
+/**
+ * 音频设备在整个进程中只打开一次，采样率取第一个有音频的文件，之后的文件都重采样到这个采样率
+ * 音频回调播放 audioState，切换播放列表的时候在 SDL_LockAudio 里替换
+ */
+static bool audioDeviceOpen = false;
+static SDL_AudioSpec audioSpec;
+static VideoState *audioState = nullptr;
+
+static void notify_ready(VideoState *is, int ready) {
+    SDL_LockMutex(is->ready_mutex);
+    is->ready = ready;
+    SDL_CondSignal(is->ready_cond);
+    SDL_UnlockMutex(is->ready_mutex);
 }
 
-int packet_queue_put(PacketQueue *q, AVPacket *pkt) {
+static double monotonic_seconds() {
+    return (double) SDL_GetPerformanceCounter() / (double) SDL_GetPerformanceFrequency();
+}
 
-    AVPacketList *pkt1;
-    if (av_packet_make_refcounted(pkt) < 0) {
-        return -1;
+// 只在音频回调中调用
+static void set_audio_clock(VideoState *is, double pts, double time, int serial) {
+    seqlock_write_begin(&is->audclk_seq);
+    is->audclk_pts = pts;
+    is->audclk_time = time;
+    is->audclk_serial = serial;
+    seqlock_write_end(&is->audclk_seq);
+}
+
+// 当前正在播放的音频 pts，没有音频或者还没开始播放时返回 NAN
+static double get_audio_clock(VideoState *is) {
+    double pts, time, pause_pts, resume_time;
+    int serial, paused, seq;
+
+    // 写者只是回调或者渲染线程里的几次赋值，碰上正在写时重读一次就好
+    do {
+        seq = seqlock_read_begin(&is->audclk_seq);
+        pts = is->audclk_pts;
+        time = is->audclk_time;
+        serial = is->audclk_serial;
+    } while (!seqlock_read_valid(&is->audclk_seq, seq));
+    do {
+        seq = seqlock_read_begin(&is->audclk_pause_seq);
+        paused = is->audclk_paused;
+        pause_pts = is->audclk_pause_pts;
+        resume_time = is->audclk_resume_time;
+    } while (!seqlock_read_valid(&is->audclk_pause_seq, seq));
+
+    if (serial != packet_queue_serial(&is->audioq)) {
+        return NAN;
     }
-    pkt1 = (AVPacketList*)av_malloc(sizeof(AVPacketList));
-    if (!pkt1)
-        return -1;
-    pkt1->pkt = *pkt;
-    pkt1->next = NULL;
+    if (paused || time < resume_time) {
+        return pause_pts;
+    }
+    if (!std::isnan(pts)) {
+        pts += monotonic_seconds() - time;
+    }
+    return pts;
+}
+
+// 暂停时把时钟停在当前值，恢复时等音频回调重新更新时钟，只在渲染线程调用
+static void pause_audio_clock(VideoState *is, bool pause) {
+    double pts = get_audio_clock(is);
+    seqlock_write_begin(&is->audclk_pause_seq);
+    if (pause) {
+        is->audclk_pause_pts = pts;
+    } else {
+        is->audclk_resume_time = monotonic_seconds();
+    }
+    is->audclk_paused = pause;
+    seqlock_write_end(&is->audclk_pause_seq);
+}
+
+//// 音频设备回调，只从 audio_ring 拷贝数据，不解码、不重采样、不阻塞
+static void audio_callback(void *userdata, Uint8 *stream, int len) {
+    VideoState *is = audioState;
+    double callback_time = monotonic_seconds();
+    unsigned int len1, end;
+    double pts;
+    int serial, seq;
 
-    SDL_LockMutex(q->mutex);
+    // 当前这一项没有音频，或者正在切换
+    if (is == nullptr) {
+        memset(stream, 0, len);
+        return;
+    }
+    if (SDL_AtomicGet(&is->audio_flush_req)) {
+        audio_ring_skip_all(&is->audio_ring);
+        SDL_AtomicSet(&is->audio_flush_req, 0);
+    }
+    len1 = audio_ring_read(&is->audio_ring, stream, len);
+    if (len1 < (unsigned int) len) {
+        // 解码线程没跟上，或者已经播完了，剩下的部分播放静音
+        memset(stream + len1, 0, len - len1);
+        if (!SDL_AtomicGet(&is->audio_finished)) {
+            SDL_AtomicAdd(&is->audio_underruns, 1);
+        }
+    }
+    // 解码线程在等空间或者等 flush 完成，叫醒它
+    if (SDL_AtomicCAS(&is->audio_ring_waiting, 1, 0)) {
+        SDL_SemPost(is->audio_ring_sem);
+    }
+    if (len1 == 0) {
+        // 播放静音时让时钟按真实时间外推，音频播完之后视频也能继续走
+        return;
+    }
 
-    if (!q->last_pkt)
-        q->first_pkt = pkt1;
-    else
-        q->last_pkt->next = pkt1;
-    q->last_pkt = pkt1;
-    q->nb_packets++;
-    q->size += pkt1->pkt.size;
-    SDL_CondSignal(q->cond);
+    /**
+     * audio_ring_pts 是 audio_ring 中 audio_ring_windex 字节处的 pts，减去还没播放的字节：
+     * audio_ring 中到这个位置为止剩下的，加上设备缓冲区中的两个回调周期（ffplay 的估计）。
+     * 解码线程可能已经写了下一帧但还没发布，这时 rindex 会超过 audio_ring_windex，差值是负数。
+     * 解码线程正在发布时读到的值不完整，这一次不更新，时钟按真实时间外推到下一次回调
+     */
+    seq = seqlock_read_begin(&is->audio_ring_seq);
+    pts = is->audio_ring_pts;
+    end = is->audio_ring_windex;
+    serial = is->audio_ring_serial;
+    if (!seqlock_read_valid(&is->audio_ring_seq, seq)) {
+        return;
+    }
+    if (!std::isnan(pts) && serial == packet_queue_serial(&is->audioq)) {
+        int unplayed = 2 * is->audio_hw_buf_size +
+                       (int) (end - (unsigned) SDL_AtomicGet(&is->audio_ring.rindex));
+        set_audio_clock(is, pts - (double) unplayed / is->audio_bytes_per_sec, callback_time, serial);
+    }
+}
 
-    SDL_UnlockMutex(q->mutex);
+// 文件已经放完，等到 q 开始新的 serial（有人 seek 了）或者退出，退出时返回 -1
+static int wait_serial_change(VideoState *is, PacketQueue *q, int serial) {
+    SDL_LockMutex(is->seek_mutex);
+    while (!is->quit && packet_queue_serial(q) == serial) {
+        SDL_CondWait(is->seek_cond, is->seek_mutex);
+    }
+    SDL_UnlockMutex(is->seek_mutex);
+    return is->quit ? -1 : 0;
+}
+
+/**
+ * 把重采样后的数据全部写进 audio_ring，只在音频解码线程调用
+ * 满了说明已经缓存了足够多的音频，睡到音频回调取走一些再写，音频回调不会因此等待
+ * 退出或者又 seek 了（剩下的数据已经没用）返回 -1
+ */
+static int audio_ring_write_all(VideoState *is, const uint8_t *data, unsigned int len) {
+    unsigned int written;
+    while (len > 0) {
+        if (is->quit || is->audio_serial != packet_queue_serial(&is->audioq)) {
+            return -1;
+        }
+        // 先置 1 再看有没有空间，回调在这之后读走的数据一定会叫醒我们
+        SDL_AtomicSet(&is->audio_ring_waiting, 1);
+        written = audio_ring_write(&is->audio_ring, data, len);
+        if (written == 0) {
+            SDL_SemWait(is->audio_ring_sem);
+        }
+        data += written;
+        len -= written;
+    }
+    SDL_AtomicSet(&is->audio_ring_waiting, 0);
     return 0;
 }
 
-int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block) {
-    AVPacketList *pkt1;
-    int ret;
+/**
+ * seek 之后丢掉 audio_ring 里旧的音频：只有读者能移动 rindex，所以请求音频回调来丢，
+ * 丢完之前不写新数据。回调暂时不读这一项（暂停中）时一直等到恢复播放或者退出
+ */
+static int audio_ring_flush(VideoState *is) {
+    SDL_AtomicSet(&is->audio_flush_req, 1);
+    for (;;) {
+        SDL_AtomicSet(&is->audio_ring_waiting, 1);
+        if (!SDL_AtomicGet(&is->audio_flush_req)) {
+            break;
+        }
+        if (is->quit) {
+            return -1;
+        }
+        SDL_SemWait(is->audio_ring_sem);
+    }
+    SDL_AtomicSet(&is->audio_ring_waiting, 0);
+    return 0;
+}
 
-    SDL_LockMutex(q->mutex);
+//// 音频解码，解码、重采样之后写进 audio_ring，预先打开的下一项也会先把 audio_ring 填满
+static int decode_audio_thread(void *arg) {
+    VideoState *is = (VideoState *) arg;
+    int ret, serial;
 
-    while (true) {
+    for (;;) {
+        ret = packet_queue_get_serial(&is->audioq, is->audio_pkt, 1, &serial);
+        if (ret < 0 && SDL_AtomicGet(&is->audioq.abort_request)) {
+            break;
+        }
+        if (ret > 0) {
+            if (serial != packet_queue_serial(&is->audioq)) {
+                // seek 之前放入的旧 packet
+                av_packet_unref(is->audio_pkt);
+                continue;
+            }
+            if (serial != is->audio_serial) {
+                avcodec_flush_buffers(is->audio_ctx);
+                is->audio_serial = serial;
+                is->audio_clock = NAN;
+                is->audio_skip_until = is->seek_target;
+                if (audio_ring_flush(is) < 0) {
+                    av_packet_unref(is->audio_pkt);
+                    break;
+                }
+            }
+        }
+        // 读完之后送入 nullptr 把解码器里缓存的帧都取出来
+        ret = avcodec_send_packet(is->audio_ctx, ret < 0 ? nullptr : is->audio_pkt);
+        av_packet_unref(is->audio_pkt);
+        if (ret < 0 && ret != AVERROR_EOF) {
+            // 坏的 packet 直接跳过
+            continue;
+        }
+        while ((ret = avcodec_receive_frame(is->audio_ctx, is->audio_frame)) == 0) {
+            AVFrame *af = is->audio_frame;
+            uint8_t *out = is->audio_buf;
+            int out_count = sizeof(is->audio_buf) / (2 * 2);
+            if (af->best_effort_timestamp != AV_NOPTS_VALUE) {
+                is->audio_clock = af->best_effort_timestamp * av_q2d(is->audio_st->time_base) +
+                                  (double) af->nb_samples / af->sample_rate;
+            } else if (!std::isnan(is->audio_clock)) {
+                is->audio_clock += (double) af->nb_samples / af->sample_rate;
+            }
+            // seek 之后目标时间之前的音频不播放
+            if (!std::isnan(is->audio_skip_until) && !std::isnan(is->audio_clock) &&
+                is->audio_clock <= is->audio_skip_until) {
+                av_frame_unref(af);
+                continue;
+            }
+            int nb_samples = swr_convert(is->audio_swr_ctx, &out, out_count,
+                                         (const uint8_t **) af->extended_data, af->nb_samples);
+            av_frame_unref(af);
+            if (nb_samples <= 0) {
+                continue;
+            }
+            if (audio_ring_write_all(is, is->audio_buf, nb_samples * 2 * 2) < 0) {
+                // 退出或者 seek 了，下一个 packet 会冲刷解码器
+                break;
+            }
+            seqlock_write_begin(&is->audio_ring_seq);
+            is->audio_ring_pts = is->audio_clock;
+            is->audio_ring_windex = (unsigned) SDL_AtomicGet(&is->audio_ring.windex);
+            is->audio_ring_serial = is->audio_serial;
+            seqlock_write_end(&is->audio_ring_seq);
+        }
+        if (ret == AVERROR_EOF) {
+            // 所有音频都已经写进 audio_ring，播完之前还可能 seek 回去
+            SDL_AtomicSet(&is->audio_finished, 1);
+            if (wait_serial_change(is, &is->audioq, is->audio_serial) < 0) {
+                break;
+            }
+            avcodec_flush_buffers(is->audio_ctx);
+            SDL_AtomicSet(&is->audio_finished, 0);
+        }
+    }
+    return 0;
+}
+
+static const char *degrade_level_names[DEGRADE_LEVELS] = {
+        "full quality",
+        "skip loop filter",
+        "skip loop filter, skip idct on non-ref frames",
+        "skip loop filter, skip idct, skip non-ref frames",
+};
+
+/**
+ * 解码降级的控制器，只在解码线程使用
+ * 每一帧算出它领先显示时刻多少秒：有音频时是 pts 减去音频时钟，
+ * 没有音频时用 pictq 里已经缓存的帧数估算，小于 0 就算落后，提前丢掉的帧也算落后
+ */
+typedef struct DecodeGovernor {
+    double window_start;
+    double level_start;
+    int frames;
+    int behind;
+    double min_ahead;
+} DecodeGovernor;
+
+// 按降级级别设置解码器，快放时 skip_frame 保持 AVDISCARD_NONKEY
+static void decode_quality_apply(VideoState *is, int level) {
+    AVCodecContext *ctx = is->video_ctx;
+    ctx->skip_loop_filter = level >= 1 ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    ctx->skip_idct = level >= 2 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    if (is->speed > 1) {
+        ctx->skip_frame = AVDISCARD_NONKEY;
+    } else {
+        ctx->skip_frame = level >= 3 ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+    }
+}
+
+static void governor_reset(DecodeGovernor *gov, double now) {
+    gov->window_start = now;
+    gov->frames = 0;
+    gov->behind = 0;
+    gov->min_ahead = INFINITY;
+}
 
-        if (global_video_state->quit) {
-            ret = -1;
+static void governor_set_level(VideoState *is, DecodeGovernor *gov, int level, double now) {
+    is->degrade_seconds[is->degrade_level] += now - gov->level_start;
+    gov->level_start = now;
+    printf("decode quality level %d -> %d (%s)\n", is->degrade_level, level, degrade_level_names[level]);
+    is->degrade_level = level;
+    is->degrade_changes++;
+    decode_quality_apply(is, level);
+}
+
+/**
+ * 记录一帧领先显示时刻的秒数 ahead，每个评估周期结束时决定升级、降级还是不变
+ * 落后的帧太多就升一级；整个周期都领先足够多并且当前级别待得够久才降一级，避免来回跳
+ */
+static void governor_update(VideoState *is, DecodeGovernor *gov, double ahead) {
+    double now = monotonic_seconds();
+    if (std::isnan(ahead)) {
+        return;
+    }
+    gov->frames++;
+    if (ahead < 0) {
+        gov->behind++;
+    }
+    gov->min_ahead = FFMIN(gov->min_ahead, ahead);
+    if (now - gov->window_start < DEGRADE_WINDOW) {
+        return;
+    }
+    int level = is->degrade_level;
+    if (gov->behind > gov->frames * DEGRADE_BEHIND_RATIO && level < DEGRADE_LEVELS - 1) {
+        governor_set_level(is, gov, level + 1, now);
+    } else if (gov->behind == 0 && gov->min_ahead > DEGRADE_RELAX_AHEAD && level > 0 &&
+               now - gov->level_start >= DEGRADE_MIN_HOLD) {
+        governor_set_level(is, gov, level - 1, now);
+    }
+    governor_reset(gov, now);
+}
+
+/**
+ * 把 frame 缩放成 tile_w x tile_h 的 YUV420P，结果放回 frame
+ * 缓冲区来自 av_buffer_pool，稳定后不再分配内存
+ */
+static int scale_to_tile(VideoState *is, AVFrame *frame) {
+    AVFrame *tile = is->tile_frame;
+    is->tile_sws = sws_getCachedContext(is->tile_sws, frame->width, frame->height, (AVPixelFormat) frame->format,
+                                        is->tile_w, is->tile_h, AV_PIX_FMT_YUV420P, SWS_BILINEAR,
+                                        nullptr, nullptr, nullptr);
+    if (!is->tile_sws) {
+        return -1;
+    }
+    if (!is->tile_pool) {
+        is->tile_pool = av_buffer_pool_init(av_image_get_buffer_size(AV_PIX_FMT_YUV420P, is->tile_w, is->tile_h, 32),
+                                            nullptr);
+    }
+    tile->buf[0] = is->tile_pool ? av_buffer_pool_get(is->tile_pool) : nullptr;
+    if (!tile->buf[0]) {
+        return -1;
+    }
+    av_image_fill_arrays(tile->data, tile->linesize, tile->buf[0]->data, AV_PIX_FMT_YUV420P,
+                         is->tile_w, is->tile_h, 32);
+    tile->extended_data = tile->data;
+    tile->width = is->tile_w;
+    tile->height = is->tile_h;
+    tile->format = AV_PIX_FMT_YUV420P;
+    sws_scale(is->tile_sws, frame->data, frame->linesize, 0, frame->height, tile->data, tile->linesize);
+    av_frame_unref(frame);
+    av_frame_move_ref(frame, tile);
+    return 0;
+}
+
+//// 视频解码
+int decode_video_thread(void *arg) {
+    VideoState *is = (VideoState *) arg;
+    AVPacket pkt1, *packet = &pkt1;
+    AVFrame *pFrame;
+    double pts;
+    int ret, pkt_serial;
+    int serial = packet_queue_serial(&is->videoq);
+    // seek 之后从关键帧开始解码，在这个时间之前结束的帧只解码不显示
+    double skip_until = NAN;
+
+    AVRational frame_rate = av_guess_frame_rate(is->pFormatCtx, is->video_st, nullptr);
+    double duration = (frame_rate.num && frame_rate.den) ? av_q2d((AVRational) {frame_rate.den, frame_rate.num}) : 0;
+
+    // 跑分测的是完整解码的速度，不降级
+    bool degrade = degradeEnabled && !benchMode;
+    DecodeGovernor gov;
+    gov.level_start = monotonic_seconds();
+    governor_reset(&gov, gov.level_start);
+
+    // 上一帧送进 pictq 之后累计的解码时间，丢掉的帧算到下一帧上
+    double frame_decode = 0;
+
+    memset(packet, 0, sizeof(*packet));
+    pFrame = av_frame_alloc();
+
+    for (;;) {
+        double wait_start = monotonic_seconds();
+        double queued = 0;
+        ret = packet_queue_get_timed(&is->videoq, packet, 1, &pkt_serial, &queued);
+        double decode_start = monotonic_seconds();
+        is->wait_packet_seconds += decode_start - wait_start;
+        if (ret < 0 && SDL_AtomicGet(&is->videoq.abort_request)) {
+            // means we quit getting packets
             break;
         }
+        if (ret > 0) {
+            if (pkt_serial != packet_queue_serial(&is->videoq)) {
+                // seek 之前放入的旧 packet，不用解码
+                av_packet_unref(packet);
+                continue;
+            }
+            latency_histogram_add(&is->latency[LATENCY_PACKET_QUEUE], queued);
+            if (pkt_serial != serial) {
+                avcodec_flush_buffers(is->video_ctx);
+                serial = pkt_serial;
+                frame_decode = 0;
+                skip_until = is->seek_target;
+                is->seek_frames_skipped = 0;
+                // 快放时非关键帧 packet 在解复用时已经丢掉，解码器这里也只输出关键帧
+                decode_quality_apply(is, is->degrade_level);
+                // seek 之后重新开始统计，不把 seek 造成的落后算进去
+                governor_reset(&gov, monotonic_seconds());
+            }
+        }
 
-        pkt1 = q->first_pkt;
-        if (pkt1) {
-            q->first_pkt = pkt1->next;
-            if (!q->first_pkt)
-                q->last_pkt = NULL;
-            q->nb_packets--;
-            q->size -= pkt1->pkt.size;
-            *pkt = pkt1->pkt;
-            av_free(pkt1);
-            ret = 1;
+        // Decode video frame，读完之后送入 nullptr 把解码器里缓存的帧都取出来
+        ret = avcodec_send_packet(is->video_ctx, ret < 0 ? nullptr : packet);
+        av_packet_unref(packet);
+        if (ret < 0 && ret != AVERROR_EOF) {
+            std::cerr << "Error! decode packet failed!" << std::endl;
             break;
-        } else if (!block) {
-            ret = 0;
+        }
+        while ((ret = avcodec_receive_frame(is->video_ctx, pFrame)) == 0) {
+            if ((pts = pFrame->best_effort_timestamp) != AV_NOPTS_VALUE) {
+                pts *= av_q2d(is->video_st->time_base);
+            } else {
+                pts = NAN;
+            }
+
+            // 还没解码到 seek 的目标时间
+            if (!std::isnan(skip_until)) {
+                if (!std::isnan(pts) && pts + duration <= skip_until) {
+                    is->seek_frames_skipped++;
+                    av_frame_unref(pFrame);
+                    continue;
+                }
+                skip_until = NAN;
+            }
+
+            // 已经落后于音频时钟的帧不用再送去显示，后面还有 packet 时直接丢掉
+            double ahead = NAN;
+            if (is->audio_st && !std::isnan(pts)) {
+                double diff = pts + duration - get_audio_clock(is);
+                if (!std::isnan(diff) && std::fabs(diff) < AV_NOSYNC_THRESHOLD) {
+                    ahead = diff - duration;
+                }
+                if (!std::isnan(diff) && diff < 0 && std::fabs(diff) < AV_NOSYNC_THRESHOLD &&
+                    packet_queue_nb_packets(&is->videoq) > 0) {
+                    is->frame_drops_early++;
+                    if (degrade && is->speed == 1) {
+                        governor_update(is, &gov, ahead);
+                    }
+                    av_frame_unref(pFrame);
+                    continue;
+                }
+            } else {
+                // 没有音频时钟，渲染线程手里只剩这一帧就算落后
+                ahead = (frame_queue_nb_remaining(&is->pictq) - 1) * duration;
+            }
+            if (degrade && is->speed == 1) {
+                governor_update(is, &gov, ahead);
+            }
+
+            // 马赛克模式下缩放也在解码线程里做，渲染线程只上传纹理
+            if (is->tile_w > 0 && scale_to_tile(is, pFrame) < 0) {
+                std::cerr << "Error! scale frame to tile failed!" << std::endl;
+                av_frame_unref(pFrame);
+                continue;
+            }
+
+            // 队列满时在这里等待渲染线程取走一帧
+            wait_start = monotonic_seconds();
+            is->decode_seconds += wait_start - decode_start;
+            latency_histogram_add(&is->latency[LATENCY_DECODE], frame_decode + wait_start - decode_start);
+            frame_decode = 0;
+            Frame *vp = frame_queue_peek_writable(&is->pictq);
+            decode_start = monotonic_seconds();
+            is->wait_frame_seconds += decode_start - wait_start;
+            if (vp == nullptr) {
+                av_frame_unref(pFrame);
+                goto end;
+            }
+            vp->pts = pts;
+            vp->duration = duration;
+            vp->serial = serial;
+            vp->queued_time = decode_start;
+            av_frame_move_ref(vp->frame, pFrame);
+            frame_queue_push(&is->pictq);
+        }
+        double decode_end = monotonic_seconds();
+        is->decode_seconds += decode_end - decode_start;
+        frame_decode += decode_end - decode_start;
+        if (ret == AVERROR_EOF) {
+            // 所有帧都已经放进 pictq，播完之前还可能 seek 回去
+            SDL_AtomicSet(&is->video_finished, 1);
+            if (wait_serial_change(is, &is->videoq, serial) < 0) {
+                break;
+            }
+            SDL_AtomicSet(&is->video_finished, 0);
+        } else if (ret != AVERROR(EAGAIN)) {
+            std::cerr << "receive_frame return " << ret << std::endl;
             break;
-        } else {
-            SDL_CondWait(q->cond, q->mutex);
         }
     }
-    SDL_UnlockMutex(q->mutex);
-    return ret;
+
+    end:
+    is->degrade_seconds[is->degrade_level] += monotonic_seconds() - gov.level_start;
+    SDL_AtomicSet(&is->video_finished, 1);
+    av_frame_free(&pFrame);
+    return 0;
+}
+
+/**
+ * 打开音频设备（第一次调用时）、重采样和 audio_ring，音频在 decode_audio_thread 中解码
+ * 在解复用线程中调用，预先打开的下一项总是在当前这一项打开完之后才开始，不会同时打开设备
+ */
+static int audio_open(VideoState *is, AVCodecContext *codecCtx) {
+    if (!audioDeviceOpen) {
+        SDL_AudioSpec wanted_spec;
+        wanted_spec.freq = codecCtx->sample_rate;
+        wanted_spec.format = AUDIO_S16SYS;
+        wanted_spec.channels = 2;
+        wanted_spec.silence = 0;
+        wanted_spec.samples = SDL_AUDIO_BUFFER_SIZE;
+        wanted_spec.callback = audio_callback;
+        wanted_spec.userdata = nullptr;
+        if (SDL_OpenAudio(&wanted_spec, &audioSpec) < 0) {
+            fprintf(stderr, "SDL_OpenAudio: %s\n", SDL_GetError());
+            return -1;
+        }
+        audioDeviceOpen = true;
+        // 还没有激活的文件时回调播放静音
+        SDL_PauseAudio(0);
+    }
+    const SDL_AudioSpec &spec = audioSpec;
+
+    // 输出 S16 双声道，采样率不变
+    int64_t in_channel_layout = codecCtx->channel_layout ? (int64_t) codecCtx->channel_layout :
+                                av_get_default_channel_layout(codecCtx->channels);
+    is->audio_swr_ctx = swr_alloc_set_opts(nullptr,
+                                           AV_CH_LAYOUT_STEREO, AV_SAMPLE_FMT_S16, spec.freq,
+                                           in_channel_layout, codecCtx->sample_fmt, codecCtx->sample_rate,
+                                           0, nullptr);
+    if (!is->audio_swr_ctx || swr_init(is->audio_swr_ctx) < 0) {
+        fprintf(stderr, "Could not init audio resampler!\n");
+        swr_free(&is->audio_swr_ctx);
+        return -1;
+    }
+
+    if (audio_ring_init(&is->audio_ring, AUDIO_RING_SIZE) < 0) {
+        fprintf(stderr, "Could not allocate audio ring!\n");
+        swr_free(&is->audio_swr_ctx);
+        return -1;
+    }
+    is->audio_ring_sem = SDL_CreateSemaphore(0);
+    if (!is->audio_ring_sem) {
+        fprintf(stderr, "SDL_CreateSemaphore: %s\n", SDL_GetError());
+        audio_ring_destroy(&is->audio_ring);
+        swr_free(&is->audio_swr_ctx);
+        return -1;
+    }
+
+    is->audio_frame = av_frame_alloc();
+    is->audio_pkt = av_packet_alloc();
+    is->audio_hw_buf_size = spec.size;
+    is->audio_bytes_per_sec = spec.freq * 2 * 2;
+    is->audio_clock = NAN;
+    is->audio_skip_until = NAN;
+    is->audio_ring_pts = NAN;
+    return 0;
+}
+
+// 打开音频或视频解码器，视频会创建解码线程
+static int stream_component_open(VideoState *is, int stream_index) {
+    AVFormatContext *pFormatCtx = is->pFormatCtx;
+    AVStream *st = pFormatCtx->streams[stream_index];
+    const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
+    if (!codec) {
+        fprintf(stderr, "Unsupported codec!\n");
+        return -1;
+    }
+
+    AVCodecContext *codecCtx = avcodec_alloc_context3(codec);
+    if (!codecCtx) {
+        return -1;
+    }
+    // 根据 AVCodecParameters 填充 AVCodecContext
+    if (avcodec_parameters_to_context(codecCtx, st->codecpar) < 0) {
+        avcodec_free_context(&codecCtx);
+        return -1;
+    }
+    if (avcodec_open2(codecCtx, codec, nullptr) < 0) {
+        fprintf(stderr, "Could not open codec!\n");
+        avcodec_free_context(&codecCtx);
+        return -1;
+    }
+
+    if (codecCtx->codec_type == AVMEDIA_TYPE_AUDIO) {
+        if (audio_open(is, codecCtx) < 0) {
+            avcodec_free_context(&codecCtx);
+            return -1;
+        }
+        is->audioStream = stream_index;
+        is->audio_st = st;
+        is->audio_ctx = codecCtx;
+        packet_queue_set_limits(&is->audioq, MAX_AUDIOQ_SIZE,
+                                (int64_t) (MAX_QUEUE_DURATION / av_q2d(st->time_base)));
+        // 创建音频解码线程，stream_activate 把音频回调切到这一项之后才开始播放
+        is->audio_tid = SDL_CreateThread(decode_audio_thread, "decode_audio_thread", is);
+        return 0;
+    }
+
+    is->videoStream = stream_index;
+    is->video_st = st;
+    is->video_ctx = codecCtx;
+    AVRational frame_rate = av_guess_frame_rate(pFormatCtx, st, nullptr);
+    is->frame_interval = (frame_rate.num && frame_rate.den) ? av_q2d(av_inv_q(frame_rate)) : 0.04;
+    packet_queue_set_limits(&is->videoq, MAX_VIDEOQ_SIZE,
+                            (int64_t) (MAX_QUEUE_DURATION / av_q2d(st->time_base)));
+
+    // 创建视频解码线程
+    is->video_tid = SDL_CreateThread(decode_video_thread, "decode_video_thread", is);
+    return 0;
+}
+
+static void keyframe_index_report(VideoState *is, int source, double start) {
+    static const char *sources[] = {"cache", "demuxer", "scan"};
+    printf("%s: keyframe index: %d keyframes from %s in %.1f ms, max GOP %.3f s\n", is->filename,
+           is->kf_index.nb_entries, sources[source], (monotonic_seconds() - start) * 1000,
+           is->kf_index.max_gop * av_q2d(is->kf_index.time_base));
+}
+
+/**
+ * 文件没有现成的关键帧索引（TS、裸流、FLV）时，第一次 seek 在这个线程里扫描整个文件，
+ * 扫完之前的 seek 按时间戳进行；关闭时通过 is->quit 提前结束
+ */
+static int keyframe_scan_thread(void *arg) {
+    VideoState *is = (VideoState *) arg;
+    KeyframeIndex idx;
+    double start = monotonic_seconds();
+
+    int source = keyframe_index_build_scan(&idx, is->filename, is->videoStream, is->video_st->time_base,
+                                           probeCache, &is->quit);
+    if (source < 0) {
+        if (!is->quit) {
+            fprintf(stderr, "%s: could not build keyframe index, seek by timestamp\n", is->filename);
+        }
+        return 0;
+    }
+    // 先填好索引再发布，解复用线程和渲染线程看到 has_kf_index 之后才读
+    is->kf_index = idx;
+    keyframe_index_report(is, source, start);
+    SDL_AtomicSet(&is->has_kf_index, 1);
+    return 0;
+}
+
+/**
+ * 在解复用线程中执行 seek
+ * 关键帧索引里找到目标之前最近的关键帧，让 avformat_seek_file 正好落在它上面，
+ * 之后两个队列开始新的 serial，解码线程看到新 serial 的 packet 时冲刷解码器，
+ * 解码到 seek_target 之前的帧都不显示，所以最多多解码一个 GOP
+ */
+static void stream_do_seek(VideoState *is) {
+    AVRational tb = is->video_st->time_base;
+    double target = is->seek_pos;
+    int64_t seek_ts = (int64_t) (target / av_q2d(tb));
+    int ret;
+
+    if (!SDL_AtomicGet(&is->has_kf_index) && is->kf_tid == nullptr) {
+        // 第一次 seek：在后台扫描文件建立索引，这一次先按时间戳 seek
+        is->kf_tid = SDL_CreateThread(keyframe_scan_thread, "keyframe_scan_thread", is);
+    }
+    if (SDL_AtomicGet(&is->has_kf_index)) {
+        int k = keyframe_index_lookup(&is->kf_index, seek_ts);
+        if (k >= 0) {
+            seek_ts = is->kf_index.entries[k].pts;
+        }
+    }
+    ret = avformat_seek_file(is->pFormatCtx, is->videoStream, INT64_MIN, seek_ts, seek_ts, 0);
+    if (ret < 0) {
+        fprintf(stderr, "%s: error while seeking to %.3f\n", is->filename, target);
+    } else {
+        SDL_LockMutex(is->seek_mutex);
+        is->speed = is->req_speed;
+        is->trick_last_pts = NAN;
+        // 快放时只有关键帧，不需要解码到精确的目标时间
+        is->seek_target = is->speed > 1 ? NAN : target;
+        is->seek_keyframe = seek_ts * av_q2d(tb);
+        packet_queue_start_serial(&is->videoq);
+        packet_queue_start_serial(&is->audioq);
+        SDL_CondBroadcast(is->seek_cond);
+        SDL_UnlockMutex(is->seek_mutex);
+        // 音频时钟的 serial 和 audioq 不一样了，等新 serial 的音频播出来之后才有效
+    }
+    SDL_AtomicSet(&is->seek_req, 0);
 }
 
+/**
+ * 快放时视频 packet 是否送去解码：只要关键帧，并且相邻两个关键帧的时间
+ * 至少隔 speed 个帧间隔，这样每秒显示的帧数不超过原始帧率
+ */
+static bool trick_keep_packet(VideoState *is, AVPacket *pkt) {
+    if (!(pkt->flags & AV_PKT_FLAG_KEY)) {
+        return false;
+    }
+    int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+    if (ts == AV_NOPTS_VALUE) {
+        return true;
+    }
+    double pts = ts * av_q2d(is->video_st->time_base);
+    if (!std::isnan(is->trick_last_pts) && pts >= is->trick_last_pts &&
+        pts < is->trick_last_pts + is->speed * is->frame_interval) {
+        return false;
+    }
+    is->trick_last_pts = pts;
+    return true;
+}
 
 /**
- * 视频解码线程
+ * 解复用线程
  * 入参 VideoState，VideoState里保存视频所有相关状态
  * 解复用，获取音频、视频流，并将packet放入队列中
  */
@@ -181,12 +1043,9 @@ int demux_thread(void *arg) {
     int err_code;
     char errors[1024] = {0,};
 
-    int w, h;
-
     VideoState *is = (VideoState *) arg;
     AVFormatContext *pFormatCtx = NULL;
     AVPacket pkt1, *packet = &pkt1;
-    const AVCodec *videoCodec;
 
     int video_index = -1;
     int audio_index = -1;
@@ -195,23 +1054,27 @@ int demux_thread(void *arg) {
     is->videoStream = -1;
     is->audioStream = -1;
 
-    global_video_state = is;
+    memset(packet, 0, sizeof(*packet));
 
-    /* open input file, and allocate format context */
-    if ((err_code = avformat_open_input(&pFormatCtx, is->filename, NULL, NULL)) < 0) {
+    /**
+     * open input file, and allocate format context
+     * 命中探测缓存时不调用 avformat_find_stream_info，流信息从缓存文件里读
+     */
+    double open_start = monotonic_seconds();
+    int probe_hit;
+    if ((err_code = probe_cache_open_input(&pFormatCtx, is->filename, NULL, probeCache, &probe_hit)) < 0) {
         av_strerror(err_code, errors, 1024);
         fprintf(stderr, "Could not open source file %s, %d(%s)\n", is->filename, err_code, errors);
+        notify_ready(is, -1);
         return -1;
     }
+    printf("open %s: %.1f ms, probe cache %s\n", is->filename, (monotonic_seconds() - open_start) * 1000,
+           probe_hit ? "hit" : probeCache ? "miss" : "off");
 
     is->pFormatCtx = pFormatCtx;
 
-    // Retrieve stream information
-    if (avformat_find_stream_info(pFormatCtx, NULL) < 0)
-        return -1; // Couldn't find stream information
-
     // Dump information about file onto standard error
-//    av_dump_format(pFormatCtx, 0, is->filename, 0);
+    av_dump_format(pFormatCtx, 0, is->filename, 0);
 
     // Find the first video stream
     for (i = 0; i < pFormatCtx->nb_streams; i++) {
@@ -225,280 +1088,997 @@ int demux_thread(void *arg) {
         }
     }
 
-//    if (audio_index >= 0) {
-//        stream_component_open(is, audio_index);
-//    }
-//    if (video_index >= 0) {
-//        stream_component_open(is, video_index);
-//    }
-    packet_queue_init(&is->videoq);
+    // 音频打不开时只播放视频，时钟退回到按 pts 自由运行；跑分和马赛克时不打开音频，音频 packet 直接丢弃
+    if (!benchMode && mosaicCols == 0 && audio_index >= 0 && stream_component_open(is, audio_index) < 0) {
+        fprintf(stderr, "%s: could not open audio, play video only\n", is->filename);
+    }
+    if (video_index >= 0) {
+        stream_component_open(is, video_index);
+    }
 
-    if (is->videoStream < 0 || is->audioStream < 0) {
+    if (is->videoStream < 0) {
         fprintf(stderr, "%s: could not open codecs\n", is->filename);
-        goto fail;
+        notify_ready(is, -1);
+        return -1;
+    }
+    notify_ready(is, 1);
+
+    {
+        // 只用缓存和解复用器自带的索引，不读文件内容，不影响第一帧出来的时间
+        double start = monotonic_seconds();
+        int source = keyframe_index_build(&is->kf_index, is->filename, pFormatCtx, is->videoStream);
+        if (source >= 0) {
+            keyframe_index_report(is, source, start);
+            SDL_AtomicSet(&is->has_kf_index, 1);
+        }
     }
 
     while (true) {
         if (is->quit) {
             break;
         }
-        // seek stuff goes here
-        if (is->audioq.size > MAX_AUDIOQ_SIZE ||
-            is->videoq.size > MAX_VIDEOQ_SIZE) {
-            SDL_Delay(10);
-            continue;
+        if (SDL_AtomicGet(&is->seek_req)) {
+            stream_do_seek(is);
+        }
+        // 任何一个队列超过上限就睡眠，直到对应的解码线程取走 packet；只有 abort 时返回 -1
+        if (packet_queue_wait_space(&is->audioq) < 0 ||
+            packet_queue_wait_space(&is->videoq) < 0) {
+            break;
         }
         if (av_read_frame(is->pFormatCtx, packet) < 0) {
-            if (is->pFormatCtx->pb->error == 0) {
-                SDL_Delay(100); /* no error; wait for user input */
-                continue;
-            } else {
-                break;
+            // 文件读完或者读取出错，解码线程和音频回调取完队列之后会冲刷解码器，这里等 seek 或者退出
+            packet_queue_finish(&is->videoq);
+            packet_queue_finish(&is->audioq);
+            SDL_LockMutex(is->seek_mutex);
+            while (!is->quit && !SDL_AtomicGet(&is->seek_req)) {
+                SDL_CondWait(is->seek_cond, is->seek_mutex);
             }
+            SDL_UnlockMutex(is->seek_mutex);
+            continue;
         }
         // Is this a packet from the video stream?
         if (packet->stream_index == is->videoStream) {
+            if (is->speed > 1 && !trick_keep_packet(is, packet)) {
+                av_packet_unref(packet);
+                continue;
+            }
             packet_queue_put(&is->videoq, packet);
-        } else if (packet->stream_index == is->audioStream) {
-//            packet_queue_put(&is->audioq, packet);
+        } else if (packet->stream_index == is->audioStream && is->speed <= 1) {
+            packet_queue_put(&is->audioq, packet);
         } else {
             av_packet_unref(packet);
         }
     }
-    /* all done - wait for it */
-    while (!is->quit) {
-        SDL_Delay(100);
+    return 0;
+}
+
+
+static bool appQuit = false;
+static bool appPause = false;
+
+/**
+ * 按 pts 调度显示时刻
+ * 第一帧显示时记下 base_time 和 base_pts，之后每一帧的显示时刻是
+ * base_time + (pts - base_pts)，用单调时钟 SDL_GetPerformanceCounter 计时，
+ * 帧率可变的视频也按实际的时间戳显示，不会累积误差。
+ * 有音频时每次都把 base 对齐到音频时钟，视频跟着音频走。
+ * 暂停期间不唤醒，恢复时把 base_time 向后挪暂停的时长。
+ */
+typedef struct FrameScheduler {
+    int started;
+    // 当前时间基准对应的 serial 和播放速度，seek 或者改变速度之后重新对齐
+    int serial;
+    double speed;
+    double base_time;
+    double base_pts;
+    double last_pts;
+    double last_target;
+    double last_duration;
+    double pause_time;
+
+    // 统计：显示误差是实际调用 present 的时刻减去目标时刻
+    int64_t frames;
+    double sum_abs_error;
+    double max_abs_error;
+    // 抖动：相邻两帧实际间隔和 pts 间隔之差
+    double last_present;
+    int last_serial;
+    int64_t jitter_samples;
+    double sum_jitter;
+    double max_jitter;
+} FrameScheduler;
+
+/**
+ * 计算 vp 的目标显示时刻，master 是音频时钟，没有时为 NAN；时间戳异常时以当前时刻为基准重新开始
+ * speed 大于 1 时 pts 的间隔按倍速缩短
+ */
+static double scheduler_target(FrameScheduler *sched, Frame *vp, double master, int speed) {
+    double now = monotonic_seconds();
+    double pts = vp->pts;
+    if (vp->serial != sched->serial || sched->speed == 0) {
+        sched->started = 0;
+        sched->serial = vp->serial;
+        sched->speed = speed > 1 ? speed : 1;
     }
+    if (std::isnan(pts)) {
+        // 没有时间戳，按上一帧加上帧时长估算
+        pts = sched->started ? sched->last_pts + sched->last_duration : 0;
+    }
+    if (!std::isnan(master) && std::fabs(pts - master) < AV_NOSYNC_THRESHOLD) {
+        sched->started = 1;
+        sched->base_time = now;
+        sched->base_pts = master;
+    } else if (!sched->started) {
+        sched->started = 1;
+        sched->base_time = now;
+        sched->base_pts = pts;
+    }
+    double target = sched->base_time + (pts - sched->base_pts) / sched->speed;
+    if (std::fabs(target - now) > AV_NOSYNC_THRESHOLD) {
+        // pts 跳变（拼接的流、时间戳回绕等），重新对齐
+        sched->base_time = now;
+        sched->base_pts = pts;
+        target = now;
+    }
+    vp->pts = pts;
+    return target;
+}
 
-    fail:
-    if (1) {
-        SDL_Event event;
-        event.type = FF_QUIT_EVENT;
-        event.user.data1 = is;
-        SDL_PushEvent(&event);
+static void scheduler_pause(FrameScheduler *sched, bool pause) {
+    if (pause) {
+        sched->pause_time = monotonic_seconds();
+    } else if (sched->started) {
+        double paused = monotonic_seconds() - sched->pause_time;
+        sched->base_time += paused;
+        sched->last_target += paused;
+        sched->last_present += paused;
     }
-    return 0;
 }
 
-//// 视频解码
-int decode_video_thread(void *arg) {
-    VideoState *is = (VideoState *) arg;
-    AVPacket pkt1, *packet = &pkt1;
-    AVFrame *pFrame;
-    double pts;
+// 自旋等到 target，剩余时间已经小于 SCHED_SPIN_THRESHOLD
+static void scheduler_spin_until(double target) {
+    while (monotonic_seconds() < target) {
+    }
+}
 
-    pFrame = av_frame_alloc();
+static void scheduler_presented(FrameScheduler *sched, Frame *vp, double target, double present) {
+    double error = present - target;
+    sched->frames++;
+    sched->sum_abs_error += std::fabs(error);
+    sched->max_abs_error = FFMAX(sched->max_abs_error, std::fabs(error));
+    // seek 前后的两帧之间不算抖动
+    if (sched->frames > 1 && sched->last_serial == vp->serial) {
+        double jitter = std::fabs((present - sched->last_present) - (vp->pts - sched->last_pts) / sched->speed);
+        sched->jitter_samples++;
+        sched->sum_jitter += jitter;
+        sched->max_jitter = FFMAX(sched->max_jitter, jitter);
+    }
+    if (vp->duration > 0) {
+        sched->last_duration = vp->duration;
+    } else if (sched->frames > 1) {
+        sched->last_duration = vp->pts - sched->last_pts;
+    }
+    sched->last_pts = vp->pts;
+    sched->last_target = target;
+    sched->last_present = present;
+    sched->last_serial = vp->serial;
+}
 
-    for (;;) {
-        if (packet_queue_get(&is->videoq, packet, 1) < 0) {
-            // means we quit getting packets
-            break;
-        }
+// 显示最近一次 frame_queue_next 之后的帧
+static void video_display(VideoState *is, SDL_Renderer *renderer, SDL_Texture *texture) {
+    Frame *vp = frame_queue_peek_last(&is->pictq);
+    if (!is->pictq.rindex_shown || !vp->frame->data[0]) {
+        return;
+    }
+    double upload_start = monotonic_seconds();
+    SDL_UpdateYUVTexture(texture, nullptr,
+                         vp->frame->data[0], vp->frame->linesize[0],
+                         vp->frame->data[1], vp->frame->linesize[1],
+                         vp->frame->data[2], vp->frame->linesize[2]);
+    is->nb_uploads++;
+    double upload_time = monotonic_seconds() - upload_start;
+    is->upload_seconds += upload_time;
+    latency_histogram_add(&is->latency[LATENCY_UPLOAD], upload_time);
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+    SDL_RenderPresent(renderer);
+}
 
-        // Decode video frame
-        avcodec_send_packet(is->video_ctx, packet);
-        while (avcodec_receive_frame(is->video_ctx, pFrame) == 0) {
-            if ((pts = pFrame->best_effort_timestamp) != AV_NOPTS_VALUE) {
-            } else {
-                pts = 0;
-            }
-            pts *= av_q2d(is->video_st->time_base);
 
+// 打开输入文件，创建解复用线程，等视频解码器打开之后返回
+/**
+ * 创建 VideoState 并启动解复用线程，不等文件打开就返回，播放列表用它在后台预先打开下一项
+ * 开始播放之前用 stream_wait_ready 等文件和解码器打开
+ */
+static VideoState *stream_open(const char *filename) {
+    auto *is = (VideoState *) av_mallocz(sizeof(VideoState));
+    if (is == nullptr) {
+        return nullptr;
+    }
+    strlcpy(is->filename, filename, sizeof(is->filename));
+    // 音频开始播放之前时钟无效
+    is->audclk_pts = NAN;
+    is->ready_mutex = SDL_CreateMutex();
+    is->ready_cond = SDL_CreateCond();
+    is->seek_mutex = SDL_CreateMutex();
+    is->seek_cond = SDL_CreateCond();
+    is->req_speed = 1;
+    is->speed = 1;
+    is->trick_last_pts = NAN;
+    for (int i = 0; i < LATENCY_STAGES; i++) {
+        latency_histogram_init(&is->latency[i], latency_stage_names[i]);
+    }
+    if (mosaicCols > 0) {
+        // 格子大小在解码线程启动之前就要定下来
+        is->tile_w = mosaicTileW;
+        is->tile_h = mosaicTileH;
+        is->tile_frame = av_frame_alloc();
+    }
+    packet_queue_init(&is->audioq);
+    packet_queue_init(&is->videoq);
+    if (frame_queue_init(&is->pictq, VIDEO_PICTURE_QUEUE_SIZE, 1) < 0) {
+        std::cerr << "Error! frame queue init failed!" << std::endl;
+        return nullptr;
+    }
 
-            av_packet_unref(packet);
-        }
+    // 创建解复用线程，等它打开视频流之后才知道窗口大小
+    is->parse_tid = SDL_CreateThread(demux_thread, "demux_thread", is);
+    return is;
+}
+
+// 等解复用线程打开文件和解码器，失败返回 -1
+static int stream_wait_ready(VideoState *is) {
+    SDL_LockMutex(is->ready_mutex);
+    while (is->ready == 0) {
+        SDL_CondWait(is->ready_cond, is->ready_mutex);
+    }
+    SDL_UnlockMutex(is->ready_mutex);
+    if (is->ready < 0) {
+        std::cerr << "Error! open input file! " << is->filename << std::endl;
+        return -1;
     }
-    av_frame_free(&pFrame);
     return 0;
 }
 
+// 开始播放 is：音频回调切到这一项，之前预先解码好的帧马上就可以显示
+static void stream_activate(VideoState *is) {
+    SDL_LockAudio();
+    audioState = is->audio_st ? is : nullptr;
+    SDL_UnlockAudio();
+}
 
-static bool appQuit = false;
-static bool appPause = false;
-static uint32_t delayMs = 0;
-
-int refresh_video(void *opaque) {
-    while (!appQuit) {
-        if (!appPause) {
-            SDL_Event event;
-            event.type = REFRESH_EVENT;
-            SDL_PushEvent(&event);
+/**
+ * 把 is 各阶段的耗时直方图追加到 path，path 以 .json 结尾时写一行 JSON，否则写 CSV，新文件先写表头
+ * 播放列表的每一项和每次按 s 键都追加一次，用文件名和 time_s（从程序启动开始的秒数）区分
+ */
+static void latency_dump(VideoState *is, const char *path) {
+    size_t len = strlen(path);
+    bool json = len >= 5 && strcmp(path + len - 5, ".json") == 0;
+    double time_s = monotonic_seconds() - appStartTime;
+
+    SDL_AtomicLock(&latencyFileLock);
+    FILE *fp = fopen(path, "a");
+    if (fp == nullptr) {
+        SDL_AtomicUnlock(&latencyFileLock);
+        std::cerr << "Error: could not write latency stats to " << path << std::endl;
+        return;
+    }
+    if (json) {
+        fprintf(fp, "{\"file\":");
+        latency_histogram_write_string(fp, is->filename, 1);
+        fprintf(fp, ",\"time_s\":%.3f,\"stages\":[", time_s);
+        for (int i = 0; i < LATENCY_STAGES; i++) {
+            if (i > 0) {
+                fputc(',', fp);
+            }
+            latency_histogram_write_json(&is->latency[i], fp);
+        }
+        fprintf(fp, "]}\n");
+    } else {
+        fseek(fp, 0, SEEK_END);
+        if (ftell(fp) == 0) {
+            latency_histogram_csv_header(fp);
+        }
+        for (int i = 0; i < LATENCY_STAGES; i++) {
+            latency_histogram_write_csv(&is->latency[i], fp, is->filename, time_s);
         }
-        SDL_Delay(delayMs);
     }
-    return 0;
+    fclose(fp);
+    SDL_AtomicUnlock(&latencyFileLock);
+    printf("latency stats of %s written to %s\n", is->filename, path);
 }
 
+// 通知解复用和解码线程退出，打印统计信息并释放所有资源
+static void stream_close(VideoState *is) {
+    SDL_LockAudio();
+    if (audioState == is) {
+        audioState = nullptr;
+    }
+    SDL_UnlockAudio();
+    SDL_LockMutex(is->seek_mutex);
+    is->quit = 1;
+    SDL_CondBroadcast(is->seek_cond);
+    SDL_UnlockMutex(is->seek_mutex);
+    // 音频解码线程可能在等 audio_ring，回调已经不会再叫醒它了
+    if (is->audio_ring_sem) {
+        SDL_SemPost(is->audio_ring_sem);
+    }
+    packet_queue_abort(&is->videoq);
+    packet_queue_abort(&is->audioq);
+    frame_queue_abort(&is->pictq);
+    SDL_WaitThread(is->parse_tid, nullptr);
+    SDL_WaitThread(is->kf_tid, nullptr);
+    SDL_WaitThread(is->video_tid, nullptr);
+    SDL_WaitThread(is->audio_tid, nullptr);
+
+    std::cout << "decoded frames: " << is->pictq.nb_pushed
+              << ", max buffered: " << is->pictq.max_occupancy << "/" << is->pictq.max_size
+              << ", decoder waits on full: " << is->pictq.nb_full_waits
+              << ", display underruns: " << is->pictq.nb_underruns
+              << ", dropped early: " << is->frame_drops_early
+              << ", dropped late: " << is->frame_drops_late << std::endl;
+    if (is->audio_st) {
+        std::cout << "audio underruns: " << SDL_AtomicGet(&is->audio_underruns) << std::endl;
+    }
+    if (is->nb_seeks > 0) {
+        std::cout << "seeks: " << is->nb_seeks << ", max seek latency(ms): " << is->max_seek_latency * 1000
+                  << std::endl;
+    }
+    if (is->degrade_changes > 0) {
+        std::cout << "decode quality changes: " << is->degrade_changes << ", time at level(s):";
+        for (int i = 0; i < DEGRADE_LEVELS; i++) {
+            std::cout << " " << i << "=" << is->degrade_seconds[i];
+        }
+        std::cout << std::endl;
+    }
+    if (SDL_AtomicGet(&is->latency[LATENCY_DECODE].count) > 0) {
+        printf("latency of %s:\n", is->filename);
+        for (int i = 0; i < LATENCY_STAGES; i++) {
+            latency_histogram_print(&is->latency[i]);
+        }
+        if (latencyFile) {
+            latency_dump(is, latencyFile);
+        }
+    }
 
-int main(int argc, char *args[]) {
-//    exit(0);
+    frame_queue_destroy(&is->pictq);
+    packet_queue_destroy(&is->videoq);
+    packet_queue_destroy(&is->audioq);
+    avcodec_free_context(&is->video_ctx);
+    sws_freeContext(is->tile_sws);
+    av_frame_free(&is->tile_frame);
+    av_buffer_pool_uninit(&is->tile_pool);
+    SDL_DestroyMutex(is->ready_mutex);
+    SDL_DestroyCond(is->ready_cond);
+    SDL_DestroyMutex(is->seek_mutex);
+    SDL_DestroyCond(is->seek_cond);
+    keyframe_index_free(&is->kf_index);
+    avcodec_free_context(&is->audio_ctx);
+    swr_free(&is->audio_swr_ctx);
+    audio_ring_destroy(&is->audio_ring);
+    if (is->audio_ring_sem) {
+        SDL_DestroySemaphore(is->audio_ring_sem);
+    }
+    av_frame_free(&is->audio_frame);
+    av_packet_free(&is->audio_pkt);
+    avformat_close_input(&is->pFormatCtx);
+    av_free(is);
+}
 
-    const char INPUT_FILE[] = "88.mp4";
-    // FFmpeg
-    AVFormatContext *pFormatCtx;
-    const AVCodec *videoCodec;
-    AVCodecContext *videoCodecCtx;
-    AVFrame *pFrame;
-    AVPacket *pkt;
-    int ret;
-    int videoStreamIdx = -1;
-    AVStream *videoStream = nullptr;
-    AVCodecParserContext *parserCtx = nullptr;
+static int stream_close_thread(void *arg) {
+    stream_close((VideoState *) arg);
+    return 0;
+}
 
-    // 打开视频文件
-    if (avformat_open_input(&pFormatCtx, INPUT_FILE, nullptr, nullptr) < 0) {
-        std::cerr << "Error! open input file! " << std::endl;
-        return -1;
+// 从当前显示的位置前进或者后退 incr 秒，交给解复用线程去做；上一次 seek 还没完成时忽略并返回 false
+static bool stream_seek(VideoState *is, double incr) {
+    if (SDL_AtomicGet(&is->seek_req)) {
+        return false;
     }
+    double pos = std::isnan(is->video_current_pts) ? 0 : is->video_current_pts;
+    double start = is->pFormatCtx->start_time != AV_NOPTS_VALUE ?
+                   (double) is->pFormatCtx->start_time / AV_TIME_BASE : 0;
+    pos += incr;
+    if (is->pFormatCtx->duration != AV_NOPTS_VALUE) {
+        pos = FFMIN(pos, start + (double) is->pFormatCtx->duration / AV_TIME_BASE);
+    }
+    pos = FFMAX(pos, start);
+
+    SDL_LockMutex(is->seek_mutex);
+    is->seek_pos = pos;
+    is->seek_pending = 1;
+    is->seek_request_time = monotonic_seconds();
+    SDL_AtomicSet(&is->seek_req, 1);
+    SDL_CondBroadcast(is->seek_cond);
+    SDL_UnlockMutex(is->seek_mutex);
+    return true;
+}
 
-    // 获取文件信息
-    if (avformat_find_stream_info(pFormatCtx, nullptr) < 0) {
-        std::cerr << "find stream info error!" << std::endl;
-        return -1;
+// 改变播放速度：在当前位置原地 seek 一次，新的 serial 开始按新速度解复用和解码
+static void stream_set_speed(VideoState *is, int speed) {
+    speed = av_clip(speed, 1, TRICK_MAX_SPEED);
+    if (speed == is->req_speed) {
+        return;
+    }
+    int old_speed = is->req_speed;
+    is->req_speed = speed;
+    if (!stream_seek(is, 0.0)) {
+        is->req_speed = old_speed;
+        return;
     }
+    // 不是用户发起的 seek，不统计延迟
+    is->seek_pending = 0;
+    printf("speed: %dx%s\n", speed, speed > 1 ? ", keyframes only" : "");
+}
 
-    // 分离视频流
-    videoStreamIdx = av_find_best_stream(pFormatCtx, AVMEDIA_TYPE_VIDEO,
-                                         -1, -1, &videoCodec, 0);
-    if (videoStreamIdx < 0) {
-        std::cerr << "find best video stream error! " << std::endl;
-        return -1;
+// seek 之后的第一帧显示出来了，打印从按键到显示的延迟
+static void seek_report(VideoState *is, double present) {
+    double latency = present - is->seek_request_time;
+    is->seek_pending = 0;
+    is->nb_seeks++;
+    is->max_seek_latency = FFMAX(is->max_seek_latency, latency);
+    printf("seek to %.3f s: keyframe at %.3f s, %d frames decoded before target, latency %.1f ms",
+           is->seek_pos, is->seek_keyframe, is->seek_frames_skipped, latency * 1000);
+    if (SDL_AtomicGet(&is->has_kf_index)) {
+        printf(", max GOP %.3f s", is->kf_index.max_gop * av_q2d(is->kf_index.time_base));
     }
-    parserCtx = av_parser_init(videoCodec->id);
-    videoStream = pFormatCtx->streams[videoStreamIdx];
+    printf("\n");
+}
 
-    videoCodecCtx = avcodec_alloc_context3(videoCodec);
-    if (videoCodecCtx == nullptr) {
-        std::cerr << "alloc context3 error!" << std::endl;
-        return -1;
+// 按 pts 播放，直到播完或者用户退出
+/**
+ * 播放 is 直到最后一帧显示够它的时长，返回这个时刻，播放列表的下一项从这里接上
+ * prev_end 是上一项结束的时刻，第一帧显示时打印切换花了多久，没有上一项时为 NAN
+ */
+static double play_loop(VideoState *is, SDL_Renderer *renderer, SDL_Texture *texture, double prev_end) {
+    SDL_Event event;
+    FrameScheduler sched = {};
+    // 发起 seek 时的 serial，显示出 serial 不同的第一帧时 seek 完成
+    int seek_from_serial = 0;
+
+    // 渲染循环，只处理事件和显示，解码在 decode_video_thread 中进行
+    while (!appQuit) {
+        int timeout_ms = -1;
+        if (!appPause && frame_queue_nb_remaining(&is->pictq) > 0) {
+            Frame *vp = frame_queue_peek(&is->pictq);
+            // seek 之前解码出来的帧
+            if (vp->serial != packet_queue_serial(&is->videoq)) {
+                frame_queue_next(&is->pictq);
+                continue;
+            }
+            double target = scheduler_target(&sched, vp, get_audio_clock(is), is->speed);
+            double remaining = target - monotonic_seconds();
+
+            // 下一帧的显示时刻都已经过了，这一帧不用再上传纹理，直接丢掉
+            if (frame_queue_nb_remaining(&is->pictq) > 1 &&
+                frame_queue_peek_next(&is->pictq)->serial == vp->serial) {
+                Frame *nextvp = frame_queue_peek_next(&is->pictq);
+                double duration = nextvp->pts - vp->pts;
+                if (std::isnan(duration) || duration <= 0 || duration > AV_NOSYNC_THRESHOLD) {
+                    duration = vp->duration;
+                }
+                if (remaining + FFMAX(duration / sched.speed, AV_SYNC_THRESHOLD) < 0) {
+                    is->frame_drops_late++;
+                    frame_queue_next(&is->pictq);
+                    continue;
+                }
+            }
+
+            if (remaining <= SCHED_SPIN_THRESHOLD) {
+                // 先休眠到临近显示时刻，最后一小段自旋，误差控制在 1ms 以内
+                scheduler_spin_until(target);
+                double present = monotonic_seconds();
+                frame_queue_next(&is->pictq);
+                video_display(is, renderer, texture);
+                scheduler_presented(&sched, vp, target, present);
+                latency_histogram_add(&is->latency[LATENCY_FRAME_QUEUE], present - vp->queued_time);
+                latency_histogram_add(&is->latency[LATENCY_PRESENT_ERROR], present - target);
+                is->video_current_pts = vp->pts;
+                if (sched.frames == 1 && !std::isnan(prev_end)) {
+                    printf("playlist switch to %s: first frame %.1f ms after previous item ended\n",
+                           is->filename, (present - prev_end) * 1000);
+                }
+                if (is->seek_pending && vp->serial != seek_from_serial) {
+                    seek_report(is, present);
+                }
+                continue;
+            }
+            timeout_ms = (int) ((remaining - SCHED_SPIN_THRESHOLD) * 1000);
+        } else if (!appPause) {
+            if (SDL_AtomicGet(&is->video_finished) && frame_queue_nb_remaining(&is->pictq) == 0) {
+                // 最后一帧也要显示够它的时长
+                double remaining = sched.frames > 0 ?
+                                   sched.last_target + sched.last_duration / sched.speed - monotonic_seconds() : 0;
+                if (remaining <= 0) {
+                    break;
+                }
+                timeout_ms = (int) (remaining * 1000) + 1;
+            } else {
+                // 解码跟不上，稍后再看
+                is->pictq.nb_underruns++;
+                timeout_ms = SCHED_IDLE_WAIT_MS;
+            }
+        }
+
+        // 暂停时一直阻塞到有事件为止
+        int got_event = timeout_ms < 0 ? SDL_WaitEvent(&event) :
+                        timeout_ms > 0 ? SDL_WaitEventTimeout(&event, timeout_ms) : SDL_PollEvent(&event);
+        if (!got_event) {
+            continue;
+        }
+        if (event.type == SDL_QUIT || event.type == FF_QUIT_EVENT) {
+            appQuit = true;
+        } else if (event.type == SDL_KEYDOWN) {
+            switch (event.key.keysym.sym) {
+                case SDLK_q:
+                    appQuit = true;
+                    break;
+                case SDLK_LEFT:
+                    seek_from_serial = packet_queue_serial(&is->videoq);
+                    stream_seek(is, -10.0);
+                    break;
+                case SDLK_RIGHT:
+                    seek_from_serial = packet_queue_serial(&is->videoq);
+                    stream_seek(is, 10.0);
+                    break;
+                case SDLK_DOWN:
+                    seek_from_serial = packet_queue_serial(&is->videoq);
+                    stream_seek(is, -60.0);
+                    break;
+                case SDLK_UP:
+                    seek_from_serial = packet_queue_serial(&is->videoq);
+                    stream_seek(is, 60.0);
+                    break;
+                case SDLK_RIGHTBRACKET:
+                    stream_set_speed(is, is->req_speed * 2);
+                    break;
+                case SDLK_LEFTBRACKET:
+                    stream_set_speed(is, is->req_speed / 2);
+                    break;
+                case SDLK_s:
+                    latency_dump(is, latencyFile ? latencyFile : LATENCY_DEFAULT_FILE);
+                    break;
+                case SDLK_SPACE:
+                    appPause = !appPause;
+                    scheduler_pause(&sched, appPause);
+                    if (is->audio_st) {
+                        pause_audio_clock(is, appPause);
+                        SDL_PauseAudio(appPause);
+                    }
+                    break;
+            }
+        } else if (event.type == SDL_WINDOWEVENT) {
+            if (event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+                video_display(is, renderer, texture);
+            }
+        }
     }
 
-    // 根据 AVCodecParameters 填充 AVCodecContext
-    if (avcodec_parameters_to_context(videoCodecCtx, videoStream->codecpar) < 0) {
-        std::cerr << "Error: Failed to copy codec parameters to decoder context."
-                  << std::endl;
-        return -1;
+    if (sched.frames > 0) {
+        std::cout << "presented: " << sched.frames
+                  << ", mean error(ms): " << sched.sum_abs_error / sched.frames * 1000
+                  << ", max error(ms): " << sched.max_abs_error * 1000
+                  << ", mean jitter(ms): " << (sched.jitter_samples > 0 ? sched.sum_jitter / sched.jitter_samples * 1000 : 0)
+                  << ", max jitter(ms): " << sched.max_jitter * 1000 << std::endl;
     }
+    return monotonic_seconds();
+}
+
+/**
+ * 跑分：不按时间戳等待，解出一帧就渲染一帧，测的是整条 解复用/解码/队列/渲染 流水线的吞吐
+ * 返回整个文件从打开到渲染完最后一帧的时间
+ */
+static double bench_loop(VideoState *is, SDL_Renderer *renderer, SDL_Texture *texture) {
+    SDL_Event event;
+    double start = monotonic_seconds();
 
-    // 初始化AVCodecContext
-    if (avcodec_open2(videoCodecCtx, videoCodec, nullptr) < 0) {
-        std::cerr << "Error: AVCodec open failed!" << std::endl;
-        exit(-1);
+    while (!appQuit) {
+        if (frame_queue_nb_remaining(&is->pictq) > 0) {
+            Frame *vp = frame_queue_peek(&is->pictq);
+            latency_histogram_add(&is->latency[LATENCY_FRAME_QUEUE], monotonic_seconds() - vp->queued_time);
+            frame_queue_next(&is->pictq);
+            video_display(is, renderer, texture);
+            continue;
+        }
+        if (SDL_AtomicGet(&is->video_finished) && frame_queue_nb_remaining(&is->pictq) == 0) {
+            break;
+        }
+        // 解码跟不上，顺便处理事件
+        double wait_start = monotonic_seconds();
+        is->pictq.nb_underruns++;
+        if (SDL_WaitEventTimeout(&event, 1) && (event.type == SDL_QUIT || event.type == FF_QUIT_EVENT)) {
+            appQuit = true;
+        }
+        is->render_wait_seconds += monotonic_seconds() - wait_start;
     }
+    return monotonic_seconds() - start;
+}
 
-    // 打印文件信息
-    av_dump_format(pFormatCtx, 0, INPUT_FILE, 0);
+static void bench_report(VideoState *is, double elapsed) {
+    int64_t frames = is->pictq.nb_pushed;
+    int64_t uploads = is->nb_uploads;
+    printf("bench %s: %" PRId64 " frames in %.3f s, %.1f fps overall, %.1f fps decode\n",
+           is->filename, frames, elapsed,
+           elapsed > 0 ? frames / elapsed : 0,
+           is->decode_seconds > 0 ? frames / is->decode_seconds : 0);
+    printf("  decoder wait packet: %.1f ms, decoder wait frame queue: %.1f ms, render wait frame: %.1f ms\n",
+           is->wait_packet_seconds * 1000, is->wait_frame_seconds * 1000, is->render_wait_seconds * 1000);
+    printf("  texture upload: %.1f ms total, %.3f ms/frame, dropped early: %" PRId64 ", dropped late: %" PRId64 "\n",
+           is->upload_seconds * 1000, uploads > 0 ? is->upload_seconds * 1000 / uploads : 0,
+           is->frame_drops_early, is->frame_drops_late);
+}
 
-    pkt = av_packet_alloc();
-    pFrame = av_frame_alloc();
-    if (pkt == nullptr || pFrame == nullptr) {
-        std::cerr << "Error! pkt or pFrame alloc failed!" << std::endl;
-        exit(-1);
+// 马赛克中的一路：各自按 pts 调度，统计一个报告周期内显示的帧数
+typedef struct MosaicTile {
+    VideoState *is;
+    FrameScheduler sched;
+    SDL_Rect rect;
+    int64_t report_frames;
+    bool done;
+    // 不循环播放时这一路放完的时刻
+    double end_time;
+} MosaicTile;
+
+// 把一个格子到点的帧上传到纹理，过了下一帧显示时刻的帧丢掉，返回是否上传了新帧
+static bool mosaic_update_tile(MosaicTile *tile, SDL_Texture *texture, double now, double *next_wake) {
+    VideoState *is = tile->is;
+    while (frame_queue_nb_remaining(&is->pictq) > 0) {
+        Frame *vp = frame_queue_peek(&is->pictq);
+        if (vp->serial != packet_queue_serial(&is->videoq)) {
+            frame_queue_next(&is->pictq);
+            continue;
+        }
+        double target = scheduler_target(&tile->sched, vp, NAN, 1);
+        if (target > now + SCHED_SPIN_THRESHOLD) {
+            *next_wake = FFMIN(*next_wake, target);
+            return false;
+        }
+        if (frame_queue_nb_remaining(&is->pictq) > 1 && target + vp->duration < now) {
+            is->frame_drops_late++;
+            frame_queue_next(&is->pictq);
+            continue;
+        }
+        frame_queue_next(&is->pictq);
+        AVFrame *frame = frame_queue_peek_last(&is->pictq)->frame;
+        double upload_start = monotonic_seconds();
+        SDL_UpdateYUVTexture(texture, &tile->rect,
+                             frame->data[0], frame->linesize[0],
+                             frame->data[1], frame->linesize[1],
+                             frame->data[2], frame->linesize[2]);
+        double upload_time = monotonic_seconds() - upload_start;
+        is->upload_seconds += upload_time;
+        is->nb_uploads++;
+        scheduler_presented(&tile->sched, vp, target, now);
+        latency_histogram_add(&is->latency[LATENCY_FRAME_QUEUE], now - vp->queued_time);
+        latency_histogram_add(&is->latency[LATENCY_UPLOAD], upload_time);
+        latency_histogram_add(&is->latency[LATENCY_PRESENT_ERROR], now - target);
+        is->video_current_pts = vp->pts;
+        tile->report_frames++;
+        return true;
+    }
+    // 放完了：循环播放时回到开头，不然这一格停在最后一帧
+    if (SDL_AtomicGet(&is->video_finished) && tile->sched.last_serial == packet_queue_serial(&is->videoq)) {
+        if (loopPlaylist) {
+            stream_seek(is, std::isnan(is->video_current_pts) ? 0 : -is->video_current_pts);
+        } else {
+            tile->done = true;
+            tile->end_time = now;
+        }
+    } else {
+        is->pictq.nb_underruns++;
     }
+    return false;
+}
 
-    /**
-     * 展示SDL窗口
-     */
+// 一个报告周期内有多少路的显示帧率达到了原始帧率
+static void mosaic_report(std::vector<MosaicTile> &tiles, double elapsed) {
+    int active = 0, full = 0;
+    double min_fps = INFINITY;
+    for (MosaicTile &tile: tiles) {
+        if (tile.done) {
+            continue;
+        }
+        double fps = tile.report_frames / elapsed;
+        active++;
+        if (fps >= MOSAIC_FULL_RATE / tile.is->frame_interval) {
+            full++;
+        }
+        min_fps = FFMIN(min_fps, fps);
+        tile.report_frames = 0;
+    }
+    if (active > 0) {
+        printf("mosaic: %d/%d streams at full frame rate, slowest %.1f fps\n", full, active, min_fps);
+    }
+}
 
-    int screen_w = videoStream->codecpar->width;
-    int screen_h = videoStream->codecpar->height;
+/**
+ * 马赛克的渲染循环：每一轮把所有到点的格子上传到同一张纹理，有更新时 present 一次，
+ * 然后睡到最早的一个格子的下一帧
+ */
+static void mosaic_loop(std::vector<MosaicTile> &tiles, SDL_Renderer *renderer, SDL_Texture *texture) {
+    SDL_Event event;
+    double report_start = monotonic_seconds();
 
-    delayMs = (uint32_t)(1000.0 / av_q2d(videoStream->avg_frame_rate));
+    while (!appQuit) {
+        double now = monotonic_seconds();
+        double next_wake = now + SCHED_IDLE_WAIT_MS / 1000.0;
+        bool updated = false;
+        int active = 0;
+        if (!appPause) {
+            for (MosaicTile &tile: tiles) {
+                if (!tile.done) {
+                    updated |= mosaic_update_tile(&tile, texture, now, &next_wake);
+                    active += !tile.done;
+                }
+            }
+            if (active == 0) {
+                break;
+            }
+        }
+        if (updated) {
+            SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+            SDL_RenderPresent(renderer);
+        }
+        if (!appPause && now - report_start >= MOSAIC_REPORT_INTERVAL) {
+            mosaic_report(tiles, now - report_start);
+            report_start = now;
+        }
 
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
-        return -1;
+        // 暂停时一直阻塞到有事件为止
+        int timeout_ms = (int) ((next_wake - monotonic_seconds() - SCHED_SPIN_THRESHOLD) * 1000);
+        int got_event = appPause ? SDL_WaitEvent(&event) :
+                        timeout_ms > 0 ? SDL_WaitEventTimeout(&event, timeout_ms) : SDL_PollEvent(&event);
+        if (!got_event) {
+            continue;
+        }
+        if (event.type == SDL_QUIT || event.type == FF_QUIT_EVENT ||
+            (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_q)) {
+            appQuit = true;
+        } else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_s) {
+            for (MosaicTile &tile: tiles) {
+                latency_dump(tile.is, latencyFile ? latencyFile : LATENCY_DEFAULT_FILE);
+            }
+        } else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_SPACE) {
+            appPause = !appPause;
+            for (MosaicTile &tile: tiles) {
+                scheduler_pause(&tile.sched, appPause);
+            }
+            if (!appPause) {
+                report_start = monotonic_seconds();
+            }
+        } else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+            SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+            SDL_RenderPresent(renderer);
+        }
     }
+}
 
-    SDL_Window *window = SDL_CreateWindow("Blank Window", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-                                          screen_w, screen_h, SDL_WINDOW_SHOWN);
+/**
+ * 马赛克模式：mosaicCols x mosaicRows 个格子，文件按顺序循环填满，所有格子同时打开、同时播放
+ * 退出时打印每一路的平均显示帧率和丢帧，以及有多少路跑满了原始帧率
+ */
+static int mosaic_main(std::vector<const char *> &files) {
+    int n = mosaicCols * mosaicRows;
+    std::vector<MosaicTile> tiles;
+    for (int i = 0; i < n; i++) {
+        MosaicTile tile = {};
+        tile.is = stream_open(files[i % files.size()]);
+        if (tile.is == nullptr) {
+            break;
+        }
+        tile.rect = {(i % mosaicCols) * mosaicTileW, (i / mosaicCols) * mosaicTileH, mosaicTileW, mosaicTileH};
+        tiles.push_back(tile);
+    }
+    // 所有格子并行打开，这里依次等它们都准备好，打不开的格子留黑
+    double open_start = monotonic_seconds();
+    for (MosaicTile &tile: tiles) {
+        if (stream_wait_ready(tile.is) < 0) {
+            tile.done = true;
+        }
+    }
+    printf("mosaic: %zu streams opened in %.1f ms\n", tiles.size(), (monotonic_seconds() - open_start) * 1000);
+
+    int ret = 0;
+    SDL_Window *window = SDL_CreateWindow("Mosaic", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                          mosaicCols * mosaicTileW, mosaicRows * mosaicTileH,
+                                          benchMode ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN);
+    SDL_Renderer *renderer = window ? SDL_CreateRenderer(window, -1, benchMode ? SDL_RENDERER_SOFTWARE :
+                                                                     SDL_RENDERER_ACCELERATED) : nullptr;
+    SDL_Texture *texture = renderer ? SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING,
+                                                        mosaicCols * mosaicTileW, mosaicRows * mosaicTileH) : nullptr;
+    if (texture == nullptr) {
+        printf("Mosaic window could not be created! SDL_Error: %s\n", SDL_GetError());
+        ret = -1;
+    } else {
+        double start = monotonic_seconds();
+        mosaic_loop(tiles, renderer, texture);
+        double stop = monotonic_seconds();
+
+        int full = 0, playing = 0;
+        for (MosaicTile &tile: tiles) {
+            VideoState *is = tile.is;
+            if (is->ready < 0) {
+                continue;
+            }
+            double elapsed = (tile.done ? tile.end_time : stop) - start;
+            double fps = elapsed > 0 ? tile.sched.frames / elapsed : 0;
+            double nominal = 1.0 / is->frame_interval;
+            playing++;
+            full += fps >= MOSAIC_FULL_RATE * nominal;
+            printf("  %s: %.1f/%.1f fps, presented %" PRId64 ", dropped late %" PRId64 ", underruns %" PRId64
+                   ", max error %.1f ms\n", is->filename, fps, nominal, tile.sched.frames, is->frame_drops_late,
+                   is->pictq.nb_underruns, tile.sched.max_abs_error * 1000);
+        }
+        printf("mosaic %dx%d: %d/%d streams sustained full frame rate over %.1f s\n",
+               mosaicCols, mosaicRows, full, playing, stop - start);
+    }
 
-    if (window == nullptr) {
-        printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
-        return -1;
+    for (MosaicTile &tile: tiles) {
+        stream_close(tile.is);
     }
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    return ret;
+}
 
-    auto renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+int main(int argc, char *args[]) {
+//    exit(0);
 
-    if (renderer == nullptr) {
-        printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
-        return -1;
+    // 可以在命令行指定输入文件，比如测试帧间隔抖动用的 77-3s.mp4
+    const char *INPUT_FILE = "88.mp4";
+    appStartTime = monotonic_seconds();
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(args[i], "--bench") == 0) {
+            benchMode = true;
+        } else if (strcmp(args[i], "--no-degrade") == 0) {
+            degradeEnabled = false;
+        } else if (strcmp(args[i], "--loop") == 0) {
+            loopPlaylist = true;
+        } else if (strcmp(args[i], "--no-probe-cache") == 0) {
+            probeCache = false;
+        } else if (strcmp(args[i], "--latency") == 0 && i + 1 < argc) {
+            latencyFile = args[++i];
+        } else if (strcmp(args[i], "--mosaic") == 0 && i + 1 < argc) {
+            if (sscanf(args[++i], "%dx%d", &mosaicCols, &mosaicRows) != 2 || mosaicCols <= 0 || mosaicRows <= 0) {
+                fprintf(stderr, "--mosaic expects COLSxROWS, for example 4x4\n");
+                return -1;
+            }
+        } else {
+            files.push_back(args[i]);
+        }
+    }
+    if (files.empty()) {
+        if (benchMode || mosaicCols > 0) {
+            files = {"88.mp4", "77-1s.mp4", "77-3s.mp4"};
+        } else {
+            files.push_back(INPUT_FILE);
+        }
     }
-    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV,
-                                                             SDL_TEXTUREACCESS_STREAMING, screen_w, screen_h);
 
-    // 开启独立线程发送refresh event
-    SDL_Thread *refresh_thread = SDL_CreateThread(refresh_video, nullptr, nullptr);
-    SDL_Event event;
+    if (benchMode) {
+        // 没有显示器和声卡也能跑
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+        SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+    }
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) < 0) {
+        printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
+        return -1;
+    }
 
-    std::chrono::high_resolution_clock::time_point start, end1, end2;
-    start=end1=end2 = std::chrono::high_resolution_clock::now();
+    if (mosaicCols > 0) {
+        // YUV420P 的格子宽高都要是偶数
+        mosaicTileW = FFMAX(MOSAIC_WIDTH / mosaicCols / 2 * 2, 2);
+        mosaicTileH = FFMAX(mosaicTileW * 9 / 16 / 2 * 2, 2);
+        int ret = mosaic_main(files);
+        SDL_Quit();
+        return ret;
+    }
 
-    // 读取文件中的下一个packet，保存到pkt中，pkt引用计数+1，需要av_packet_unref释放
-    // 使用合适的编解码器解码packet为frame，保存到文件
-    while (av_read_frame(pFormatCtx, pkt) >= 0 && !appQuit) {
-        if (pkt->stream_index != videoStreamIdx) continue;
+    // 窗口和渲染器整个播放列表共用，视频尺寸变了只重建纹理
+    SDL_Window *window = nullptr;
+    SDL_Renderer *renderer = nullptr;
+    SDL_Texture *texture = nullptr;
+    int screen_w = 0, screen_h = 0;
+    // 上一项在后台线程里关闭，不占用切换的时间
+    SDL_Thread *close_tid = nullptr;
+    double prev_end = NAN;
+
+    size_t index = 0;
+    // 连续打不开的文件数，循环播放时全部都打不开就退出
+    size_t failures = 0;
+    VideoState *next = stream_open(files[index]);
+    while (next != nullptr && !appQuit) {
+        VideoState *is = next;
+        next = nullptr;
+        size_t next_index = index + 1;
+        if (next_index == files.size() && loopPlaylist && !benchMode) {
+            next_index = 0;
+        }
 
-        // 将packet送入解码器，由于B帧的存在，送入packet后可能无法解码，此时receive_frame返回AVERROR(EAGAIN)
-        // 应当再送入packet，之后从解码器可能取出多个frame，直到AVERROR_EOF或是AVERROR(EAGAIN)
-        ret = avcodec_send_packet(videoCodecCtx, pkt);
-        if (ret < 0) {
-            std::cerr << "Error! decode packet failed!" << std::endl;
-            exit(-1);
-        }
-        while (!appQuit) {
-            // 帧率很不稳定，加载大画面很卡
-            ret = avcodec_receive_frame(videoCodecCtx, pFrame);
-            if (ret < 0) {
-                if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) break;
-                else {
-                    std::cerr << "receive_frame return " << ret << std::endl;
-                    return -1;
-                }
+        if (stream_wait_ready(is) < 0) {
+            // 打不开的文件跳过，后面的照常播放
+            stream_close(is);
+            if (next_index < files.size() && ++failures < files.size()) {
+                index = next_index;
+                next = stream_open(files[index]);
             }
+            continue;
+        }
 
-            SDL_WaitEvent(&event);
-            if (event.type == SDL_KEYDOWN) {
-                switch (event.key.keysym.sym) {
-                    case SDLK_q:
-                        appQuit = true;
-                        exit(0);
-                        break;
-                    case SDLK_SPACE:
-                        appPause = !appPause;
-                        break;
-                }
-            } else if (event.type == REFRESH_EVENT) { // 刷新画面
-                SDL_UpdateYUVTexture(texture, nullptr,
-                                     pFrame->data[0], pFrame->linesize[0],
-                                     pFrame->data[1], pFrame->linesize[1],
-                                     pFrame->data[2], pFrame->linesize[2]);
-                SDL_RenderClear(renderer);
-                SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-                SDL_RenderPresent(renderer);
-                end1 = end2;
-                end2 = std::chrono::high_resolution_clock::now();
-                auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end2 - end1);
-                auto nowTime = std::chrono::duration_cast<std::chrono::milliseconds>(end2 - start);
+        /**
+         * 展示SDL窗口
+         */
 
-                std::cout << "pts: " << pFrame->pts << ", now time: " << nowTime.count() << ", duration: " << duration.count() << std::endl;
+        if (window == nullptr) {
+            screen_w = is->video_ctx->width;
+            screen_h = is->video_ctx->height;
+            window = SDL_CreateWindow("Blank Window", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                                      screen_w, screen_h, benchMode ? SDL_WINDOW_HIDDEN : SDL_WINDOW_SHOWN);
 
+            if (window == nullptr) {
+                printf("Window could not be created! SDL_Error: %s\n", SDL_GetError());
+                return -1;
             }
 
+            renderer = SDL_CreateRenderer(window, -1, benchMode ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED);
 
-            av_frame_unref(pFrame);
+            if (renderer == nullptr) {
+                printf("Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
+                return -1;
+            }
+        } else if (is->video_ctx->width != screen_w || is->video_ctx->height != screen_h) {
+            screen_w = is->video_ctx->width;
+            screen_h = is->video_ctx->height;
+            SDL_DestroyTexture(texture);
+            texture = nullptr;
+            SDL_SetWindowSize(window, screen_w, screen_h);
+        }
+        if (texture == nullptr) {
+            texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV,
+                                        SDL_TEXTUREACCESS_STREAMING, screen_w, screen_h);
         }
-        av_packet_unref(pkt);
-    }
 
+        failures = 0;
+        stream_activate(is);
+        // 跑分时一个一个文件测，不预先打开
+        if (!benchMode && next_index < files.size()) {
+            index = next_index;
+            next = stream_open(files[index]);
+        }
+
+        if (benchMode) {
+            double elapsed = bench_loop(is, renderer, texture);
+            bench_report(is, elapsed);
+            stream_close(is);
+            if (next_index < files.size()) {
+                index = next_index;
+                next = stream_open(files[index]);
+            }
+        } else {
+            prev_end = play_loop(is, renderer, texture, prev_end);
+            SDL_WaitThread(close_tid, nullptr);
+            close_tid = SDL_CreateThread(stream_close_thread, "stream_close", is);
+        }
+    }
+    if (next != nullptr) {
+        // 中途退出，预先打开的下一项还没播放
+        stream_close(next);
+    }
+    SDL_WaitThread(close_tid, nullptr);
+    if (audioDeviceOpen) {
+        SDL_CloseAudio();
+    }
+    if (window == nullptr) {
+        // 一个文件都没能打开
+        SDL_Quit();
+        return -1;
+    }
 
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
-
-    av_packet_free(&pkt);
-    av_frame_free(&pFrame);
     return 0;
 }
-
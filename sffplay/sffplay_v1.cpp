@@ -17,6 +17,8 @@ extern "C" {
 
 #include <SDL.h>
 
+#include "probe_cache.h"
+
 #include <iostream>
 #include <chrono>
 
@@ -58,17 +60,16 @@ int main(int argc, char *args[]) {
     AVStream *videoStream = nullptr;
     AVCodecParserContext *parserCtx = nullptr;
 
-    // 打开视频文件
-    if (avformat_open_input(&pFormatCtx, INPUT_FILE, nullptr, nullptr) < 0) {
+    // 打开视频文件，获取文件信息，命中探测缓存时不用再调用 avformat_find_stream_info
+    auto open_start = std::chrono::steady_clock::now();
+    int probe_hit;
+    if (probe_cache_open_input(&pFormatCtx, INPUT_FILE, nullptr, 1, &probe_hit) < 0) {
         std::cerr << "Error! open input file! " << std::endl;
         return -1;
     }
-
-    // 获取文件信息
-    if (avformat_find_stream_info(pFormatCtx, nullptr) < 0) {
-        std::cerr << "find stream info error!" << std::endl;
-        return -1;
-    }
+    std::cout << "open " << INPUT_FILE << ": "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - open_start).count()
+              << " ms, probe cache " << (probe_hit ? "hit" : "miss") << std::endl;
 
     // 分离视频流
     videoStreamIdx = av_find_best_stream(pFormatCtx, AVMEDIA_TYPE_VIDEO,
@@ -6,8 +6,9 @@
  * 简单的视频播放器，只能解码播放视频，不能播放音频，没有倍速和快进快退
  * 读取packet后解码成frame，使用frame->data的YUV数据更新 texture
  * 使用read_thread()解封装获取AVPacket放入PacketQueue
- * TODO：
  * 使用video_thread()从PacketQueue获取AVPacket解码成AVFrame放入FrameQueue
+ * 主线程收到刷新事件时从FrameQueue取出一帧显示，解码可以领先显示若干帧，
+ * 解码和渲染的耗时抖动都由FrameQueue吸收
  */
 
 extern "C" {
@@ -17,31 +18,14 @@ extern "C" {
 
 #include <SDL.h>
 
+#include "frame_queue.h"
+#include "packet_queue.h"
+#include "probe_cache.h"
+
 #include <iostream>
 #include <chrono>
-#include <libavutil/fifo.h>
-#define FRAME_QUEUE_MAX_SIZE 32
-
-typedef struct PacketQueue {
-    AVPacketList *first_pkt, *last_pkt;
-    int nb_packets;
-    int size;
-    SDL_mutex *mutex;
-    SDL_cond *cond;
-} PacketQueue;
-
-/**
- * AVFrame并不直接包含数据，而是包含使用data指针指向数据，所有可以用
- * 一个环形队列表示，循环利用AVFrame，更新环形队列指针
- */
-typedef struct FrameQueue {
-    AVFrame frames[FRAME_QUEUE_MAX_SIZE];
-    int rindex;  // read index
-    int windex;  // write index
-    int size;
-    SDL_mutex *mutex;
-    SDL_cond *cond;
-} FrameQueue;
+#include <cmath>
+#define VIDEO_PICTURE_QUEUE_SIZE 8
 
 /**
  * 主要视频文件数据结构
@@ -49,9 +33,10 @@ typedef struct FrameQueue {
 typedef struct VideoState {
     char filename[1024];
     AVFormatContext *pFormatCtx;
-    bool quit=false; SDL_mutex *pictq_mutex;
+    bool quit=false;
+    // 1 表示视频流和解码器已经打开，-1 表示打开失败
+    int ready=0;
 
-    SDL_cond *pictq_cond;
     SDL_Thread *parse_tid;
     SDL_Thread *video_tid;
 
@@ -61,8 +46,9 @@ typedef struct VideoState {
     AVStream *videoSt;
     AVCodecContext *videoCodecCtx;
     PacketQueue videoq;
-
-
+    FrameQueue pictq;
+    // 解码线程已经把所有帧都放进 pictq
+    SDL_atomic_t video_finished;
 
 }VideoState;
 
@@ -71,6 +57,8 @@ typedef struct VideoState {
 #define BREAK_EVENT  (SDL_USEREVENT + 2)
 
 static int MAX_VIDEOQ_SIZE = 5 * 256 * 1024;
+// videoq 最多缓存的时长，单位秒
+static double MAX_VIDEOQ_DURATION = 2.0;
 static VideoState *global_video_state;
 static bool appQuit = false;
 static bool appPause = false;
@@ -91,91 +79,12 @@ int refresh_video(void *opaque) {
     return 0;
 }
 
-/**
- * 初始化FrameQueue
- */
-int frame_queue_init() {
-
-}
-
-int frame_queue_put() {
-
-}
-
-int frame_queue_get() {
-
-}
-
-//// 初始化队列
-void packet_queue_init(PacketQueue *q) {
-    memset(q, 0, sizeof(PacketQueue));
-    q->mutex = SDL_CreateMutex();
-    q->cond = SDL_CreateCond();
-}
-
-int packet_queue_put(PacketQueue *q, AVPacket *pkt) {
-
-    AVPacketList *pkt1;
-    if (pkt!= nullptr && av_packet_make_refcounted(pkt) < 0) {
-        return -1;
-    }
-    pkt1 = (AVPacketList*)av_malloc(sizeof(AVPacketList));
-    if (!pkt1)
-        return -1;
-    pkt1->pkt = *pkt;
-    pkt1->next = NULL;
-
-    SDL_LockMutex(q->mutex);
-
-    if (!q->last_pkt)
-        q->first_pkt = pkt1;
-    else
-        q->last_pkt->next = pkt1;
-    q->last_pkt = pkt1;
-    q->nb_packets++;
-    q->size += pkt1->pkt.size;
-    SDL_CondSignal(q->cond);
-    SDL_UnlockMutex(q->mutex);
-    return 0;
-}
-
-int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block) {
-    AVPacketList *pkt1;
-    int ret;
-
-    SDL_LockMutex(q->mutex);
-
-    for (;;) {
-
-        if (global_video_state->quit) {
-            ret = -1;
-            break;
-        }
-
-        pkt1 = q->first_pkt;
-        if (pkt1) {
-            q->first_pkt = pkt1->next;
-            if (!q->first_pkt)
-                q->last_pkt = NULL;
-            q->nb_packets--;
-            q->size -= pkt1->pkt.size;
-            *pkt = pkt1->pkt;
-            av_free(pkt1);
-            ret = 1;
-            break;
-        } else if (!block) {
-            ret = 0;
-            break;
-        } else {
-            std::cout << "cond1, ";
-            if (SDL_CondWaitTimeout(q->cond, q->mutex, 200) == SDL_MUTEX_TIMEDOUT) {
-                return -2;
-            }
-            std::cout << "cond2 ";
-        }
-    }
-    SDL_UnlockMutex(q->mutex);
-    return ret;
+// 打开视频流之后通知主线程创建窗口
+static void notify_ready(VideoState *is, int ready) {
+    SDL_LockMutex(read_mtx);
+    is->ready = ready;
+    SDL_CondSignal(read_cond);
+    SDL_UnlockMutex(read_mtx);
 }
 
 
@@ -187,17 +96,17 @@ int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block) {
 int read_thread(void* arg) {
     auto is = (VideoState*) arg;
 
-    // 打开视频文件
-    if (avformat_open_input(&is->pFormatCtx, is->filename, nullptr, nullptr) < 0) {
+    // 打开视频文件，获取文件信息，命中探测缓存时不用再调用 avformat_find_stream_info
+    auto open_start = std::chrono::steady_clock::now();
+    int probe_hit;
+    if (probe_cache_open_input(&is->pFormatCtx, is->filename, nullptr, 1, &probe_hit) < 0) {
         std::cerr << "Error! open input file! " << std::endl;
+        notify_ready(is, -1);
         return -1;
     }
-
-    // 获取文件信息
-    if (avformat_find_stream_info(is->pFormatCtx, nullptr) < 0) {
-        std::cerr << "find stream info error!" << std::endl;
-        return -1;
-    }
+    std::cout << "open " << is->filename << ": "
+              << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - open_start).count()
+              << " ms, probe cache " << (probe_hit ? "hit" : "miss") << std::endl;
 
     const AVCodec *videoCodec;
     // 分离视频流
@@ -205,6 +114,7 @@ int read_thread(void* arg) {
                                          -1, -1, &videoCodec, 0);
     if (is->videoStreamIdx < 0) {
         std::cerr << "find best video stream error! " << std::endl;
+        notify_ready(is, -1);
         return -1;
     }
     auto parserCtx = av_parser_init(videoCodec->id);
@@ -213,20 +123,19 @@ int read_thread(void* arg) {
     is->videoCodecCtx = avcodec_alloc_context3(videoCodec);
     if (is->videoCodecCtx == nullptr) {
         std::cerr << "alloc context3 error!" << std::endl;
+        notify_ready(is, -1);
         return -1;
     }
     // 获取视频信息
     screen_w = is->videoSt->codecpar->width;
     screen_h = is->videoSt->codecpar->height;
     delayMs = (uint32_t)(1000.0 / av_q2d(is->videoSt->avg_frame_rate));
-    SDL_LockMutex(read_mtx);
-    SDL_CondSignal(read_cond);
-    SDL_UnlockMutex(read_mtx);
 
     // 根据 AVCodecParameters 填充 AVCodecContext
     if (avcodec_parameters_to_context(is->videoCodecCtx, is->videoSt->codecpar) < 0) {
         std::cerr << "Error: Failed to copy codec parameters to decoder context."
                   << std::endl;
+        notify_ready(is, -1);
         return -1;
     }
 
@@ -239,12 +148,18 @@ int read_thread(void* arg) {
     // 打印文件信息
     av_dump_format(is->pFormatCtx, 0, is->filename, 0);
 
+    // 解码器打开之后主线程才能创建解码线程
+    notify_ready(is, 1);
+
     auto pkt = av_packet_alloc();
 
+    // 超过字节数或者时长上限时，packet_queue_wait_space 一直睡到解码线程取走 packet
+    packet_queue_set_limits(&is->videoq, MAX_VIDEOQ_SIZE,
+                            (int64_t) (MAX_VIDEOQ_DURATION / av_q2d(is->videoSt->time_base)));
+
     while (!appQuit) {
-        if (is->videoq.size >= MAX_VIDEOQ_SIZE) {
-            SDL_Delay(10);
-            continue;
+        if (packet_queue_wait_space(&is->videoq) < 0) {
+            break;
         }
 
         if (int ret = av_read_frame(is->pFormatCtx, pkt) < 0) {
@@ -256,9 +171,81 @@ int read_thread(void* arg) {
             av_packet_unref(pkt);
         }
     }
+    // 读完了，videoq 取空之后 packet_queue_get 返回 -1，播放循环随之结束
+    packet_queue_finish(&is->videoq);
+    av_packet_free(&pkt);
     return 0;
 }
 
+/**
+ * 解码线程
+ * 从 videoq 取 AVPacket 解码，解出的 AVFrame 放入 pictq，pictq 满时阻塞，
+ * 这样解码最多领先显示 pictq.max_size 帧
+ */
+int video_thread(void *arg) {
+    auto is = (VideoState *) arg;
+    AVPacket *pkt = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    AVRational tb = is->videoSt->time_base;
+    AVRational frame_rate = av_guess_frame_rate(is->pFormatCtx, is->videoSt, nullptr);
+    double duration = (frame_rate.num && frame_rate.den) ? av_q2d((AVRational) {frame_rate.den, frame_rate.num}) : 0;
+    int ret;
+
+    while (pkt && frame) {
+        ret = packet_queue_get(&is->videoq, pkt, 1);
+        if (ret < 0 && SDL_AtomicGet(&is->videoq.abort_request)) {
+            break;
+        }
+        // 读完之后送入 nullptr，把解码器里缓存的帧都取出来
+        // 将packet送入解码器，由于B帧的存在，送入packet后可能无法解码，此时receive_frame返回AVERROR(EAGAIN)
+        ret = avcodec_send_packet(is->videoCodecCtx, ret < 0 ? nullptr : pkt);
+        av_packet_unref(pkt);
+        if (ret < 0 && ret != AVERROR_EOF) {
+            std::cerr << "Error! decode packet failed!" << std::endl;
+            break;
+        }
+
+        while ((ret = avcodec_receive_frame(is->videoCodecCtx, frame)) >= 0) {
+            Frame *vp = frame_queue_peek_writable(&is->pictq);
+            if (vp == nullptr) {
+                av_frame_unref(frame);
+                goto end;
+            }
+            vp->pts = frame->best_effort_timestamp == AV_NOPTS_VALUE ? NAN : frame->best_effort_timestamp * av_q2d(tb);
+            vp->duration = duration;
+            av_frame_move_ref(vp->frame, frame);
+            frame_queue_push(&is->pictq);
+        }
+        if (ret == AVERROR_EOF) {
+            break;
+        } else if (ret != AVERROR(EAGAIN)) {
+            std::cerr << "receive_frame return " << ret << std::endl;
+            break;
+        }
+    }
+
+    end:
+    SDL_AtomicSet(&is->video_finished, 1);
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    return 0;
+}
+
+// 显示上一次 frame_queue_next 之后的帧，也就是 peek_last
+static void video_display(VideoState *is, SDL_Renderer *renderer, SDL_Texture *texture) {
+    Frame *vp = frame_queue_peek_last(&is->pictq);
+    if (!is->pictq.rindex_shown || !vp->frame->data[0]) {
+        return;
+    }
+    SDL_UpdateYUVTexture(texture, nullptr,
+                         vp->frame->data[0], vp->frame->linesize[0],
+                         vp->frame->data[1], vp->frame->linesize[1],
+                         vp->frame->data[2], vp->frame->linesize[2]);
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+    SDL_RenderPresent(renderer);
+}
+
 int main(int argc, char *args[]) {
 
     const char INPUT_FILE[] = "88.mp4";
@@ -270,21 +257,24 @@ int main(int argc, char *args[]) {
 
     // 创建解复用线程
     packet_queue_init(&is->videoq);
+    if (frame_queue_init(&is->pictq, VIDEO_PICTURE_QUEUE_SIZE, 1) < 0) {
+        std::cerr << "Error! frame queue init failed!" << std::endl;
+        return -1;
+    }
+    SDL_AtomicSet(&is->video_finished, 0);
     is->parse_tid = SDL_CreateThread(read_thread, "read_thread", is);
 
-    // FFmpeg
-    AVFrame *pFrame;
-    AVPacket *pkt;
-    int ret;
-
-    pFrame = av_frame_alloc();
-    pkt = av_packet_alloc();
-
-
-    // 等待读取视频的宽高和帧率
+    // 等待读取视频的宽高和帧率，并打开解码器
     SDL_LockMutex(read_mtx);
-    SDL_CondWait(read_cond, read_mtx);
+    while (is->ready == 0) {
+        SDL_CondWait(read_cond, read_mtx);
+    }
     SDL_UnlockMutex(read_mtx);
+    if (is->ready < 0) {
+        return -1;
+    }
+    is->video_tid = SDL_CreateThread(video_thread, "video_thread", is);
+
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         printf("SDL could not initialize! SDL_Error: %s\n", SDL_GetError());
         return -1;
@@ -314,80 +304,71 @@ int main(int argc, char *args[]) {
     std::chrono::high_resolution_clock::time_point start, end1, end2;
     start=end1=end2 = std::chrono::high_resolution_clock::now();
 
-    // 读取文件中的下一个packet，保存到pkt中，pkt引用计数+1，需要av_packet_unref释放
-    // 使用合适的编解码器解码packet为frame，保存到文件
     while (!appQuit) {
-        // 从队列获取packet
-
-        if (packet_queue_get(&is->videoq, pkt, 1) < 0) {
-            break;
-        }
-        std::cout << "pkt == nullptr " << int(pkt==nullptr) << std::endl;
-        if (pkt == nullptr) break;
-
-        // 将packet送入解码器，由于B帧的存在，送入packet后可能无法解码，此时receive_frame返回AVERROR(EAGAIN)
-        // 应当再送入packet，之后从解码器可能取出多个frame，直到AVERROR_EOF或是AVERROR(EAGAIN)
-        ret = avcodec_send_packet(is->videoCodecCtx, pkt);
-        if (ret < 0) {
-            std::cerr << "Error! decode packet failed!" << std::endl;
-            exit(-1);
-        }
-        while (!appQuit) {
-            // 帧率很不稳定，加载大画面很卡
-            ret = avcodec_receive_frame(is->videoCodecCtx, pFrame);
-            if (ret < 0) {
-                if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) break;
-                else {
-                    std::cerr << "receive_frame return " << ret << std::endl;
-                    return -1;
-                }
+        SDL_WaitEvent(&event);
+        if (event.type == SDL_QUIT) {
+            appQuit = true;
+        } else if (event.type == SDL_KEYDOWN) {
+            switch (event.key.keysym.sym) {
+                case SDLK_q:
+                    appQuit = true;
+                    break;
+                case SDLK_SPACE:
+                    appPause = !appPause;
+                    break;
             }
-
-            SDL_WaitEvent(&event);
-            if (event.type == SDL_KEYDOWN) {
-                switch (event.key.keysym.sym) {
-                    case SDLK_q:
-                        appQuit = true;
-                        exit(0);
-                        break;
-                    case SDLK_SPACE:
-                        appPause = !appPause;
-                        break;
+        } else if (event.type == SDL_WINDOWEVENT) {
+            // 窗口被遮挡或者改变大小后重画最后一帧，暂停时也能正常显示
+            if (event.window.event == SDL_WINDOWEVENT_EXPOSED ||
+                event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                video_display(is, renderer, texture);
+            }
+        } else if (event.type == REFRESH_EVENT) { // 刷新画面
+            if (frame_queue_nb_remaining(&is->pictq) == 0) {
+                if (SDL_AtomicGet(&is->video_finished)) {
+                    // 所有帧都显示完了
+                    appQuit = true;
+                } else {
+                    // 解码跟不上，保留上一帧
+                    is->pictq.nb_underruns++;
                 }
-            } else if (event.type == REFRESH_EVENT) { // 刷新画面
-                SDL_UpdateYUVTexture(texture, nullptr,
-                                     pFrame->data[0], pFrame->linesize[0],
-                                     pFrame->data[1], pFrame->linesize[1],
-                                     pFrame->data[2], pFrame->linesize[2]);
-                SDL_RenderClear(renderer);
-                SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-                SDL_RenderPresent(renderer);
-                end1 = end2;
-                end2 = std::chrono::high_resolution_clock::now();
-                auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end2 - end1);
-                auto nowTime = std::chrono::duration_cast<std::chrono::milliseconds>(end2 - start);
-
-                std::cout << "pts: " << pFrame->pts << ", now time: " << nowTime.count() << ", duration: " << duration.count() << std::endl;
-
+                continue;
             }
+            frame_queue_next(&is->pictq);
+            video_display(is, renderer, texture);
 
+            end1 = end2;
+            end2 = std::chrono::high_resolution_clock::now();
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end2 - end1);
+            auto nowTime = std::chrono::duration_cast<std::chrono::milliseconds>(end2 - start);
 
-            av_frame_unref(pFrame);
+            std::cout << "pts: " << frame_queue_peek_last(&is->pictq)->pts << ", now time: " << nowTime.count()
+                      << ", duration: " << duration.count()
+                      << ", queued frames: " << frame_queue_nb_remaining(&is->pictq) << std::endl;
         }
-        av_packet_unref(pkt);
     }
 
+    // 通知各个线程退出，阻塞在队列上的线程会被唤醒
+    packet_queue_abort(&is->videoq);
+    frame_queue_abort(&is->pictq);
+    SDL_WaitThread(is->parse_tid, nullptr);
+    SDL_WaitThread(is->video_tid, nullptr);
+    SDL_WaitThread(refresh_thread, nullptr);
+
+    std::cout << "FrameQueue pushed: " << is->pictq.nb_pushed
+              << ", max occupancy: " << is->pictq.max_occupancy << "/" << is->pictq.max_size
+              << ", decoder waits on full: " << is->pictq.nb_full_waits
+              << ", display underruns: " << is->pictq.nb_underruns << std::endl;
+
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
 
-    if (pkt != nullptr) {
-        av_packet_free(&pkt);
-    }
-    if (pFrame != nullptr) {
-        av_frame_free(&pFrame);
-    }
+    frame_queue_destroy(&is->pictq);
+    packet_queue_destroy(&is->videoq);
+    avcodec_free_context(&is->videoCodecCtx);
+    avformat_close_input(&is->pFormatCtx);
+    delete is;
     return 0;
 }
-